@@ -5,6 +5,7 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 TARGET = OBJViewerQt
 TEMPLATE = app
+CONFIG += c++11
 
 win32 {
     LIBS+=-lopengl32
@@ -13,18 +14,80 @@ win32 {
 
 QMAKE_MAC_SDK = macosx10.12
 
+#gzip and zstd input when zlib and libzstd are found by pkg-config
+packagesExist(zlib) {
+    DEFINES += HAVE_ZLIB
+    CONFIG += link_pkgconfig
+    PKGCONFIG += zlib
+}
+packagesExist(libzstd) {
+    DEFINES += HAVE_ZSTD
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libzstd
+}
+
 SOURCES += main.cpp\
         window.cpp \
     trianglemesh.cpp \
     mfileparser.cpp \
     viewportwidget.cpp \
-    parseworker.cpp
+    parseworker.cpp \
+    renderbenchmark.cpp \
+    parallel.cpp \
+    softwarerasterizer.cpp \
+    meshbuffers.cpp \
+    meshlod.cpp \
+    meshbuilder.cpp \
+    meshdecimator.cpp \
+    meshreorder.cpp \
+    meshcomponents.cpp \
+    facegraph.cpp \
+    pathfinder.cpp \
+    clustergraph.cpp \
+    pathbenchmark.cpp \
+    pathpointwriter.cpp \
+    pathgraphwriter.cpp \
+    pathgraphtiler.cpp \
+    coplanarmerger.cpp \
+    walkabilityfilter.cpp \
+    meshcache.cpp \
+    scene.cpp \
+    vertexwelder.cpp \
+    facetriangulator.cpp \
+    meshfileio.cpp \
+    compressedinput.cpp
 
 HEADERS  += window.h \
     trianglemesh.h \
     mfileparser.h \
     viewportwidget.h \
-    parseworker.h
+    parseworker.h \
+    renderbenchmark.h \
+    parallel.h \
+    rendercamera.h \
+    softwarerasterizer.h \
+    meshbuffers.h \
+    meshlod.h \
+    meshbuilder.h \
+    meshdecimator.h \
+    meshreorder.h \
+    meshcomponents.h \
+    facegraph.h \
+    pathfinder.h \
+    clustergraph.h \
+    pathbenchmark.h \
+    pathpointwriter.h \
+    pathgraphwriter.h \
+    pathgraphtiler.h \
+    pathgraphfile.h \
+    coplanarmerger.h \
+    walkabilityfilter.h \
+    meshcache.h \
+    scene.h \
+    vertexwelder.h \
+    facetriangulator.h \
+    meshfileio.h \
+    compressedinput.h
 
 FORMS    += window.ui
 
@@ -0,0 +1,583 @@
+#include "clustergraph.h"
+#include "parallel.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+
+ClusterGraph::ClusterGraph(const FaceGraph* graph)
+    : mLocal(graph)
+{
+    mGraph = graph;
+    mClusterSize = 256;
+    mClusterCount = 0;
+    mCellSize = 1.0f;
+}
+
+ClusterGraph::~ClusterGraph()
+{
+    for(size_t i=0; i<mFreeStates.size(); i++)
+        delete mFreeStates[i];
+}
+
+void ClusterGraph::setClusterSize(int faces)
+{
+    mClusterSize = qMax(8, faces);
+}
+
+void ClusterGraph::build()
+{
+    QElapsedTimer timer;
+    timer.start();
+    buildClusters();
+    std::vector<std::pair<int,int> > links;
+    std::vector<float> linkWeights;
+    buildPortals(links, linkWeights);
+    buildAbstractGraph(links, linkWeights);
+    qDebug() << "Cluster graph:" << mClusterCount << "clusters," << abstractNodeCount()
+             << "portals," << (qint64)abstractEdgeCount() << "abstract edges in"
+             << timer.elapsed() << "ms";
+}
+
+/**
+ * @brief buildClusters
+ * Bins the centroids into a grid sized for about mClusterSize faces per
+ * occupied cell, then labels the connected pieces of every cell in
+ * parallel, so each cluster is connected.
+ */
+void ClusterGraph::buildClusters()
+{
+    const FaceGraph& graph = *mGraph;
+    const int nodes = graph.nodeCount();
+    float lo[3] = {0,0,0}, hi[3] = {0,0,0};
+    for(int n=0; n<nodes; n++)
+    {
+        for(int a=0; a<3; a++)
+        {
+            const float p = graph.centroids[n*3+a];
+            if(n==0 || p<lo[a]) lo[a] = p;
+            if(n==0 || p>hi[a]) hi[a] = p;
+        }
+    }
+    //Meshes are surfaces, so the face count grows with the square of the cell size
+    const float extent = qMax(hi[0]-lo[0], qMax(hi[1]-lo[1], hi[2]-lo[2]));
+    mCellSize = extent * sqrtf((float)mClusterSize / (float)qMax(1, nodes));
+    if(mCellSize <= 0.0f)
+        mCellSize = 1.0f;
+
+    std::vector<quint64> cellKey(nodes);
+    std::vector<std::pair<quint64,int> > sorted(nodes);
+    parallelFor(0, nodes, 8192, [&](long from, long to) {
+        for(long n=from; n<to; n++)
+        {
+            quint64 key = 0;
+            for(int a=0; a<3; a++)
+            {
+                quint64 c = (quint64)((graph.centroids[n*3+a]-lo[a]) / mCellSize);
+                key = (key << 21) | (c & 0x1fffff);
+            }
+            cellKey[n] = key;
+            sorted[n] = std::make_pair(key, (int)n);
+        }
+    });
+    std::sort(sorted.begin(), sorted.end());
+
+    std::vector<int> runStart;
+    for(int i=0; i<nodes; i++)
+    {
+        if(i==0 || sorted[i].first!=sorted[i-1].first)
+            runStart.push_back(i);
+    }
+    runStart.push_back(nodes);
+    const long runs = (long)runStart.size()-1;
+
+    //Cells touch disjoint node sets, so their flood fills can run concurrently
+    nodeCluster.assign(nodes, -1);
+    std::vector<int> pieces(runs+1, 0);
+    parallelFor(0, runs, 64, [&](long from, long to) {
+        std::deque<int> queue;
+        for(long r=from; r<to; r++)
+        {
+            int count = 0;
+            for(int i=runStart[r]; i<runStart[r+1]; i++)
+            {
+                const int seed = sorted[i].second;
+                if(nodeCluster[seed]>=0)
+                    continue;
+                nodeCluster[seed] = count;
+                queue.push_back(seed);
+                while(!queue.empty())
+                {
+                    const int n = queue.front();
+                    queue.pop_front();
+                    for(int k=graph.offsets[n]; k<graph.offsets[n+1]; k++)
+                    {
+                        const int m = graph.targets[k];
+                        if(cellKey[m]==cellKey[n] && nodeCluster[m]<0)
+                        {
+                            nodeCluster[m] = count;
+                            queue.push_back(m);
+                        }
+                    }
+                }
+                count++;
+            }
+            pieces[r+1] = count;
+        }
+    });
+    for(long r=0; r<runs; r++)
+        pieces[r+1] += pieces[r];
+    mClusterCount = pieces[runs];
+
+    parallelFor(0, runs, 256, [&](long from, long to) {
+        for(long r=from; r<to; r++)
+        {
+            for(int i=runStart[r]; i<runStart[r+1]; i++)
+                nodeCluster[sorted[i].second] += pieces[r];
+        }
+    });
+}
+
+/**
+ * @brief buildPortals
+ * Collects the links between clusters and merges the ones of the same
+ * cluster pair that lie within half a cell of each other into one portal,
+ * keeping the link nearest to the middle of the group.
+ */
+void ClusterGraph::buildPortals(std::vector<std::pair<int,int> >& links,
+                                std::vector<float>& linkWeights)
+{
+    const FaceGraph& graph = *mGraph;
+    struct Border {
+        quint64 pairKey;
+        int a;
+        int b;
+        float weight;
+        bool operator<(const Border& o) const {
+            if(pairKey!=o.pairKey) return pairKey<o.pairKey;
+            if(a!=o.a) return a<o.a;
+            return b<o.b;
+        }
+    };
+
+    std::vector<Border> borders;
+    std::mutex borderLock;
+    parallelFor(0, graph.nodeCount(), 8192, [&](long from, long to) {
+        std::vector<Border> local;
+        for(long n=from; n<to; n++)
+        {
+            for(int k=graph.offsets[n]; k<graph.offsets[n+1]; k++)
+            {
+                const int m = graph.targets[k];
+                const int ca = nodeCluster[n];
+                const int cb = nodeCluster[m];
+                if(ca==cb)
+                    continue;
+                //Every border is seen from both sides; keep the one from the lower cluster
+                if(ca>cb)
+                    continue;
+                Border border = {((quint64)ca << 32) | (quint64)cb, (int)n, m, graph.weights[k]};
+                local.push_back(border);
+            }
+        }
+        std::lock_guard<std::mutex> lock(borderLock);
+        borders.insert(borders.end(), local.begin(), local.end());
+    });
+    std::sort(borders.begin(), borders.end());
+
+    const float spacing = 0.5f * mCellSize;
+    std::vector<int> anchor;
+    std::vector<float> mean;
+    std::vector<int> members;
+    size_t begin = 0;
+    while(begin < borders.size())
+    {
+        size_t end = begin;
+        while(end < borders.size() && borders[end].pairKey==borders[begin].pairKey)
+            end++;
+
+        //Greedy grouping around the first link of every group
+        anchor.clear();
+        mean.clear();
+        members.clear();
+        std::vector<int> group(end-begin);
+        for(size_t i=begin; i<end; i++)
+        {
+            float mid[3];
+            for(int a=0; a<3; a++)
+                mid[a] = 0.5f*(graph.centroids[borders[i].a*3+a] + graph.centroids[borders[i].b*3+a]);
+            int found = -1;
+            for(size_t g=0; g<anchor.size() && found<0; g++)
+            {
+                const Border& first = borders[anchor[g]];
+                float d2 = 0.0f;
+                for(int a=0; a<3; a++)
+                {
+                    float am = 0.5f*(graph.centroids[first.a*3+a] + graph.centroids[first.b*3+a]);
+                    d2 += (mid[a]-am)*(mid[a]-am);
+                }
+                if(d2 <= spacing*spacing)
+                    found = (int)g;
+            }
+            if(found<0)
+            {
+                found = (int)anchor.size();
+                anchor.push_back((int)i);
+                mean.insert(mean.end(), 3, 0.0f);
+                members.push_back(0);
+            }
+            for(int a=0; a<3; a++)
+                mean[found*3+a] += mid[a];
+            members[found]++;
+            group[i-begin] = found;
+        }
+
+        for(size_t g=0; g<anchor.size(); g++)
+        {
+            int best = -1;
+            float bestD2 = 0.0f;
+            for(size_t i=begin; i<end; i++)
+            {
+                if(group[i-begin]!=(int)g)
+                    continue;
+                float d2 = 0.0f;
+                for(int a=0; a<3; a++)
+                {
+                    float mid = 0.5f*(graph.centroids[borders[i].a*3+a] + graph.centroids[borders[i].b*3+a]);
+                    float m = mean[g*3+a] / members[g];
+                    d2 += (mid-m)*(mid-m);
+                }
+                if(best<0 || d2<bestD2)
+                {
+                    best = (int)i;
+                    bestD2 = d2;
+                }
+            }
+            links.push_back(std::make_pair(borders[best].a, borders[best].b));
+            linkWeights.push_back(borders[best].weight);
+        }
+        begin = end;
+    }
+}
+
+void ClusterGraph::buildAbstractGraph(const std::vector<std::pair<int,int> >& links,
+                                      const std::vector<float>& linkWeights)
+{
+    const int nodes = mGraph->nodeCount();
+    mPortalOf.assign(nodes, -1);
+    portalNodes.clear();
+    for(size_t l=0; l<links.size(); l++)
+    {
+        const int ends[2] = {links[l].first, links[l].second};
+        for(int i=0; i<2; i++)
+        {
+            if(mPortalOf[ends[i]]<0)
+            {
+                mPortalOf[ends[i]] = (int)portalNodes.size();
+                portalNodes.push_back(ends[i]);
+            }
+        }
+    }
+    const int portals = (int)portalNodes.size();
+
+    clusterOffsets.assign(mClusterCount+1, 0);
+    for(int p=0; p<portals; p++)
+        clusterOffsets[nodeCluster[portalNodes[p]]+1]++;
+    for(int c=0; c<mClusterCount; c++)
+        clusterOffsets[c+1] += clusterOffsets[c];
+    clusterPortals.resize(portals);
+    std::vector<int> fill(clusterOffsets.begin(), clusterOffsets.end()-1);
+    for(int p=0; p<portals; p++)
+        clusterPortals[fill[nodeCluster[portalNodes[p]]]++] = p;
+
+    struct Edge {
+        int from;
+        int to;
+        float weight;
+        char inter;
+    };
+    //Cached intra-cluster distances, one flood per portal
+    std::vector<std::vector<Edge> > intra(mClusterCount);
+    parallelFor(0, mClusterCount, 16, [&](long from, long to) {
+        PathFinder::SearchState state;
+        for(long c=from; c<to; c++)
+        {
+            for(int i=clusterOffsets[c]; i<clusterOffsets[c+1]; i++)
+            {
+                const int p = clusterPortals[i];
+                mLocal.flood(portalNodes[p], state, &nodeCluster, (int)c);
+                for(int j=clusterOffsets[c]; j<clusterOffsets[c+1]; j++)
+                {
+                    const int q = clusterPortals[j];
+                    const int qn = portalNodes[q];
+                    if(q!=p && state.closed[qn]==state.stamp)
+                    {
+                        Edge e = {p, q, state.g[qn], 0};
+                        intra[c].push_back(e);
+                    }
+                }
+            }
+        }
+    });
+
+    std::vector<Edge> edges;
+    for(size_t l=0; l<links.size(); l++)
+    {
+        const int a = mPortalOf[links[l].first];
+        const int b = mPortalOf[links[l].second];
+        Edge ab = {a, b, linkWeights[l], 1};
+        Edge ba = {b, a, linkWeights[l], 1};
+        edges.push_back(ab);
+        edges.push_back(ba);
+    }
+    for(int c=0; c<mClusterCount; c++)
+        edges.insert(edges.end(), intra[c].begin(), intra[c].end());
+
+    absOffsets.assign(portals+1, 0);
+    for(size_t e=0; e<edges.size(); e++)
+        absOffsets[edges[e].from+1]++;
+    for(int p=0; p<portals; p++)
+        absOffsets[p+1] += absOffsets[p];
+    absTargets.resize(edges.size());
+    absWeights.resize(edges.size());
+    absInter.resize(edges.size());
+    std::vector<int> slot(absOffsets.begin(), absOffsets.end()-1);
+    for(size_t e=0; e<edges.size(); e++)
+    {
+        const int k = slot[edges[e].from]++;
+        absTargets[k] = edges[e].to;
+        absWeights[k] = edges[e].weight;
+        absInter[k] = edges[e].inter;
+    }
+}
+
+bool ClusterGraph::findPath(int start, int goal, PathFinder::Result* result)
+{
+    QueryState* state = acquireState();
+    bool found = search(start, goal, *state, result);
+    releaseState(state);
+    return found;
+}
+
+std::vector<PathFinder::Result> ClusterGraph::findPaths(const std::vector<PathFinder::Query>& queries)
+{
+    std::vector<PathFinder::Result> results(queries.size());
+    const long grain = qMax(1L, (long)queries.size() / (parallelThreadCount()*8));
+    parallelFor(0, (long)queries.size(), grain, [&](long from, long to) {
+        QueryState* state = acquireState();
+        for(long q=from; q<to; q++)
+            search(queries[q].start, queries[q].goal, *state, &results[q]);
+        releaseState(state);
+    });
+    return results;
+}
+
+bool ClusterGraph::search(int start, int goal, QueryState& state, PathFinder::Result* result)
+{
+    const FaceGraph& graph = *mGraph;
+    result->found = false;
+    result->cost = 0.0f;
+    result->expanded = 0;
+    result->path.clear();
+    if(start<0 || goal<0 || start>=graph.nodeCount() || goal>=graph.nodeCount())
+        return false;
+
+    const int sc = nodeCluster[start];
+    const int gc = nodeCluster[goal];
+    if(sc==gc && mLocal.findPath(start, goal, state.local, result, &nodeCluster, sc))
+        return true;
+    long expanded = result->expanded;
+
+    //Abstract nodes, then the start and the goal
+    const int portals = (int)portalNodes.size();
+    const int startNode = portals;
+    const int goalNode = portals+1;
+    PathFinder::SearchState& abs = state.abstract;
+    abs.prepare(portals+2);
+    const unsigned int stamp = abs.stamp;
+    if((int)state.goalStamp.size()!=portals || stamp==1)
+    {
+        state.goalStamp.assign(portals, 0);
+        state.goalCost.resize(portals);
+    }
+
+    expanded += mLocal.flood(goal, state.local, &nodeCluster, gc);
+    for(int i=clusterOffsets[gc]; i<clusterOffsets[gc+1]; i++)
+    {
+        const int p = clusterPortals[i];
+        if(state.local.closed[portalNodes[p]]==state.local.stamp)
+        {
+            state.goalStamp[p] = stamp;
+            state.goalCost[p] = state.local.g[portalNodes[p]];
+        }
+    }
+    expanded += mLocal.flood(start, state.local, &nodeCluster, sc);
+    state.startLinks.clear();
+    for(int i=clusterOffsets[sc]; i<clusterOffsets[sc+1]; i++)
+    {
+        const int p = clusterPortals[i];
+        if(state.local.closed[portalNodes[p]]==state.local.stamp)
+            state.startLinks.push_back(std::make_pair(p, state.local.g[portalNodes[p]]));
+    }
+
+    auto graphNode = [&](int u) {
+        return u<portals ? portalNodes[u] : (u==startNode ? start : goal);
+    };
+    PathFinder::SearchState::OpenOrder order;
+    auto relax = [&](int n, float g0, int m, float w) {
+        if(abs.closed[m]==stamp)
+            return;
+        const float g = g0 + w;
+        if(abs.seen[m]==stamp && g >= abs.g[m])
+            return;
+        abs.seen[m] = stamp;
+        abs.g[m] = g;
+        abs.parent[m] = n;
+        PathFinder::SearchState::OpenEntry entry = {g + graph.distance(graphNode(m), goal), g, m};
+        abs.open.push_back(entry);
+        std::push_heap(abs.open.begin(), abs.open.end(), order);
+    };
+
+    abs.g[startNode] = 0.0f;
+    abs.parent[startNode] = -1;
+    abs.seen[startNode] = stamp;
+    PathFinder::SearchState::OpenEntry first = {graph.distance(start, goal), 0.0f, startNode};
+    abs.open.push_back(first);
+    bool reached = false;
+    while(!abs.open.empty())
+    {
+        std::pop_heap(abs.open.begin(), abs.open.end(), order);
+        const PathFinder::SearchState::OpenEntry current = abs.open.back();
+        abs.open.pop_back();
+        const int n = current.node;
+        if(abs.closed[n]==stamp || current.g > abs.g[n])
+            continue;
+        abs.closed[n] = stamp;
+        expanded++;
+        if(n==goalNode)
+        {
+            reached = true;
+            break;
+        }
+        if(n==startNode)
+        {
+            for(size_t i=0; i<state.startLinks.size(); i++)
+                relax(n, current.g, state.startLinks[i].first, state.startLinks[i].second);
+            continue;
+        }
+        for(int k=absOffsets[n]; k<absOffsets[n+1]; k++)
+            relax(n, current.g, absTargets[k], absWeights[k]);
+        if(state.goalStamp[n]==stamp)
+            relax(n, current.g, goalNode, state.goalCost[n]);
+    }
+    if(!reached)
+    {
+        result->expanded = expanded;
+        return false;
+    }
+
+    state.absPath.clear();
+    for(int u=goalNode; u>=0; u=abs.parent[u])
+        state.absPath.push_back(u);
+    std::reverse(state.absPath.begin(), state.absPath.end());
+
+    //Refine every abstract edge inside its cluster
+    result->path.push_back(start);
+    float cost = 0.0f;
+    for(size_t i=0; i+1<state.absPath.size(); i++)
+    {
+        const int ua = state.absPath[i];
+        const int va = state.absPath[i+1];
+        const int u = graphNode(ua);
+        const int v = graphNode(va);
+        if(u==v)
+            continue;
+        if(nodeCluster[u]!=nodeCluster[v])
+        {
+            //The portal link's weight, as the abstract search used it
+            result->path.push_back(v);
+            for(int k=absOffsets[ua]; k<absOffsets[ua+1]; k++)
+            {
+                if(absTargets[k]==va && absInter[k])
+                {
+                    cost += absWeights[k];
+                    break;
+                }
+            }
+            continue;
+        }
+        if(!mLocal.findPath(u, v, state.local, &state.segment, &nodeCluster, nodeCluster[u]))
+        {
+            result->path.clear();
+            result->expanded = expanded;
+            return false;
+        }
+        expanded += state.segment.expanded;
+        cost += state.segment.cost;
+        result->path.insert(result->path.end(), state.segment.path.begin()+1, state.segment.path.end());
+    }
+    result->found = true;
+    result->cost = cost;
+    result->expanded = expanded;
+    return true;
+}
+
+ClusterGraph::QueryState* ClusterGraph::acquireState()
+{
+    std::lock_guard<std::mutex> lock(mStateLock);
+    if(mFreeStates.empty())
+        return new QueryState();
+    QueryState* state = mFreeStates.back();
+    mFreeStates.pop_back();
+    return state;
+}
+
+void ClusterGraph::releaseState(QueryState* state)
+{
+    std::lock_guard<std::mutex> lock(mStateLock);
+    mFreeStates.push_back(state);
+}
+
+QJsonObject ClusterGraph::toJson() const
+{
+    QJsonObject root;
+    root["cluster_size"] = mClusterSize;
+    root["cluster_count"] = mClusterCount;
+
+    QJsonArray faceClusters;
+    for(size_t n=0; n<nodeCluster.size(); n++)
+        faceClusters.append(nodeCluster[n]);
+    root["face_clusters"] = faceClusters;
+
+    QJsonArray portals;
+    for(size_t p=0; p<portalNodes.size(); p++)
+    {
+        QJsonObject portal;
+        portal["index"] = portalNodes[p] + 1;
+        portal["cluster"] = nodeCluster[portalNodes[p]];
+        portals.append(portal);
+    }
+    root["portals"] = portals;
+
+    //Abstract edges are symmetric; each is written once
+    QJsonArray links;
+    for(size_t p=0; p<portalNodes.size(); p++)
+    {
+        for(int k=absOffsets[p]; k<absOffsets[p+1]; k++)
+        {
+            if(absTargets[k] < (int)p)
+                continue;
+            QJsonObject link;
+            link["start_index"] = portalNodes[p] + 1;
+            link["end_index"] = portalNodes[absTargets[k]] + 1;
+            link["cost"] = absWeights[k];
+            link["inter_cluster"] = absInter[k]!=0;
+            links.append(link);
+        }
+    }
+    root["links"] = links;
+    return root;
+}
@@ -0,0 +1,88 @@
+#ifndef CLUSTERGRAPH_H
+#define CLUSTERGRAPH_H
+
+#include <vector>
+#include <mutex>
+#include <QJsonObject>
+
+#include "pathfinder.h"
+
+/**
+ * Two-level abstraction of a FaceGraph for long queries, after HPA*
+ * (Botea, Mueller and Schaeffer 2004).
+ *
+ * Nodes are grouped into connected clusters of about clusterSize faces
+ * (a grid over the centroids, each cell split into its connected pieces).
+ * Between every pair of touching clusters, border links that lie close
+ * together are merged into one portal link. The abstract graph has a node
+ * for every portal face, an inter-cluster edge per portal link, and
+ * intra-cluster edges with the cached shortest distance between the
+ * portals of a cluster.
+ *
+ * A query links start and goal to the portals of their clusters, runs A*
+ * on the abstract graph and refines each abstract edge with a search
+ * confined to one cluster. Paths are near-optimal, not optimal.
+ */
+class ClusterGraph
+{
+public:
+    explicit ClusterGraph(const FaceGraph* graph);
+    ~ClusterGraph();
+    void setClusterSize(int faces);
+    void build();
+
+    int clusterCount() const { return mClusterCount; }
+    int abstractNodeCount() const { return (int)portalNodes.size(); }
+    long abstractEdgeCount() const { return (long)absTargets.size(); }
+
+    bool findPath(int start, int goal, PathFinder::Result* result);
+    std::vector<PathFinder::Result> findPaths(const std::vector<PathFinder::Query>& queries);
+
+    //Clusters, portals and abstract edges using 1-based face indices
+    QJsonObject toJson() const;
+
+    //Cluster of every graph node
+    std::vector<int> nodeCluster;
+    //Graph node of every abstract node
+    std::vector<int> portalNodes;
+    //Abstract nodes of cluster c are clusterPortals[clusterOffsets[c] .. clusterOffsets[c+1])
+    std::vector<int> clusterOffsets;
+    std::vector<int> clusterPortals;
+    //Abstract edges in CSR form; absInter marks links between clusters
+    std::vector<int> absOffsets;
+    std::vector<int> absTargets;
+    std::vector<float> absWeights;
+    std::vector<char> absInter;
+
+private:
+    struct QueryState {
+        PathFinder::SearchState local;
+        PathFinder::SearchState abstract;
+        std::vector<float> goalCost;
+        std::vector<unsigned int> goalStamp;
+        std::vector<std::pair<int,float> > startLinks;
+        //Abstract nodes from the start to the goal node
+        std::vector<int> absPath;
+        PathFinder::Result segment;
+    };
+
+    void buildClusters();
+    void buildPortals(std::vector<std::pair<int,int> >& links,
+                      std::vector<float>& linkWeights);
+    void buildAbstractGraph(const std::vector<std::pair<int,int> >& links,
+                            const std::vector<float>& linkWeights);
+    bool search(int start, int goal, QueryState& state, PathFinder::Result* result);
+    QueryState* acquireState();
+    void releaseState(QueryState* state);
+
+    const FaceGraph* mGraph;
+    PathFinder mLocal;
+    int mClusterSize;
+    int mClusterCount;
+    float mCellSize;
+    std::vector<int> mPortalOf;
+    std::mutex mStateLock;
+    std::vector<QueryState*> mFreeStates;
+};
+
+#endif // CLUSTERGRAPH_H
@@ -0,0 +1,406 @@
+#include "compressedinput.h"
+
+#include <QFileInfo>
+#include <cstdio>
+#include <cstring>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+//Eight 1 MB blocks keep the reader a few thousand lines ahead of the parser
+const size_t kBlockSize = 1 << 20;
+const int kBlockCount = 8;
+const size_t kInputSize = 256 << 10;
+
+CompressedInput::Compression compressionOf(const std::string& head)
+{
+    const unsigned char* b = (const unsigned char*)head.data();
+    if(head.size()>=2 && b[0]==0x1f && b[1]==0x8b)
+        return CompressedInput::Gzip;
+    if(head.size()>=4 && b[0]==0x28 && b[1]==0xb5 && b[2]==0x2f && b[3]==0xfd)
+        return CompressedInput::Zstd;
+    return CompressedInput::None;
+}
+
+}
+
+CompressedInput::CompressedInput()
+{
+    mCompression = None;
+    mFinished = true;
+    mStop = false;
+    mFailed = false;
+    mCurrent = -1;
+    mOffset = 0;
+}
+
+CompressedInput::~CompressedInput()
+{
+    close();
+}
+
+bool CompressedInput::handles(QString fileName)
+{
+    if(fileName=="-")
+        return true;
+#ifndef _WIN32
+    //Reading the magic bytes of a pipe here would consume them
+    struct stat status;
+    if(stat(QFile::encodeName(fileName).constData(), &status)==0 && S_ISFIFO(status.st_mode))
+        return true;
+#endif
+    if(!QFileInfo(fileName).isFile())
+        return false;
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray head = file.read(4);
+    file.close();
+    return compressionOf(std::string(head.constData(), head.size()))!=None;
+}
+
+bool CompressedInput::open(QString fileName)
+{
+    close();
+    bool opened;
+    if(fileName=="-")
+        opened = mInput.open(fileno(stdin), QIODevice::ReadOnly | QIODevice::Unbuffered);
+    else
+    {
+        mInput.setFileName(fileName);
+        opened = mInput.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+    if(!opened)
+    {
+        mError = mInput.errorString();
+        return false;
+    }
+
+    //A pipe may deliver the magic bytes over several reads
+    mHead.clear();
+    char magic[4];
+    while(mHead.size()<4)
+    {
+        qint64 n = mInput.read(magic, 4 - (qint64)mHead.size());
+        if(n<=0)
+            break;
+        mHead.append(magic, (size_t)n);
+    }
+    mCompression = compressionOf(mHead);
+#ifndef HAVE_ZLIB
+    if(mCompression==Gzip)
+    {
+        mError = "gzip input needs a build with zlib (HAVE_ZLIB)";
+        mInput.close();
+        return false;
+    }
+#endif
+#ifndef HAVE_ZSTD
+    if(mCompression==Zstd)
+    {
+        mError = "zstd input needs a build with zstd (HAVE_ZSTD)";
+        mInput.close();
+        return false;
+    }
+#endif
+
+    mBlocks.resize(kBlockCount);
+    mFree.clear();
+    mFilled.clear();
+    for(int i=0; i<kBlockCount; i++)
+    {
+        mBlocks[i].data.resize(kBlockSize);
+        mBlocks[i].size = 0;
+        mFree.push_back(i);
+    }
+    mFinished = false;
+    mStop = false;
+    mFailed = false;
+    mError = QString();
+    mCurrent = -1;
+    mOffset = 0;
+    QIODevice::open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    mReader = std::thread(&CompressedInput::produce, this);
+    return true;
+}
+
+void CompressedInput::close()
+{
+    if(mReader.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mStop = true;
+        }
+        mChanged.notify_all();
+        mReader.join();
+    }
+    if(mInput.isOpen())
+        mInput.close();
+    mCurrent = -1;
+    QIODevice::close();
+}
+
+CompressedInput::Compression CompressedInput::compression() const
+{
+    return mCompression;
+}
+
+bool CompressedInput::failed() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mFailed;
+}
+
+QString CompressedInput::error() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mError;
+}
+
+bool CompressedInput::isSequential() const
+{
+    return true;
+}
+
+bool CompressedInput::atEnd() const
+{
+    return QIODevice::bytesAvailable()==0 && !const_cast<CompressedInput*>(this)->nextBlock();
+}
+
+qint64 CompressedInput::bytesAvailable() const
+{
+    const qint64 current = mCurrent>=0 ? (qint64)(mBlocks[mCurrent].size - mOffset) : 0;
+    return current + QIODevice::bytesAvailable();
+}
+
+qint64 CompressedInput::readData(char* data, qint64 maxSize)
+{
+    if(!nextBlock())
+        return 0;
+    const Block& block = mBlocks[mCurrent];
+    const size_t n = qMin((size_t)maxSize, block.size - mOffset);
+    memcpy(data, block.data.data() + mOffset, n);
+    mOffset += n;
+    return (qint64)n;
+}
+
+qint64 CompressedInput::writeData(const char* data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+bool CompressedInput::nextBlock()
+{
+    if(mCurrent>=0 && mOffset<mBlocks[mCurrent].size)
+        return true;
+    std::unique_lock<std::mutex> lock(mLock);
+    if(mCurrent>=0)
+    {
+        mFree.push_back(mCurrent);
+        mCurrent = -1;
+        mChanged.notify_all();
+    }
+    mChanged.wait(lock, [this]() { return !mFilled.empty() || mFinished; });
+    if(mFilled.empty())
+        return false;
+    mCurrent = mFilled.front();
+    mFilled.pop_front();
+    mOffset = 0;
+    return true;
+}
+
+bool CompressedInput::readInput(std::vector<char>& buffer, size_t& size)
+{
+    if(!mHead.empty())
+    {
+        memcpy(buffer.data(), mHead.data(), mHead.size());
+        size = mHead.size();
+        mHead.clear();
+        return true;
+    }
+    qint64 n = mInput.read(buffer.data(), (qint64)buffer.size());
+    if(n<0)
+        return false;
+    size = (size_t)n;
+    return true;
+}
+
+void CompressedInput::finish(bool failed, QString error)
+{
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mFinished = true;
+        mFailed = failed;
+        mError = error;
+    }
+    mChanged.notify_all();
+}
+
+/**
+ * @brief produce
+ * Runs on the reader thread: takes a free block, decodes input into it
+ * until it is full or the input ends, and queues it for the consumer.
+ */
+void CompressedInput::produce()
+{
+#ifdef HAVE_ZLIB
+    z_stream zlib;
+    memset(&zlib, 0, sizeof(zlib));
+    if(mCompression==Gzip && inflateInit2(&zlib, 15 + 32)!=Z_OK)
+    {
+        finish(true, "unable to initialize zlib");
+        return;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream* zstd = NULL;
+    if(mCompression==Zstd)
+    {
+        zstd = ZSTD_createDStream();
+        ZSTD_initDStream(zstd);
+    }
+#endif
+
+    std::vector<char> input(kInputSize);
+    size_t inputSize = 0;
+    size_t inputOffset = 0;
+    bool inputEnded = false;
+    //True between the end of a gzip member or zstd frame and the next byte
+    bool frameEnded = mCompression==None;
+    bool ended = false;
+    bool failed = false;
+    QString error;
+    while(!ended)
+    {
+        int index;
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mChanged.wait(lock, [this]() { return !mFree.empty() || mStop; });
+            if(mStop)
+                break;
+            index = mFree.front();
+            mFree.pop_front();
+        }
+        Block& block = mBlocks[index];
+        block.size = 0;
+        while(block.size<block.data.size())
+        {
+            if(inputOffset==inputSize && !inputEnded)
+            {
+                inputOffset = 0;
+                if(!readInput(input, inputSize))
+                {
+                    failed = true;
+                    error = mInput.errorString();
+                    inputSize = 0;
+                }
+                inputEnded = inputSize==0;
+            }
+            const size_t available = inputSize - inputOffset;
+            char* out = block.data.data() + block.size;
+            const size_t room = block.data.size() - block.size;
+            size_t consumed = 0;
+            size_t produced = 0;
+            if(mCompression==None)
+            {
+                consumed = produced = qMin(available, room);
+                memcpy(out, input.data() + inputOffset, produced);
+            }
+#ifdef HAVE_ZLIB
+            else if(mCompression==Gzip && frameEnded && available>0 && input[inputOffset]==0)
+            {
+                //Zero padding after the last member, as tape blocking leaves;
+                //gzip(1) ignores it too
+                while(consumed<available && input[inputOffset+consumed]==0)
+                    consumed++;
+            }
+            else if(mCompression==Gzip)
+            {
+                zlib.next_in = (Bytef*)(input.data() + inputOffset);
+                zlib.avail_in = (uInt)available;
+                zlib.next_out = (Bytef*)out;
+                zlib.avail_out = (uInt)room;
+                int status = inflate(&zlib, Z_NO_FLUSH);
+                consumed = available - zlib.avail_in;
+                produced = room - zlib.avail_out;
+                if(consumed>0)
+                    frameEnded = false;
+                if(status==Z_STREAM_END)
+                {
+                    //pigz and concatenated files carry further members
+                    frameEnded = true;
+                    inflateReset(&zlib);
+                }
+                else if(status!=Z_OK && status!=Z_BUF_ERROR)
+                {
+                    failed = true;
+                    error = zlib.msg!=NULL ? QString(zlib.msg) : QString("corrupt gzip data");
+                    ended = true;
+                }
+            }
+#endif
+#ifdef HAVE_ZSTD
+            else
+            {
+                ZSTD_inBuffer in = {input.data() + inputOffset, available, 0};
+                ZSTD_outBuffer outBuffer = {out, room, 0};
+                size_t status = ZSTD_decompressStream(zstd, &outBuffer, &in);
+                consumed = in.pos;
+                produced = outBuffer.pos;
+                if(ZSTD_isError(status))
+                {
+                    failed = true;
+                    error = ZSTD_getErrorName(status);
+                    ended = true;
+                }
+                else if(consumed>0 || produced>0)
+                    frameEnded = status==0;
+            }
+#endif
+            inputOffset += consumed;
+            block.size += produced;
+            if(ended)
+                break;
+            //No progress is only possible once all input has been decoded
+            if(consumed==0 && produced==0 && inputEnded)
+            {
+                if(!frameEnded && !failed)
+                {
+                    failed = true;
+                    error = "compressed stream is truncated";
+                }
+                ended = true;
+                break;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if(block.size>0)
+                mFilled.push_back(index);
+            else
+                mFree.push_front(index);
+        }
+        mChanged.notify_all();
+    }
+
+#ifdef HAVE_ZLIB
+    if(mCompression==Gzip)
+        inflateEnd(&zlib);
+#endif
+#ifdef HAVE_ZSTD
+    if(zstd!=NULL)
+        ZSTD_freeDStream(zstd);
+#endif
+    finish(failed, error);
+}
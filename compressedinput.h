@@ -0,0 +1,91 @@
+#ifndef COMPRESSEDINPUT_H
+#define COMPRESSEDINPUT_H
+
+#include <QIODevice>
+#include <QFile>
+#include <QString>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * Read-only sequential device over a gzip, zstd or plain stream, read from
+ * a file, a pipe, or standard input when the file name is "-".
+ *
+ * A reader thread decompresses into a ring of fixed-size blocks while the
+ * consumer (the OBJ parser's QTextStream) reads the filled ones, so
+ * decompression overlaps with parsing and memory stays at the size of the
+ * ring whatever the size of the input. Concatenated gzip members, as
+ * written by pigz, are read one after another. gzip needs a build with
+ * HAVE_ZLIB and zstd one with HAVE_ZSTD.
+ */
+class CompressedInput : public QIODevice
+{
+public:
+    enum Compression {
+        None,
+        Gzip,
+        Zstd
+    };
+
+    explicit CompressedInput();
+    ~CompressedInput();
+
+    //True for "-", pipes/FIFOs and regular files starting with gzip or zstd magic bytes
+    static bool handles(QString fileName);
+
+    //Detects the compression from the first bytes and starts the reader thread
+    bool open(QString fileName);
+    //Stops the reader thread; a reader blocked on a pipe is waited for
+    void close();
+    Compression compression() const;
+    //Set when the stream was truncated or corrupt; the data up to there was read
+    bool failed() const;
+    QString error() const;
+
+    bool isSequential() const;
+    //Waits for the reader thread until data arrives or the stream ends
+    bool atEnd() const;
+    qint64 bytesAvailable() const;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize);
+    qint64 writeData(const char* data, qint64 maxSize);
+
+private:
+    struct Block {
+        std::vector<char> data;
+        size_t size;
+    };
+
+    void produce();
+    //Next filled block for the consumer; false once the stream has ended
+    bool nextBlock();
+    bool readInput(std::vector<char>& buffer, size_t& size);
+    void finish(bool failed, QString error);
+
+    QFile mInput;
+    Compression mCompression;
+    //First bytes, read to detect the compression, then decoded like the rest
+    std::string mHead;
+    std::thread mReader;
+
+    std::vector<Block> mBlocks;
+    mutable std::mutex mLock;
+    std::condition_variable mChanged;
+    std::deque<int> mFilled;
+    std::deque<int> mFree;
+    bool mFinished;
+    bool mStop;
+    bool mFailed;
+    QString mError;
+
+    //Block being read by the consumer
+    int mCurrent;
+    size_t mOffset;
+};
+
+#endif // COMPRESSEDINPUT_H
@@ -0,0 +1,230 @@
+#include "coplanarmerger.h"
+#include "meshbuilder.h"
+#include "facetriangulator.h"
+
+#include <QDebug>
+#include <cmath>
+
+namespace {
+
+//Newell normal of a face loop, normalized; zero for degenerate faces
+void faceNormal(PolygonMesh::HE_face* face, float* n)
+{
+    FaceTriangulator::newellNormal(face, n);
+    const float length = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    if(length>0.0f)
+    {
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+    }
+}
+
+//Start vertex of a half-edge (vert is the destination)
+inline PolygonMesh::HE_vert* origin(PolygonMesh::HE_edge* e)
+{
+    return e->prev->vert;
+}
+
+//Turn at b is convex (or straight) around normal n
+bool convexTurn(const PolygonMesh::HE_vert* a, const PolygonMesh::HE_vert* b,
+                const PolygonMesh::HE_vert* c, const float* n)
+{
+    const float ux = b->x - a->x, uy = b->y - a->y, uz = b->z - a->z;
+    const float vx = c->x - b->x, vy = c->y - b->y, vz = c->z - b->z;
+    const float turn = (uy*vz - uz*vy)*n[0] + (uz*vx - ux*vz)*n[1] + (ux*vy - uy*vx)*n[2];
+    const float scale = sqrtf((ux*ux + uy*uy + uz*uz) * (vx*vx + vy*vy + vz*vz));
+    return turn >= -1e-4f * scale;
+}
+
+}
+
+CoplanarMerger::CoplanarMerger(const PolygonMesh* mesh)
+{
+    mMesh = mesh;
+    mAngleTolerance = 1.0f;
+    mPlaneTolerance = 0.0f;
+    mMaxVertices = 0;
+    mPolygonCount = 0;
+    mCosTolerance = 1.0f;
+    mDistance = 0.0f;
+}
+
+void CoplanarMerger::setAngleTolerance(float degrees){
+    mAngleTolerance = qMax(0.0f, degrees);
+}
+
+void CoplanarMerger::setPlaneTolerance(float distance){
+    mPlaneTolerance = qMax(0.0f, distance);
+}
+
+void CoplanarMerger::setMaxVertices(int vertices){
+    mMaxVertices = qMax(0, vertices);
+}
+
+/**
+ * @brief CoplanarMerger::tryMerge
+ * Absorbs the face across outline[at] if it is coplanar with the seed and
+ * the outline stays convex. The face loop from the twin's successor to its
+ * predecessor replaces outline[at].
+ */
+bool CoplanarMerger::tryMerge(std::vector<PolygonMesh::HE_edge*>& outline, int at,
+                              const float* normal, const float* origin_, int polygon)
+{
+    PolygonMesh::HE_edge* h = outline[at];
+    if(h->pair==NULL || h->pair->face==NULL)
+        return false;
+    PolygonMesh::HE_face* face = h->pair->face;
+    if(face->edge==NULL || mFacePolygon[face->index-1]>=0)
+        return false;
+
+    float n[3];
+    faceNormal(face, n);
+    if(n[0]*normal[0] + n[1]*normal[1] + n[2]*normal[2] < mCosTolerance)
+        return false;
+
+    //New outline vertices are the destinations of twin->next .. twin->prev->prev
+    PolygonMesh::HE_edge* twin = h->pair;
+    int added = 0;
+    for(PolygonMesh::HE_edge* e=twin->next; e!=twin->prev; e=e->next)
+    {
+        const PolygonMesh::HE_vert* v = e->vert;
+        //A vertex already on the outline would pinch it
+        if(mVertexPolygon[v->index-1]==polygon)
+            return false;
+        const float d = (v->x-origin_[0])*normal[0] + (v->y-origin_[1])*normal[1] +
+                        (v->z-origin_[2])*normal[2];
+        if(fabsf(d) > mDistance)
+            return false;
+        added++;
+        if(e->next==NULL)
+            return false;
+    }
+    if(mMaxVertices>0 && (int)outline.size() + added > mMaxVertices)
+        return false;
+
+    //Convexity only changes at the two ends of the edge and the new vertices
+    const int count = (int)outline.size();
+    const PolygonMesh::HE_vert* before = origin(outline[(at+count-1)%count]);
+    const PolygonMesh::HE_vert* after = outline[(at+1)%count]->vert;
+    const PolygonMesh::HE_vert* prev = before;
+    const PolygonMesh::HE_vert* curr = origin(h);
+    for(PolygonMesh::HE_edge* e=twin->next; ; e=e->next)
+    {
+        if(!convexTurn(prev, curr, e->vert, normal))
+            return false;
+        prev = curr;
+        curr = e->vert;
+        if(e==twin->prev)
+            break;
+    }
+    if(!convexTurn(prev, curr, after, normal))
+        return false;
+
+    std::vector<PolygonMesh::HE_edge*> chain;
+    for(PolygonMesh::HE_edge* e=twin->next; ; e=e->next)
+    {
+        chain.push_back(e);
+        if(e!=twin->prev)
+            mVertexPolygon[e->vert->index-1] = polygon;
+        else
+            break;
+    }
+    outline.erase(outline.begin()+at);
+    outline.insert(outline.begin()+at, chain.begin(), chain.end());
+    mFacePolygon[face->index-1] = polygon;
+    return true;
+}
+
+PolygonMesh* CoplanarMerger::merge()
+{
+    const long faceCount = (long)mMesh->faceVector->size();
+    const long vertCount = (long)mMesh->vertVector->size();
+    mFacePolygon.assign(faceCount, -1);
+    mVertexPolygon.assign(vertCount, -1);
+    mCosTolerance = cosf(mAngleTolerance * (float)M_PI / 180.0f);
+    mDistance = mPlaneTolerance;
+    if(mDistance<=0.0f)
+    {
+        QVector3D extent = *mMesh->maxVector - *mMesh->minVector;
+        mDistance = qMax(1e-6f, 1e-3f * extent.length());
+    }
+
+    std::vector<float> positions(vertCount*3);
+    for(long v=0; v<vertCount; v++)
+    {
+        PolygonMesh::HE_vert* vert = mMesh->vertVector->at(v);
+        positions[v*3] = vert->x;
+        positions[v*3+1] = vert->y;
+        positions[v*3+2] = vert->z;
+    }
+    std::vector<unsigned int> offsets(1, 0);
+    std::vector<unsigned int> indices;
+    std::vector<PolygonMesh::HE_edge*> outline;
+
+    int polygon = 0;
+    for(long f=0; f<faceCount; f++)
+    {
+        PolygonMesh::HE_face* seed = mMesh->faceVector->at(f);
+        if(seed->edge==NULL || mFacePolygon[f]>=0)
+            continue;
+        float normal[3];
+        faceNormal(seed, normal);
+        const float seedOrigin[3] = {seed->edge->vert->x, seed->edge->vert->y, seed->edge->vert->z};
+
+        outline.clear();
+        PolygonMesh::HE_edge* e = seed->edge;
+        do {
+            outline.push_back(e);
+            mVertexPolygon[e->vert->index-1] = polygon;
+            e = e->next;
+        } while(e!=NULL && e!=seed->edge);
+        mFacePolygon[f] = polygon;
+
+        //Degenerate seeds have no plane to grow in
+        const bool flat = normal[0]!=0.0f || normal[1]!=0.0f || normal[2]!=0.0f;
+        bool grown = flat;
+        while(grown)
+        {
+            grown = false;
+            for(int i=0; i<(int)outline.size(); i++)
+            {
+                if(tryMerge(outline, i, normal, seedOrigin, polygon))
+                    grown = true;
+            }
+        }
+
+        for(size_t i=0; i<outline.size(); i++)
+            indices.push_back((unsigned int)(origin(outline[i])->index - 1));
+        offsets.push_back((unsigned int)indices.size());
+        polygon++;
+    }
+    mPolygonCount = polygon;
+
+    PolygonMesh* merged = MeshBuilder::build(positions, offsets, indices);
+    //Path nodes use unit normals and sit at the average of the polygon's corners
+    for(long p=0; p<mPolygonCount; p++)
+    {
+        PolygonMesh::HE_face* face = merged->faceVector->at(p);
+        if(face->edge==NULL)
+            continue;
+        float n[3];
+        faceNormal(face, n);
+        face->normal->x = n[0];
+        face->normal->y = n[1];
+        face->normal->z = n[2];
+        float cx = 0.0f, cy = 0.0f, cz = 0.0f;
+        const unsigned int corners = offsets[p+1] - offsets[p];
+        for(unsigned int k=offsets[p]; k<offsets[p+1]; k++)
+        {
+            cx += positions[indices[k]*3];
+            cy += positions[indices[k]*3+1];
+            cz += positions[indices[k]*3+2];
+        }
+        face->centroid->x = cx / corners;
+        face->centroid->y = cy / corners;
+        face->centroid->z = cz / corners;
+    }
+    qDebug() << "Merged" << faceCount << "faces into" << mPolygonCount << "convex polygons";
+    return merged;
+}
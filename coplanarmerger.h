@@ -0,0 +1,50 @@
+#ifndef COPLANARMERGER_H
+#define COPLANARMERGER_H
+
+#include <vector>
+
+#include "trianglemesh.h"
+
+/**
+ * Merges adjacent coplanar faces into convex polygons, so flat floors and
+ * walls become a few path nodes instead of one node per triangle.
+ *
+ * Polygons are grown greedily from a seed face across twinned half-edges.
+ * A neighbour is absorbed when its normal is within the angle tolerance of
+ * the seed normal, its vertices lie within the plane tolerance of the seed
+ * plane and the grown outline stays convex. The result is a new polygon
+ * PolygonMesh whose shared half-edges are the portals between polygons.
+ */
+class CoplanarMerger
+{
+public:
+    explicit CoplanarMerger(const PolygonMesh* mesh);
+    void setAngleTolerance(float degrees);
+    //Distance from the seed plane in model units; 0 uses 1e-3 of the bounding box diagonal
+    void setPlaneTolerance(float distance);
+    //Upper bound on the outline length of a polygon, 0 for no limit
+    void setMaxVertices(int vertices);
+
+    //Returns a new mesh with one face per polygon; the input is not changed
+    PolygonMesh* merge();
+
+    long polygonCount() const { return mPolygonCount; }
+    //Polygon of every input face, indexed by face->index-1
+    const std::vector<int>& facePolygons() const { return mFacePolygon; }
+
+private:
+    bool tryMerge(std::vector<PolygonMesh::HE_edge*>& outline, int at,
+                  const float* normal, const float* origin, int polygon);
+
+    const PolygonMesh* mMesh;
+    float mAngleTolerance;
+    float mPlaneTolerance;
+    int mMaxVertices;
+    long mPolygonCount;
+    std::vector<int> mFacePolygon;
+    std::vector<int> mVertexPolygon;
+    float mCosTolerance;
+    float mDistance;
+};
+
+#endif // COPLANARMERGER_H
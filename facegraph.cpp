@@ -0,0 +1,84 @@
+#include "facegraph.h"
+#include "parallel.h"
+
+#include <cmath>
+
+FaceGraph::FaceGraph()
+{
+    offsets.assign(1, 0);
+}
+
+float FaceGraph::distance(int a, int b) const
+{
+    const float dx = centroids[a*3] - centroids[b*3];
+    const float dy = centroids[a*3+1] - centroids[b*3+1];
+    const float dz = centroids[a*3+2] - centroids[b*3+2];
+    return sqrtf(dx*dx + dy*dy + dz*dz);
+}
+
+void FaceGraph::build(const PolygonMesh* mesh)
+{
+    const long faceCount = (long)mesh->faceVector->size();
+    centroids.resize(faceCount*3);
+    offsets.assign(faceCount+1, 0);
+
+    //Distinct neighbours of face f, written to out; returns the count
+    auto neighbours = [mesh](long f, int* out, int capacity) {
+        PolygonMesh::HE_face* face = mesh->faceVector->at(f);
+        PolygonMesh::HE_edge* e = face->edge;
+        int count = 0;
+        if(e==NULL)
+            return 0;
+        do {
+            if(e->pair!=NULL && e->pair->face!=face)
+            {
+                int n = (int)(e->pair->face->index - 1);
+                bool known = false;
+                for(int k=0; k<count && !known; k++)
+                    known = out[k]==n;
+                if(!known && count<capacity)
+                    out[count++] = n;
+            }
+            e = e->next;
+        } while(e!=NULL && e!=face->edge);
+        return count;
+    };
+
+    parallelFor(0, faceCount, 8192, [&](long from, long to) {
+        std::vector<int> scratch;
+        for(long f=from; f<to; f++)
+        {
+            PolygonMesh::HE_face* face = mesh->faceVector->at(f);
+            centroids[f*3] = face->centroid ? face->centroid->x : 0.0f;
+            centroids[f*3+1] = face->centroid ? face->centroid->y : 0.0f;
+            centroids[f*3+2] = face->centroid ? face->centroid->z : 0.0f;
+            //At most one neighbour per edge, however large the polygon
+            int edges = 0;
+            PolygonMesh::HE_edge* e = face->edge;
+            if(e!=NULL)
+            {
+                do {
+                    edges++;
+                    e = e->next;
+                } while(e!=NULL && e!=face->edge);
+            }
+            if((int)scratch.size() < edges)
+                scratch.resize(edges);
+            offsets[f+1] = edges>0 ? neighbours(f, &scratch[0], edges) : 0;
+        }
+    });
+    for(long f=0; f<faceCount; f++)
+        offsets[f+1] += offsets[f];
+
+    targets.resize(offsets[faceCount]);
+    weights.resize(offsets[faceCount]);
+    parallelFor(0, faceCount, 8192, [&](long from, long to) {
+        for(long f=from; f<to; f++)
+        {
+            int* out = &targets[offsets[f]];
+            int count = neighbours(f, out, offsets[f+1]-offsets[f]);
+            for(int k=0; k<count; k++)
+                weights[offsets[f]+k] = distance((int)f, out[k]);
+        }
+    });
+}
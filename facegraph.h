@@ -0,0 +1,32 @@
+#ifndef FACEGRAPH_H
+#define FACEGRAPH_H
+
+#include <vector>
+
+#include "trianglemesh.h"
+
+/**
+ * Face adjacency of a PolygonMesh in compressed sparse row form: the graph
+ * behind the pedestrian_path_points export. Node n is the face with index
+ * n+1, placed at its centroid; faces sharing a twinned half-edge are linked
+ * with the Euclidean distance between their centroids as weight.
+ */
+class FaceGraph
+{
+public:
+    explicit FaceGraph();
+    void build(const PolygonMesh* mesh);
+
+    int nodeCount() const { return (int)offsets.size() - 1; }
+    long linkCount() const { return (long)targets.size(); }
+    float distance(int a, int b) const;
+
+    //Neighbours of node n are targets[offsets[n] .. offsets[n+1])
+    std::vector<int> offsets;
+    std::vector<int> targets;
+    std::vector<float> weights;
+    //xyz per node
+    std::vector<float> centroids;
+};
+
+#endif // FACEGRAPH_H
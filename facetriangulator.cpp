@@ -0,0 +1,219 @@
+#include "facetriangulator.h"
+#include "parallel.h"
+
+#include <cmath>
+
+FaceTriangulator::FaceTriangulator()
+{
+    mOrientation = 1.0f;
+}
+
+void FaceTriangulator::newellNormal(const PolygonMesh::HE_face* face, float* normal)
+{
+    normal[0] = normal[1] = normal[2] = 0.0f;
+    PolygonMesh::HE_edge* e = face->edge;
+    if(e==NULL)
+        return;
+    do {
+        const PolygonMesh::HE_vert* a = e->prev->vert;
+        const PolygonMesh::HE_vert* b = e->vert;
+        normal[0] += (a->y - b->y) * (a->z + b->z);
+        normal[1] += (a->z - b->z) * (a->x + b->x);
+        normal[2] += (a->x - b->x) * (a->y + b->y);
+        e = e->next;
+    } while(e!=NULL && e!=face->edge);
+}
+
+/**
+ * @brief centroid
+ * Sums the fan triangles from the first corner weighted by their signed
+ * area along the normal, which stays correct for concave faces.
+ */
+void FaceTriangulator::centroid(const PolygonMesh::HE_face* face, const float* normal, float* centroid)
+{
+    centroid[0] = centroid[1] = centroid[2] = 0.0f;
+    PolygonMesh::HE_edge* first = face->edge;
+    if(first==NULL)
+        return;
+
+    const PolygonMesh::HE_vert* o = first->vert;
+    float sum[3] = {0.0f, 0.0f, 0.0f};
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    float weight = 0.0f;
+    int corners = 0;
+    PolygonMesh::HE_edge* e = first;
+    do {
+        const PolygonMesh::HE_vert* a = e->vert;
+        const PolygonMesh::HE_vert* b = e->next->vert;
+        mean[0] += a->x;
+        mean[1] += a->y;
+        mean[2] += a->z;
+        corners++;
+        const float u[3] = {a->x - o->x, a->y - o->y, a->z - o->z};
+        const float v[3] = {b->x - o->x, b->y - o->y, b->z - o->z};
+        const float w = (u[1]*v[2] - u[2]*v[1]) * normal[0] +
+                        (u[2]*v[0] - u[0]*v[2]) * normal[1] +
+                        (u[0]*v[1] - u[1]*v[0]) * normal[2];
+        sum[0] += w * (o->x + a->x + b->x);
+        sum[1] += w * (o->y + a->y + b->y);
+        sum[2] += w * (o->z + a->z + b->z);
+        weight += w;
+        e = e->next;
+    } while(e!=NULL && e!=first);
+
+    const float length = normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2];
+    //Weights are twice the area times |normal|; compare against that scale
+    if(fabsf(weight) > 1e-6f * length)
+    {
+        for(int a=0; a<3; a++)
+            centroid[a] = sum[a] / (3.0f * weight);
+    }
+    else
+    {
+        for(int a=0; a<3; a++)
+            centroid[a] = mean[a] / corners;
+    }
+}
+
+int FaceTriangulator::triangulate(const PolygonMesh::HE_face* face, const float* normal,
+                                  std::vector<unsigned int>& triangles)
+{
+    mIds.clear();
+    mU.clear();
+    mV.clear();
+    PolygonMesh::HE_edge* e = face->edge;
+    if(e==NULL)
+        return 0;
+
+    //Project onto the coordinate plane the face is most parallel to
+    const float ax = fabsf(normal[0]), ay = fabsf(normal[1]), az = fabsf(normal[2]);
+    const int axis = (ax>=ay && ax>=az) ? 0 : (ay>=az ? 1 : 2);
+    mOrientation = normal[axis] < 0.0f ? -1.0f : 1.0f;
+    do {
+        const PolygonMesh::HE_vert* v = e->vert;
+        mIds.push_back((unsigned int)(v->index - 1));
+        mU.push_back(axis==0 ? v->y : (axis==1 ? v->z : v->x));
+        mV.push_back(axis==0 ? v->z : (axis==1 ? v->x : v->y));
+        e = e->next;
+    } while(e!=NULL && e!=face->edge);
+
+    const int n = (int)mIds.size();
+    if(n<3)
+        return 0;
+    if(n==3)
+    {
+        triangles.insert(triangles.end(), mIds.begin(), mIds.end());
+        return 1;
+    }
+
+    mPrev.resize(n);
+    mNext.resize(n);
+    for(int i=0; i<n; i++)
+    {
+        mPrev[i] = (i+n-1) % n;
+        mNext[i] = (i+1) % n;
+    }
+
+    int remaining = n;
+    int i = 0;
+    int misses = 0;
+    while(remaining > 3)
+    {
+        const int p = mPrev[i];
+        const int x = mNext[i];
+        if(isEar(p, i, remaining) || misses >= remaining)
+        {
+            triangles.push_back(mIds[p]);
+            triangles.push_back(mIds[i]);
+            triangles.push_back(mIds[x]);
+            mNext[p] = x;
+            mPrev[x] = p;
+            remaining--;
+            misses = 0;
+            i = p;
+        }
+        else
+        {
+            i = x;
+            misses++;
+        }
+    }
+    triangles.push_back(mIds[mPrev[i]]);
+    triangles.push_back(mIds[i]);
+    triangles.push_back(mIds[mNext[i]]);
+    return n - 2;
+}
+
+/**
+ * @brief isEar
+ * Corner i is an ear if it is convex and no other remaining corner lies in
+ * the triangle it forms with its neighbours.
+ */
+bool FaceTriangulator::isEar(int p, int i, int remaining) const
+{
+    const int x = mNext[i];
+    const float u0 = mU[p], v0 = mV[p];
+    const float u1 = mU[i], v1 = mV[i];
+    const float u2 = mU[x], v2 = mV[x];
+    if(mOrientation * ((u1-u0)*(v2-v0) - (v1-v0)*(u2-u0)) <= 0.0f)
+        return false;
+
+    int j = mNext[x];
+    for(int k=0; k<remaining-3; k++, j=mNext[j])
+    {
+        //A corner repeated on the outline touches the ear without being inside
+        if(mIds[j]==mIds[p] || mIds[j]==mIds[i] || mIds[j]==mIds[x])
+            continue;
+        const float u = mU[j], v = mV[j];
+        if(mOrientation * ((u1-u0)*(v-v0) - (v1-v0)*(u-u0)) >= 0.0f &&
+           mOrientation * ((u2-u1)*(v-v1) - (v2-v1)*(u-u1)) >= 0.0f &&
+           mOrientation * ((u0-u2)*(v-v2) - (v0-v2)*(u-u2)) >= 0.0f)
+            return false;
+    }
+    return true;
+}
+
+void FaceTriangulator::triangulateMesh(const PolygonMesh* mesh,
+                                       std::vector<unsigned int>& triangles,
+                                       std::vector<unsigned int>& faceOffsets)
+{
+    const long faceCount = (long)mesh->faceVector->size();
+    const long grain = 8192;
+    const long chunks = (faceCount + grain - 1) / grain;
+    std::vector<std::vector<unsigned int> > results(chunks);
+    faceOffsets.assign(faceCount+1, 0);
+
+    parallelFor(0, chunks, 1, [&](long from, long to) {
+        FaceTriangulator triangulator;
+        for(long c=from; c<to; c++)
+        {
+            long last = qMin(faceCount, (c+1)*grain);
+            for(long f=c*grain; f<last; f++)
+            {
+                const PolygonMesh::HE_face* face = mesh->faceVector->at(f);
+                float normal[3];
+                if(face->normal!=NULL)
+                {
+                    normal[0] = face->normal->x;
+                    normal[1] = face->normal->y;
+                    normal[2] = face->normal->z;
+                }
+                else
+                    newellNormal(face, normal);
+                faceOffsets[f+1] = (unsigned int)triangulator.triangulate(face, normal, results[c]);
+            }
+        }
+    });
+
+    for(long f=0; f<faceCount; f++)
+        faceOffsets[f+1] += faceOffsets[f];
+    triangles.resize((size_t)faceOffsets[faceCount] * 3);
+    parallelFor(0, chunks, 1, [&](long from, long to) {
+        for(long c=from; c<to; c++)
+        {
+            if(!results[c].empty())
+                std::copy(results[c].begin(), results[c].end(),
+                          triangles.begin() + (size_t)faceOffsets[c*grain] * 3);
+        }
+    });
+}
@@ -0,0 +1,61 @@
+#ifndef FACETRIANGULATOR_H
+#define FACETRIANGULATOR_H
+
+#include <vector>
+
+#include "trianglemesh.h"
+
+/**
+ * Polygon geometry for faces with any number of corners: Newell normals,
+ * area centroids and ear-clipping triangulation.
+ *
+ * Faces are clipped in the plane of their normal, so concave polygons get
+ * triangles that stay inside the outline. Every face with n corners yields
+ * n-2 triangles in the winding of the face; when no ear can be found (a
+ * self-intersecting or degenerate outline) the remaining corners are cut
+ * off one by one instead.
+ */
+class FaceTriangulator
+{
+public:
+    explicit FaceTriangulator();
+
+    /**
+     * @brief newellNormal
+     * Normal of the face loop by Newell's method; its length is twice the
+     * area of the polygon.
+     */
+    static void newellNormal(const PolygonMesh::HE_face* face, float* normal);
+    //Area-weighted centroid, or the corner average of a degenerate face
+    static void centroid(const PolygonMesh::HE_face* face, const float* normal, float* centroid);
+
+    /**
+     * @brief triangulate
+     * Appends the face's triangles as vertex positions in vertVector.
+     * @return number of triangles added
+     */
+    int triangulate(const PolygonMesh::HE_face* face, const float* normal,
+                    std::vector<unsigned int>& triangles);
+
+    /**
+     * @brief triangulateMesh
+     * Triangulates all faces in parallel. The triangles of face f are
+     * faceOffsets[f] .. faceOffsets[f+1]-1, in faceVector order.
+     */
+    static void triangulateMesh(const PolygonMesh* mesh,
+                                std::vector<unsigned int>& triangles,
+                                std::vector<unsigned int>& faceOffsets);
+
+private:
+    bool isEar(int p, int i, int remaining) const;
+
+    //Scratch space for the current face, reused between faces
+    std::vector<unsigned int> mIds;
+    std::vector<float> mU;
+    std::vector<float> mV;
+    std::vector<int> mPrev;
+    std::vector<int> mNext;
+    float mOrientation;
+};
+
+#endif // FACETRIANGULATOR_H
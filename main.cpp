@@ -1,12 +1,328 @@
 #include <QApplication>
 #include <QDesktopWidget>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QDir>
 
 #include "window.h"
+#include "renderbenchmark.h"
+#include "pathbenchmark.h"
+#include "meshfileio.h"
+#include "pathgraphwriter.h"
+#include "pathgraphtiler.h"
+#include "pathpointwriter.h"
+#include "mfileparser.h"
+#include "meshreorder.h"
+#include "coplanarmerger.h"
+#include "walkabilityfilter.h"
+#include "softwarerasterizer.h"
+
+static bool hasArgument(int argc, char *argv[], const char* name)
+{
+    for(int i=1; i<argc; i++)
+    {
+        if(qstrcmp(argv[i],name)==0)
+            return true;
+    }
+    return false;
+}
 
 int main(int argc, char *argv[])
 {
+    //The benchmark must run on CPU-only CI machines, so default it to the
+    //offscreen platform and let Mesa pick its software rasterizer (llvmpipe)
+    const bool benchmark = hasArgument(argc,argv,"--benchmark");
+    const bool headless = benchmark || hasArgument(argc,argv,"--thumbnails") ||
+                          hasArgument(argc,argv,"--path-benchmark") ||
+                          hasArgument(argc,argv,"--export-path-graph") ||
+                          hasArgument(argc,argv,"--io-benchmark") ||
+                          hasArgument(argc,argv,"--export-obj");
+    if(headless && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM","offscreen");
+    if(benchmark && hasArgument(argc,argv,"--software-gl"))
+        qputenv("LIBGL_ALWAYS_SOFTWARE","1");
+
     QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption benchmarkOption("benchmark",
+            "Render the given OBJ through a scripted camera orbit and exit.",
+            "obj-file");
+    QCommandLineOption framesOption("frames",
+            "Number of measured frames per render type (default 360).",
+            "count", "360");
+    QCommandLineOption warmupOption("warmup",
+            "Number of unmeasured frames per render type (default 10).",
+            "count", "10");
+    QCommandLineOption outputOption("output",
+            "Benchmark JSON output file (default benchmark.json).",
+            "json-file", "benchmark.json");
+    QCommandLineOption sizeOption("size",
+            "Benchmark viewport size (default 1024x768) or thumbnail size (default 256x256).",
+            "WxH", "1024x768");
+    QCommandLineOption softwareOption("software-gl",
+            "Force Mesa software rendering (LIBGL_ALWAYS_SOFTWARE=1).");
+    QCommandLineOption thumbnailsOption("thumbnails",
+            "Render the OBJ files given as arguments to PNGs in out-dir "
+            "with the CPU rasterizer and exit.",
+            "out-dir");
+    QCommandLineOption renderTypeOption("render-type",
+            "Thumbnail render type: points, wireframe, flat or smooth (default smooth).",
+            "type", "smooth");
+    QCommandLineOption turntableOption("turntable",
+            "Number of turntable frames per thumbnail (default 1).",
+            "count", "1");
+    QCommandLineOption frameBudgetOption("frame-budget",
+            "Frame-time budget for automatic LOD while rotating (default 33 ms).",
+            "ms", "33");
+    QCommandLineOption cacheBudgetOption("cache-budget",
+            "Memory for recently opened meshes in the viewer (default 1024 MB).",
+            "MB", "1024");
+    QCommandLineOption reorderOption("reorder",
+            "Reorder vertices and faces for cache locality after loading.");
+    QCommandLineOption weldOption("weld",
+            "Merge vertices closer than epsilon (in OBJ units) while loading, "
+            "so faces split along seams connect.",
+            "epsilon", "0");
+    QCommandLineOption pathBenchmarkOption("path-benchmark",
+            "Measure A* query throughput on the given OBJ and exit.",
+            "obj-file");
+    QCommandLineOption queriesOption("queries",
+            "Number of random path queries (default 10000).",
+            "count", "10000");
+    QCommandLineOption clusterSizeOption("cluster-size",
+            "Faces per cluster of the hierarchical path graph (default 256).",
+            "faces", "256");
+    QCommandLineOption exportGraphOption("export-path-graph",
+            "Write the path graph of the given OBJ in the binary .pgraph format "
+            "to --output (default <name>.pgraph) and exit.",
+            "obj-file");
+    QCommandLineOption tileSizeOption("tile-size",
+            "With --export-path-graph, write tiles of this size in model units "
+            "plus a JSON index to --output instead of one file (0 = automatic).",
+            "units");
+    QCommandLineOption mergeCoplanarOption("merge-coplanar",
+            "With --export-path-graph, merge coplanar faces into convex polygons first.");
+    QCommandLineOption maxSlopeOption("max-slope",
+            "With --export-path-graph, only keep faces within this many degrees of the up axis.",
+            "degrees");
+    QCommandLineOption clearanceOption("clearance",
+            "With --max-slope, also require this much free height above a face.",
+            "units", "0");
+    QCommandLineOption upAxisOption("up-axis",
+            "Up axis for --max-slope as x,y,z (default 0,1,0).",
+            "x,y,z", "0,1,0");
+    QCommandLineOption weightLinksOption("weight-links",
+            "With --max-slope, keep unwalkable faces and raise link costs instead of dropping them.");
+    QCommandLineOption compareJsonOption("compare-json",
+            "With --export-path-graph, also write the path point JSON and log "
+            "the size and load time of both files.");
+    QCommandLineOption ioBenchmarkOption("io-benchmark",
+            "Load the given OBJ, write it as binary PLY and STL, compare the load "
+            "times of all three in --output (default <name>_io.json) and exit.",
+            "obj-file");
+    QCommandLineOption exportObjOption("export-obj",
+            "Load the given mesh (- for standard input; .gz and .zst are "
+            "decompressed), apply --weld and --reorder, write it as OBJ to "
+            "--output (default <name>_export.obj) and exit.",
+            "mesh-file");
+    QCommandLineOption verifyOption("verify",
+            "With --export-obj, read the written file back and check that it "
+            "loads to the same mesh.");
+    parser.addPositionalArgument("files", "OBJ files for --thumbnails.", "[files...]");
+    parser.addOption(benchmarkOption);
+    parser.addOption(framesOption);
+    parser.addOption(warmupOption);
+    parser.addOption(outputOption);
+    parser.addOption(sizeOption);
+    parser.addOption(softwareOption);
+    parser.addOption(thumbnailsOption);
+    parser.addOption(renderTypeOption);
+    parser.addOption(turntableOption);
+    parser.addOption(frameBudgetOption);
+    parser.addOption(cacheBudgetOption);
+    parser.addOption(reorderOption);
+    parser.addOption(weldOption);
+    parser.addOption(pathBenchmarkOption);
+    parser.addOption(queriesOption);
+    parser.addOption(clusterSizeOption);
+    parser.addOption(exportGraphOption);
+    parser.addOption(compareJsonOption);
+    parser.addOption(tileSizeOption);
+    parser.addOption(mergeCoplanarOption);
+    parser.addOption(maxSlopeOption);
+    parser.addOption(clearanceOption);
+    parser.addOption(upAxisOption);
+    parser.addOption(weightLinksOption);
+    parser.addOption(ioBenchmarkOption);
+    parser.addOption(exportObjOption);
+    parser.addOption(verifyOption);
+    parser.process(app);
+
+    if(parser.isSet(benchmarkOption))
+    {
+        RenderBenchmark bench;
+        bench.setModelFile(parser.value(benchmarkOption));
+        bench.setFrameCount(parser.value(framesOption).toInt());
+        bench.setWarmupFrames(parser.value(warmupOption).toInt());
+        bench.setOutputFile(parser.value(outputOption));
+        QStringList size = parser.value(sizeOption).split('x');
+        if(size.size()==2)
+            bench.setViewportSize(size.at(0).toInt(),size.at(1).toInt());
+        bench.setReorder(parser.isSet(reorderOption));
+        return bench.run();
+    }
+
+    if(parser.isSet(pathBenchmarkOption))
+    {
+        PathBenchmark bench;
+        bench.setModelFile(parser.value(pathBenchmarkOption));
+        bench.setQueryCount(parser.value(queriesOption).toInt());
+        bench.setClusterSize(parser.value(clusterSizeOption).toInt());
+        if(parser.isSet(outputOption))
+            bench.setOutputFile(parser.value(outputOption));
+        return bench.run();
+    }
+
+    if(parser.isSet(ioBenchmarkOption))
+    {
+        QString modelFile = parser.value(ioBenchmarkOption);
+        QFileInfo info(modelFile);
+        QString resultFile = parser.isSet(outputOption) ? parser.value(outputOption)
+                : info.dir().filePath(info.completeBaseName() + "_io.json");
+        return MeshFileIO::compareWithObj(modelFile, resultFile) ? 0 : 1;
+    }
+
+    if(parser.isSet(exportObjOption))
+    {
+        QString modelFile = parser.value(exportObjOption);
+        QFileInfo info(modelFile);
+        QString objFile = parser.isSet(outputOption) ? parser.value(outputOption)
+                : info.dir().filePath(info.completeBaseName() + "_export.obj");
+        OBJFileParser objParser;
+        objParser.setWeldEpsilon(parser.value(weldOption).toFloat());
+        PolygonMesh* mesh = objParser.parseFile(modelFile);
+        if(mesh==NULL)
+        {
+            qCritical() << "Model could not be parsed:" << modelFile;
+            return 1;
+        }
+        if(parser.isSet(reorderOption))
+            MeshReorder::optimize(mesh);
+        bool ok = MeshFileIO::writeObj(mesh, objFile);
+        if(ok && parser.isSet(verifyOption))
+            ok = MeshFileIO::compareWithLoader(mesh, objFile);
+        delete mesh;
+        return ok ? 0 : 1;
+    }
+
+    if(parser.isSet(exportGraphOption))
+    {
+        QString modelFile = parser.value(exportGraphOption);
+        QFileInfo info(modelFile);
+        const bool tiled = parser.isSet(tileSizeOption);
+        QString graphFile = parser.isSet(outputOption) ? parser.value(outputOption)
+                : info.dir().filePath(info.completeBaseName() + (tiled ? "_tiles.json" : ".pgraph"));
+        OBJFileParser objParser;
+        objParser.setWeldEpsilon(parser.value(weldOption).toFloat());
+        //Both meshes live until the export returns; mesh is the one exported
+        QScopedPointer<PolygonMesh> parsed(objParser.parseFile(modelFile));
+        QScopedPointer<PolygonMesh> merged;
+        PolygonMesh* mesh = parsed.data();
+        if(mesh==NULL || mesh->faceVector->empty())
+        {
+            qCritical() << "Model could not be parsed:" << modelFile;
+            return 1;
+        }
+        if(parser.isSet(reorderOption))
+            MeshReorder::optimize(mesh);
+        if(parser.isSet(mergeCoplanarOption))
+        {
+            CoplanarMerger merger(mesh);
+            merged.reset(merger.merge());
+            mesh = merged.data();
+        }
+        FaceGraph graph;
+        graph.build(mesh);
+        WalkabilityFilter walkability;
+        const bool filtered = parser.isSet(maxSlopeOption);
+        if(filtered)
+        {
+            QStringList up = parser.value(upAxisOption).split(',');
+            if(up.size()==3)
+                walkability.setUpAxis(up.at(0).toFloat(), up.at(1).toFloat(), up.at(2).toFloat());
+            walkability.setMaxSlope(parser.value(maxSlopeOption).toFloat());
+            walkability.setClearance(parser.value(clearanceOption).toFloat());
+            walkability.setMode(parser.isSet(weightLinksOption) ? WalkabilityFilter::WeightLinks
+                                                                : WalkabilityFilter::DropLinks);
+            walkability.classify(mesh);
+            walkability.apply(graph);
+        }
+        if(tiled)
+        {
+            PathGraphTiler tiler;
+            tiler.setTileSize(parser.value(tileSizeOption).toFloat());
+            int tiles = tiler.write(graph, graphFile);
+            qDebug() << "Wrote" << tiles << "tiles indexed by" << graphFile;
+            return tiles>=0 ? 0 : 1;
+        }
+        PathGraphWriter writer;
+        writer.setNormals(true);
+        if(!writer.write(graph, mesh, graphFile))
+            return 1;
+        if(parser.isSet(compareJsonOption))
+        {
+            QFileInfo graphInfo(graphFile);
+            QString jsonFile = graphInfo.dir().filePath(graphInfo.completeBaseName() + ".json");
+            PathPointWriter jsonWriter;
+            jsonWriter.setPretty(false);
+            jsonWriter.setPortals(parser.isSet(mergeCoplanarOption));
+            if(filtered && walkability.mode()==WalkabilityFilter::WeightLinks)
+                jsonWriter.setFaceCosts(&walkability.faceCosts());
+            else if(filtered)
+                jsonWriter.setFaceFilter(&walkability.walkable(), 1);
+            if(!jsonWriter.write(mesh, jsonFile))
+                return 1;
+            PathGraphWriter::compareWithJson(graphFile, jsonFile);
+        }
+        return 0;
+    }
+
+    if(parser.isSet(thumbnailsOption))
+    {
+        QString type = parser.value(renderTypeOption).toLower();
+        ViewPortWidget::RENDER_TYPE renderType = ViewPortWidget::SMOOTH_SHADING;
+        if(type=="points")
+            renderType = ViewPortWidget::POINTS;
+        else if(type=="wireframe")
+            renderType = ViewPortWidget::WIREFRAME;
+        else if(type=="flat")
+            renderType = ViewPortWidget::FLAT_SHADING;
+
+        int w = 256, h = 256;
+        if(parser.isSet(sizeOption))
+        {
+            QStringList size = parser.value(sizeOption).split('x');
+            if(size.size()==2)
+            {
+                w = size.at(0).toInt();
+                h = size.at(1).toInt();
+            }
+        }
+        int failures = SoftwareRasterizer::renderThumbnails(
+                    parser.positionalArguments(),
+                    parser.value(thumbnailsOption),
+                    renderType, w, h,
+                    parser.value(turntableOption).toInt());
+        return failures==0 ? 0 : 1;
+    }
+
     Window window;
+    window.setFrameTimeBudget(parser.value(frameBudgetOption).toFloat());
+    window.setReorderOnLoad(parser.isSet(reorderOption));
+    window.setWeldEpsilon(parser.value(weldOption).toFloat());
+    window.setCacheBudget(parser.value(cacheBudgetOption).toLong());
 
     int desktopArea = QApplication::desktop()->width() *
                      QApplication::desktop()->height();
@@ -0,0 +1,159 @@
+#include "meshbuffers.h"
+#include "parallel.h"
+#include "facetriangulator.h"
+
+MeshBuffers::MeshBuffers()
+{}
+
+void MeshBuffers::build(const PolygonMesh* mesh)
+{
+    buildPositions(mesh);
+    buildEdges(mesh);
+    FaceTriangulator::triangulateMesh(mesh, triangles, faceTriangleOffsets);
+}
+
+void MeshBuffers::buildPositions(const PolygonMesh* mesh)
+{
+    const long count = (long)mesh->vertVector->size();
+    positions.resize(count*3);
+    normals.resize(count*3);
+    parallelFor(0, count, 8192, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            PolygonMesh::HE_vert* v = mesh->vertVector->at(i);
+            positions[i*3] = v->x;
+            positions[i*3+1] = v->y;
+            positions[i*3+2] = v->z;
+            PolygonMesh::Normal* n = v->normal;
+            normals[i*3] = n ? n->x : 0.0f;
+            normals[i*3+1] = n ? n->y : 0.0f;
+            normals[i*3+2] = n ? n->z : 1.0f;
+        }
+    });
+}
+
+/**
+ * @brief buildFlat
+ * Copies the corners of every triangle out of the index buffer together
+ * with the normal of the face it came from, so flat shading needs no
+ * per-face state while drawing.
+ */
+void MeshBuffers::buildFlat(const PolygonMesh* mesh)
+{
+    const long faceCount = (long)mesh->faceVector->size();
+    flatPositions.resize(triangles.size()*3);
+    flatNormals.resize(triangles.size()*3);
+    parallelFor(0, faceCount, 8192, [&](long from, long to) {
+        for(long f=from; f<to; f++)
+        {
+            const PolygonMesh::Normal* n = mesh->faceVector->at(f)->normal;
+            const unsigned int last = faceTriangleOffsets[f+1]*3;
+            for(unsigned int k=faceTriangleOffsets[f]*3; k<last; k++)
+            {
+                const unsigned int v = triangles[k];
+                flatPositions[k*3] = positions[v*3];
+                flatPositions[k*3+1] = positions[v*3+1];
+                flatPositions[k*3+2] = positions[v*3+2];
+            }
+            for(unsigned int t=faceTriangleOffsets[f]; t<faceTriangleOffsets[f+1]; t++)
+            {
+                float normal[3];
+                if(n!=NULL)
+                {
+                    normal[0] = n->x;
+                    normal[1] = n->y;
+                    normal[2] = n->z;
+                }
+                else
+                {
+                    //Faces without a normal use the triangle's own; GL normalizes it
+                    const float* p = &flatPositions[t*9];
+                    const float a[3] = {p[3]-p[0], p[4]-p[1], p[5]-p[2]};
+                    const float b[3] = {p[6]-p[0], p[7]-p[1], p[8]-p[2]};
+                    normal[0] = a[1]*b[2] - a[2]*b[1];
+                    normal[1] = a[2]*b[0] - a[0]*b[2];
+                    normal[2] = a[0]*b[1] - a[1]*b[0];
+                }
+                for(int c=0; c<3; c++)
+                {
+                    flatNormals[t*9+c*3] = normal[0];
+                    flatNormals[t*9+c*3+1] = normal[1];
+                    flatNormals[t*9+c*3+2] = normal[2];
+                }
+            }
+        }
+    });
+}
+
+/**
+ * @brief buildEdges
+ * Emits each undirected edge once by keeping only the half-edge with the
+ * smaller index of every twin pair. Half-edges without a pair are boundary
+ * edges; a pair link that does not point back means more than two faces
+ * share the edge (the parser re-pairs the last one it sees).
+ */
+void MeshBuffers::buildEdges(const PolygonMesh* mesh)
+{
+    struct ChunkEdges {
+        std::vector<unsigned int> edges;
+        std::vector<unsigned int> boundary;
+        std::vector<unsigned int> nonManifold;
+    };
+
+    const long faceCount = (long)mesh->faceVector->size();
+    const long grain = 16384;
+    const long chunks = (faceCount + grain - 1) / grain;
+    std::vector<ChunkEdges> results(chunks);
+
+    parallelFor(0, chunks, 1, [&](long from, long to) {
+        for(long c=from; c<to; c++)
+        {
+            ChunkEdges& out = results[c];
+            long last = qMin(faceCount, (c+1)*grain);
+            for(long f=c*grain; f<last; f++)
+            {
+                PolygonMesh::HE_edge* first = mesh->faceVector->at(f)->edge;
+                PolygonMesh::HE_edge* e = first;
+                if(e==NULL)
+                    continue;
+                do {
+                    unsigned int a = (unsigned int)(e->prev->vert->index - 1);
+                    unsigned int b = (unsigned int)(e->vert->index - 1);
+                    if(e->pair == NULL)
+                    {
+                        out.edges.push_back(a);
+                        out.edges.push_back(b);
+                        out.boundary.push_back(a);
+                        out.boundary.push_back(b);
+                    }
+                    else if(e->pair->pair != e)
+                    {
+                        out.edges.push_back(a);
+                        out.edges.push_back(b);
+                        out.nonManifold.push_back(a);
+                        out.nonManifold.push_back(b);
+                    }
+                    else if(e->index < e->pair->index)
+                    {
+                        out.edges.push_back(a);
+                        out.edges.push_back(b);
+                    }
+                    e = e->next;
+                } while(e!=NULL && e!=first);
+            }
+        }
+    });
+
+    edgeIndices.clear();
+    boundaryEdgeIndices.clear();
+    nonManifoldEdgeIndices.clear();
+    for(long c=0; c<chunks; c++)
+    {
+        edgeIndices.insert(edgeIndices.end(),
+                           results[c].edges.begin(), results[c].edges.end());
+        boundaryEdgeIndices.insert(boundaryEdgeIndices.end(),
+                                   results[c].boundary.begin(), results[c].boundary.end());
+        nonManifoldEdgeIndices.insert(nonManifoldEdgeIndices.end(),
+                                      results[c].nonManifold.begin(), results[c].nonManifold.end());
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef MESHBUFFERS_H
+#define MESHBUFFERS_H
+
+#include <vector>
+
+#include "trianglemesh.h"
+
+/**
+ * Flat vertex and index arrays derived from a PolygonMesh for drawing with
+ * client-side vertex arrays and for ray queries. Vertex i of every array is
+ * vertVector[i].
+ */
+class MeshBuffers
+{
+public:
+    explicit MeshBuffers();
+    void build(const PolygonMesh* mesh);
+    //Fills flatPositions and flatNormals, which build() leaves empty
+    void buildFlat(const PolygonMesh* mesh);
+
+    std::vector<float> positions;
+    //Vertex normals for smooth shading, (0,0,1) where a vertex has none
+    std::vector<float> normals;
+    //GL_LINES index pairs: one per undirected edge, boundary edges included
+    std::vector<unsigned int> edgeIndices;
+    std::vector<unsigned int> boundaryEdgeIndices;
+    std::vector<unsigned int> nonManifoldEdgeIndices;
+    //GL_TRIANGLES indices of the ear-clipped faces in faceVector order
+    std::vector<unsigned int> triangles;
+    //Triangles of face f are faceTriangleOffsets[f] .. faceTriangleOffsets[f+1]-1
+    std::vector<unsigned int> faceTriangleOffsets;
+    //triangles expanded to one corner per entry with the face normal at
+    //every corner, for flat shading with glDrawArrays; only built on request
+    std::vector<float> flatPositions;
+    std::vector<float> flatNormals;
+
+private:
+    void buildPositions(const PolygonMesh* mesh);
+    void buildEdges(const PolygonMesh* mesh);
+};
+
+#endif // MESHBUFFERS_H
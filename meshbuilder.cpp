@@ -0,0 +1,154 @@
+#include "meshbuilder.h"
+#include "mfileparser.h"
+
+#include <unordered_map>
+
+PolygonMesh* MeshBuilder::buildTriangles(const std::vector<float>& positions,
+                                         const std::vector<unsigned int>& triangles,
+                                         const std::vector<float>* normals)
+{
+    std::vector<unsigned int> offsets(triangles.size()/3 + 1);
+    for(size_t f=0; f<offsets.size(); f++)
+        offsets[f] = (unsigned int)(f*3);
+    return build(positions, offsets, triangles, normals);
+}
+
+PolygonMesh* MeshBuilder::build(const std::vector<float>& positions,
+                                const std::vector<unsigned int>& faceOffsets,
+                                const std::vector<unsigned int>& faceIndices,
+                                const std::vector<float>* normals)
+{
+    PolygonMesh* mesh = new PolygonMesh();
+    const size_t vertexCount = positions.size() / 3;
+    const size_t faceCount = faceOffsets.empty() ? 0 : faceOffsets.size() - 1;
+
+    mesh->vertVector->reserve(vertexCount);
+    for(size_t i=0; i<vertexCount; i++)
+    {
+        PolygonMesh::HE_vert* vert = new PolygonMesh::HE_vert();
+        vert->index = (long)i + 1;
+        vert->x = positions[i*3];
+        vert->y = positions[i*3+1];
+        vert->z = positions[i*3+2];
+        if(normals!=NULL)
+        {
+            vert->normal = new PolygonMesh::Normal();
+            vert->normal->x = normals->at(i*3);
+            vert->normal->y = normals->at(i*3+1);
+            vert->normal->z = normals->at(i*3+2);
+        }
+        mesh->vertVector->push_back(vert);
+
+        if(i==0)
+        {
+            *mesh->minVector = QVector3D(vert->x,vert->y,vert->z);
+            *mesh->maxVector = QVector3D(vert->x,vert->y,vert->z);
+        }
+        mesh->minVector->setX(qMin(mesh->minVector->x(),vert->x));
+        mesh->minVector->setY(qMin(mesh->minVector->y(),vert->y));
+        mesh->minVector->setZ(qMin(mesh->minVector->z(),vert->z));
+        mesh->maxVector->setX(qMax(mesh->maxVector->x(),vert->x));
+        mesh->maxVector->setY(qMax(mesh->maxVector->y(),vert->y));
+        mesh->maxVector->setZ(qMax(mesh->maxVector->z(),vert->z));
+    }
+    if(vertexCount>0)
+        mesh->first_vertex = mesh->vertVector->at(0);
+
+    //Twin pairing keyed on the directed vertex pair, as in the OBJ parser
+    std::unordered_map<quint64,PolygonMesh::HE_edge*> edgeMap;
+    edgeMap.reserve(faceIndices.size());
+    std::vector<PolygonMesh::HE_edge*> edges;
+    edges.reserve(faceIndices.size());
+    long edgeCount = 0;
+
+    mesh->faceVector->reserve(faceCount);
+    for(size_t f=0; f<faceCount; f++)
+    {
+        PolygonMesh::HE_face* face = new PolygonMesh::HE_face();
+        face->index = (long)f + 1;
+        mesh->faceVector->push_back(face);
+
+        const unsigned int begin = faceOffsets[f];
+        const unsigned int end = faceOffsets[f+1];
+        PolygonMesh::HE_edge* first_edge = NULL;
+        PolygonMesh::HE_edge* prev_edge = NULL;
+        for(unsigned int k=begin; k<end; k++)
+        {
+            unsigned int one = faceIndices[k];
+            unsigned int two = faceIndices[(k+1<end) ? k+1 : begin];
+            PolygonMesh::HE_vert* vertex_one = mesh->vertVector->at(one);
+            PolygonMesh::HE_vert* vertex_two = mesh->vertVector->at(two);
+
+            PolygonMesh::HE_edge* curr_edge = new PolygonMesh::HE_edge();
+            curr_edge->index = ++edgeCount;
+            curr_edge->vert = vertex_two;
+            curr_edge->face = face;
+            curr_edge->prev = prev_edge;
+            if(prev_edge!=NULL)
+                prev_edge->next = curr_edge;
+            else
+                first_edge = curr_edge;
+            prev_edge = curr_edge;
+            vertex_one->edge = curr_edge;
+            face->edge = curr_edge;
+            edges.push_back(curr_edge);
+
+            edgeMap[((quint64)one << 32) | two] = curr_edge;
+            std::unordered_map<quint64,PolygonMesh::HE_edge*>::iterator pair =
+                    edgeMap.find(((quint64)two << 32) | one);
+            if(pair!=edgeMap.end())
+            {
+                curr_edge->pair = pair->second;
+                pair->second->pair = curr_edge;
+            }
+        }
+        if(first_edge!=NULL)
+        {
+            first_edge->prev = prev_edge;
+            prev_edge->next = first_edge;
+        }
+    }
+
+    OBJFileParser parser;
+    for(size_t f=0; f<faceCount; f++)
+    {
+        PolygonMesh::HE_face* face = mesh->faceVector->at(f);
+        if(face->edge==NULL)
+            continue;
+        face->normal = parser.calculateFaceNormal(face);
+        face->centroid = parser.calculateFaceCentroid(face);
+    }
+
+    if(normals==NULL)
+    {
+        std::vector<float> sum(vertexCount*3, 0.0f);
+        std::vector<int> count(vertexCount, 0);
+        for(size_t k=0; k<edges.size(); k++)
+        {
+            PolygonMesh::HE_edge* e = edges[k];
+            PolygonMesh::Normal* n = e->face->normal;
+            if(n==NULL)
+                continue;
+            long v = e->vert->index - 1;
+            sum[v*3] += n->x;
+            sum[v*3+1] += n->y;
+            sum[v*3+2] += n->z;
+            count[v]++;
+        }
+        for(size_t i=0; i<vertexCount; i++)
+        {
+            PolygonMesh::Normal* normal = new PolygonMesh::Normal();
+            float c = count[i]>0 ? (float)count[i] : 1.0f;
+            normal->x = sum[i*3] / c;
+            normal->y = sum[i*3+1] / c;
+            normal->z = sum[i*3+2] / c;
+            mesh->vertVector->at(i)->normal = normal;
+        }
+    }
+
+    mesh->edgeVector->reserve(edges.size());
+    for(size_t k=0; k<edges.size(); k++)
+        mesh->edgeVector->push_back(*edges[k]);
+
+    return mesh;
+}
@@ -0,0 +1,34 @@
+#ifndef MESHBUILDER_H
+#define MESHBUILDER_H
+
+#include <vector>
+
+#include "trianglemesh.h"
+
+/**
+ * Builds a PolygonMesh (half-edges, twins, face normals, centroids and
+ * vertex normals) from flat arrays. Positions are taken as-is, i.e. already
+ * in the viewer's coordinate system.
+ */
+class MeshBuilder
+{
+public:
+    /**
+     * @brief build
+     * @param positions xyz per vertex
+     * @param faceOffsets face f uses faceIndices[faceOffsets[f] .. faceOffsets[f+1])
+     * @param faceIndices 0-based vertex indices
+     * @param normals optional xyz per vertex; averaged face normals otherwise
+     */
+    static PolygonMesh* build(const std::vector<float>& positions,
+                              const std::vector<unsigned int>& faceOffsets,
+                              const std::vector<unsigned int>& faceIndices,
+                              const std::vector<float>* normals = NULL);
+
+    //Convenience overload for triangle lists
+    static PolygonMesh* buildTriangles(const std::vector<float>& positions,
+                                       const std::vector<unsigned int>& triangles,
+                                       const std::vector<float>* normals = NULL);
+};
+
+#endif // MESHBUILDER_H
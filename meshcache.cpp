@@ -0,0 +1,138 @@
+#include "meshcache.h"
+
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDebug>
+
+MeshCache::MeshCache(size_t budgetBytes)
+{
+    mBudget = budgetBytes;
+    mBytes = 0;
+    mHits = 0;
+    mMisses = 0;
+    mEvictions = 0;
+}
+
+QString MeshCache::key(QString fileName, bool reordered, float weldEpsilon)
+{
+    QFileInfo info(fileName);
+    QString path = info.canonicalFilePath();
+    if(path.isEmpty())
+        return QString();
+    //path|size|mtime|options; parsed from the end as the path may contain '|'
+    return path + "|" + QString::number(info.size()) +
+           "|" + QString::number(info.lastModified().toMSecsSinceEpoch()) +
+           (reordered ? "|reordered" : "|") +
+           (weldEpsilon > 0.0f ? ",weld=" + QString::number(weldEpsilon) : QString());
+}
+
+MeshSnapshot MeshCache::find(const QString& key)
+{
+    std::map<QString,EntryIterator>::iterator it = mIndex.find(key);
+    if(key.isEmpty() || it==mIndex.end())
+    {
+        mMisses++;
+        return MeshSnapshot();
+    }
+    mHits++;
+    mEntries.splice(mEntries.begin(), mEntries, it->second);
+    return it->second->mesh;
+}
+
+void MeshCache::insert(const QString& key, MeshSnapshot mesh)
+{
+    if(key.isEmpty() || mesh.isNull())
+        return;
+
+    const QString path = key.section('|', 0, -4);
+    const QString stamp = key.section('|', -3, -2);
+    for(EntryIterator e=mEntries.begin(); e!=mEntries.end(); )
+    {
+        EntryIterator next = e;
+        ++next;
+        //Same key, or a version of the file that no longer exists on disk
+        if(e->key==key || (e->path==path && e->key.section('|', -3, -2)!=stamp))
+            remove(e);
+        e = next;
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.path = path;
+    entry.mesh = mesh;
+    entry.bytes = 0;
+    mEntries.push_front(entry);
+    mIndex[key] = mEntries.begin();
+
+    //Meshes drawn since they were added have grown render buffers
+    mBytes = 0;
+    for(EntryIterator e=mEntries.begin(); e!=mEntries.end(); ++e)
+    {
+        e->bytes = e->mesh->memoryUsage();
+        mBytes += e->bytes;
+    }
+    evict();
+}
+
+void MeshCache::remove(EntryIterator entry)
+{
+    mBytes -= entry->bytes;
+    mIndex.erase(entry->key);
+    mEntries.erase(entry);
+}
+
+void MeshCache::evict()
+{
+    //The newest entry stays even if it alone exceeds the budget
+    while(mBytes > mBudget && mEntries.size() > 1)
+    {
+        EntryIterator last = mEntries.end();
+        --last;
+        qDebug() << "Mesh cache evicts" << last->path << "," << (qulonglong)(last->bytes >> 20) << "MB";
+        remove(last);
+        mEvictions++;
+    }
+}
+
+void MeshCache::clear()
+{
+    mEntries.clear();
+    mIndex.clear();
+    mBytes = 0;
+}
+
+void MeshCache::setBudget(size_t bytes)
+{
+    mBudget = bytes;
+    evict();
+}
+
+size_t MeshCache::budget() const
+{
+    return mBudget;
+}
+
+size_t MeshCache::memoryUsed() const
+{
+    return mBytes;
+}
+
+int MeshCache::count() const
+{
+    return (int)mEntries.size();
+}
+
+long MeshCache::hits() const
+{
+    return mHits;
+}
+
+long MeshCache::misses() const
+{
+    return mMisses;
+}
+
+long MeshCache::evictions() const
+{
+    return mEvictions;
+}
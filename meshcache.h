@@ -0,0 +1,69 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <QString>
+#include <list>
+#include <map>
+
+#include "trianglemesh.h"
+
+/**
+ * Keeps recently loaded meshes, including their render buffers, so that
+ * reopening a file does not parse it again.
+ *
+ * Entries are keyed by the canonical path, size and modification time of
+ * the file (plus the load options that change the mesh), so an edited file
+ * is a miss. When the meshes exceed the memory budget the least recently
+ * used ones are dropped; a dropped mesh is freed once nothing else holds
+ * it. Only used from the GUI thread.
+ */
+class MeshCache
+{
+public:
+    explicit MeshCache(size_t budgetBytes = 1024UL*1024*1024);
+
+    /**
+     * @brief key
+     * @return identity of the current contents of fileName loaded with the
+     * given options, or an empty string if the file cannot be read
+     */
+    static QString key(QString fileName, bool reordered, float weldEpsilon = 0.0f);
+
+    //Counts a hit or miss; a hit becomes the most recently used entry
+    MeshSnapshot find(const QString& key);
+    //Adds or replaces the entry, drops older versions of the file and evicts
+    void insert(const QString& key, MeshSnapshot mesh);
+    void clear();
+
+    void setBudget(size_t bytes);
+    size_t budget() const;
+    //Measured on insert, so render buffers built since then are included
+    size_t memoryUsed() const;
+    int count() const;
+    long hits() const;
+    long misses() const;
+    long evictions() const;
+
+private:
+    struct Entry {
+        QString key;
+        QString path;
+        MeshSnapshot mesh;
+        size_t bytes;
+    };
+    typedef std::list<Entry>::iterator EntryIterator;
+
+    void remove(EntryIterator entry);
+    void evict();
+
+    //Most recently used first
+    std::list<Entry> mEntries;
+    std::map<QString,EntryIterator> mIndex;
+    size_t mBudget;
+    size_t mBytes;
+    long mHits;
+    long mMisses;
+    long mEvictions;
+};
+
+#endif // MESHCACHE_H
@@ -0,0 +1,196 @@
+#include "meshcomponents.h"
+#include "meshbuilder.h"
+#include "parallel.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+//Path halving; concurrent unites may only ever shorten the paths
+int findRoot(std::vector<std::atomic<int> >& parent, int x)
+{
+    while(true)
+    {
+        int p = parent[x].load(std::memory_order_relaxed);
+        if(p==x)
+            return x;
+        int gp = parent[p].load(std::memory_order_relaxed);
+        if(p!=gp)
+            parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+        x = gp;
+    }
+}
+
+//Links the larger root below the smaller one, retrying if a root moved
+void unite(std::vector<std::atomic<int> >& parent, int a, int b)
+{
+    while(true)
+    {
+        a = findRoot(parent, a);
+        b = findRoot(parent, b);
+        if(a==b)
+            return;
+        if(a<b)
+            std::swap(a,b);
+        int expected = a;
+        if(parent[a].compare_exchange_strong(expected, b))
+            return;
+    }
+}
+
+}
+
+MeshComponents::MeshComponents(const PolygonMesh* mesh)
+{
+    mMesh = mesh;
+}
+
+void MeshComponents::label()
+{
+    QElapsedTimer timer;
+    timer.start();
+    const long faceCount = (long)mMesh->faceVector->size();
+
+    std::vector<std::atomic<int> > parent(faceCount);
+    parallelFor(0, faceCount, 16384, [&](long from, long to) {
+        for(long f=from; f<to; f++)
+            parent[f].store((int)f, std::memory_order_relaxed);
+    });
+
+    parallelFor(0, faceCount, 4096, [&](long from, long to) {
+        for(long f=from; f<to; f++)
+        {
+            PolygonMesh::HE_face* face = mMesh->faceVector->at(f);
+            PolygonMesh::HE_edge* e = face->edge;
+            if(e==NULL)
+                continue;
+            do {
+                if(e->pair!=NULL)
+                    unite(parent, (int)f, (int)(e->pair->face->index-1));
+                e = e->next;
+            } while(e!=NULL && e!=face->edge);
+        }
+    });
+
+    std::vector<int> root(faceCount);
+    parallelFor(0, faceCount, 16384, [&](long from, long to) {
+        for(long f=from; f<to; f++)
+            root[f] = findRoot(parent, (int)f);
+    });
+
+    //Number the components by decreasing size
+    std::vector<long> rootSize(faceCount, 0);
+    for(long f=0; f<faceCount; f++)
+        rootSize[root[f]]++;
+    std::vector<int> roots;
+    for(long f=0; f<faceCount; f++)
+    {
+        if(root[f]==f)
+            roots.push_back((int)f);
+    }
+    std::sort(roots.begin(), roots.end(), [&](int a, int b) {
+        return rootSize[a]!=rootSize[b] ? rootSize[a]>rootSize[b] : a<b;
+    });
+    std::vector<int> rootComponent(faceCount, -1);
+    mComponents.assign(roots.size(), Component());
+    for(size_t c=0; c<roots.size(); c++)
+    {
+        rootComponent[roots[c]] = (int)c;
+        mComponents[c].faces = rootSize[roots[c]];
+    }
+
+    mFaceComponent.resize(faceCount);
+    parallelFor(0, faceCount, 16384, [&](long from, long to) {
+        for(long f=from; f<to; f++)
+            mFaceComponent[f] = rootComponent[root[f]];
+    });
+
+    std::vector<char> seen(mComponents.size(), 0);
+    for(long f=0; f<faceCount; f++)
+    {
+        PolygonMesh::HE_face* face = mMesh->faceVector->at(f);
+        PolygonMesh::HE_edge* e = face->edge;
+        if(e==NULL)
+            continue;
+        Component& c = mComponents[mFaceComponent[f]];
+        char& first = seen[mFaceComponent[f]];
+        do {
+            const QVector3D p(e->vert->x, e->vert->y, e->vert->z);
+            if(!first)
+            {
+                c.min = p;
+                c.max = p;
+                first = 1;
+            }
+            c.min = QVector3D(qMin(c.min.x(),p.x()), qMin(c.min.y(),p.y()), qMin(c.min.z(),p.z()));
+            c.max = QVector3D(qMax(c.max.x(),p.x()), qMax(c.max.y(),p.y()), qMax(c.max.z(),p.z()));
+            e = e->next;
+        } while(e!=NULL && e!=face->edge);
+    }
+
+    qDebug() << "Labelled" << (int)mComponents.size() << "components in"
+             << timer.elapsed() << "ms; largest has"
+             << (mComponents.empty() ? 0 : mComponents[0].faces) << "faces";
+}
+
+int MeshComponents::componentCount() const
+{
+    return (int)mComponents.size();
+}
+
+const MeshComponents::Component& MeshComponents::component(int c) const
+{
+    return mComponents.at(c);
+}
+
+int MeshComponents::faceComponent(long face) const
+{
+    return mFaceComponent.at(face);
+}
+
+const std::vector<int>& MeshComponents::faceComponents() const
+{
+    return mFaceComponent;
+}
+
+PolygonMesh* MeshComponents::extract(int c) const
+{
+    const long vertexCount = (long)mMesh->vertVector->size();
+    std::vector<long> remap(vertexCount, -1);
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<unsigned int> offsets(1, 0);
+    std::vector<unsigned int> indices;
+
+    for(size_t f=0; f<mFaceComponent.size(); f++)
+    {
+        if(mFaceComponent[f]!=c)
+            continue;
+        PolygonMesh::HE_face* face = mMesh->faceVector->at(f);
+        PolygonMesh::HE_edge* e = face->edge;
+        if(e==NULL)
+            continue;
+        do {
+            //Face loops start at the vertex face->edge leaves
+            PolygonMesh::HE_vert* v = e->prev->vert;
+            long& slot = remap[v->index-1];
+            if(slot<0)
+            {
+                slot = (long)positions.size()/3;
+                positions.push_back(v->x);
+                positions.push_back(v->y);
+                positions.push_back(v->z);
+                normals.push_back(v->normal ? v->normal->x : 0.0f);
+                normals.push_back(v->normal ? v->normal->y : 0.0f);
+                normals.push_back(v->normal ? v->normal->z : 1.0f);
+            }
+            indices.push_back((unsigned int)slot);
+            e = e->next;
+        } while(e!=NULL && e!=face->edge);
+        offsets.push_back((unsigned int)indices.size());
+    }
+    return MeshBuilder::build(positions, offsets, indices, &normals);
+}
@@ -0,0 +1,44 @@
+#ifndef MESHCOMPONENTS_H
+#define MESHCOMPONENTS_H
+
+#include <vector>
+#include <QVector3D>
+
+#include "trianglemesh.h"
+
+/**
+ * Connected components of the faces of a PolygonMesh, where two faces are
+ * connected if they share a twinned half-edge. Faces are labelled by a
+ * lock-free union-find run in parallel over all half-edges.
+ *
+ * Components are numbered by decreasing face count, so component 0 is
+ * always the largest.
+ */
+class MeshComponents
+{
+public:
+    struct Component {
+        long faces;
+        QVector3D min;
+        QVector3D max;
+    };
+
+    explicit MeshComponents(const PolygonMesh* mesh);
+    void label();
+
+    int componentCount() const;
+    const Component& component(int c) const;
+    //Component of face f, indexed by face->index-1
+    int faceComponent(long face) const;
+    const std::vector<int>& faceComponents() const;
+
+    //Copies the faces of component c and the vertices they use into a new mesh
+    PolygonMesh* extract(int c) const;
+
+private:
+    const PolygonMesh* mMesh;
+    std::vector<int> mFaceComponent;
+    std::vector<Component> mComponents;
+};
+
+#endif // MESHCOMPONENTS_H
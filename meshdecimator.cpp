@@ -0,0 +1,799 @@
+#include "meshdecimator.h"
+#include "meshbuilder.h"
+#include "parallel.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace {
+
+//Fans larger than this are treated as corrupt and never collapsed
+const size_t kMaxRing = 512;
+//Weight of the planes that keep open boundaries in place
+const double kBoundaryWeight = 100.0;
+
+void addPlane(double* q, double a, double b, double c, double d, double w)
+{
+    q[0] += w*a*a; q[1] += w*a*b; q[2] += w*a*c; q[3] += w*a*d;
+    q[4] += w*b*b; q[5] += w*b*c; q[6] += w*b*d;
+    q[7] += w*c*c; q[8] += w*c*d;
+    q[9] += w*d*d;
+}
+
+double quadricError(const double* q, const double* p)
+{
+    const double x = p[0], y = p[1], z = p[2];
+    return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+         + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+         + q[7]*z*z + 2*q[8]*z
+         + q[9];
+}
+
+void cross(const double* u, const double* v, double* out)
+{
+    out[0] = u[1]*v[2] - u[2]*v[1];
+    out[1] = u[2]*v[0] - u[0]*v[2];
+    out[2] = u[0]*v[1] - u[1]*v[0];
+}
+
+void triangleNormal(const double* p0, const double* p1, const double* p2, double* n)
+{
+    double u[3] = {p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2]};
+    double v[3] = {p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2]};
+    cross(u,v,n);
+}
+
+}
+
+MeshDecimator::MeshDecimator(const PolygonMesh* mesh)
+{
+    mMesh = mesh;
+    mTargetFaces = -1;
+    mMaxError = -1.0;
+    mParallel = true;
+    mCollapses = 0;
+    mAliveFaces = 0;
+}
+
+void MeshDecimator::setTargetFaceCount(long faces)
+{
+    mTargetFaces = faces;
+}
+
+//Upper bound on the quadric error of a single collapse; negative disables it
+void MeshDecimator::setMaxError(double error)
+{
+    mMaxError = error;
+}
+
+void MeshDecimator::setParallel(bool parallel)
+{
+    mParallel = parallel;
+}
+
+long MeshDecimator::collapseCount()
+{
+    return mCollapses;
+}
+
+PolygonMesh* MeshDecimator::decimate()
+{
+    QElapsedTimer timer;
+    timer.start();
+    mCollapses = 0;
+
+    buildHalfEdges();
+    computeQuadrics();
+    const long inputFaces = mAliveFaces;
+
+    long target = mTargetFaces;
+    if(target < 0)
+        target = (mMaxError >= 0.0) ? 0 : mAliveFaces;
+    long facesToRemove = qMax(0L, mAliveFaces - target);
+
+    //Partitions are only worth their border losses on larger meshes
+    if(mParallel && facesToRemove > 0 && mAliveFaces > 50000)
+        runPartitions(facesToRemove);
+
+    facesToRemove = qMax(0L, mAliveFaces - target);
+    if(facesToRemove > 0)
+    {
+        std::vector<int> edges;
+        for(int h=0; h<(int)mTri.size(); h++)
+        {
+            if(mFaceAlive[h/3] && canonical(h)==h)
+                edges.push_back(h);
+        }
+        std::vector<HeapEntry> heap;
+        seedHeap(heap, edges);
+        long collapses = 0;
+        mAliveFaces -= runHeap(heap, -1, facesToRemove, &collapses);
+        mCollapses += collapses;
+    }
+
+    PolygonMesh* result = buildResult();
+    qDebug() << "Decimated" << inputFaces << "->" << mAliveFaces << "triangles with"
+             << mCollapses << "collapses in" << timer.elapsed() << "ms";
+    return result;
+}
+
+/**
+ * @brief buildHalfEdges
+ * Fan-triangulates every face. Half-edge h belongs to triangle h/3 and runs
+ * from mTri[h] to mTri[nextHe(h)]. Twins come from the source mesh's pair
+ * links; asymmetric (non-manifold) links are left unpaired.
+ */
+void MeshDecimator::buildHalfEdges()
+{
+    const long vertexCount = (long)mMesh->vertVector->size();
+    const long faceCount = (long)mMesh->faceVector->size();
+
+    mPos.resize(vertexCount*3);
+    parallelFor(0, vertexCount, 8192, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            PolygonMesh::HE_vert* v = mMesh->vertVector->at(i);
+            mPos[i*3] = v->x;
+            mPos[i*3+1] = v->y;
+            mPos[i*3+2] = v->z;
+        }
+    });
+
+    std::vector<long> triOffset(faceCount+1, 0);
+    std::vector<long> faceMaxEdge(faceCount, 0);
+    parallelFor(0, faceCount, 4096, [&](long from, long to) {
+        for(long f=from; f<to; f++)
+        {
+            PolygonMesh::HE_edge* first = mMesh->faceVector->at(f)->edge;
+            PolygonMesh::HE_edge* e = first;
+            long n = 0;
+            if(e!=NULL)
+            {
+                do {
+                    n++;
+                    faceMaxEdge[f] = qMax(faceMaxEdge[f], e->index);
+                    e = e->next;
+                } while(e!=NULL && e!=first);
+            }
+            triOffset[f+1] = qMax(0L, n-2);
+        }
+    });
+    long maxEdge = 0;
+    for(long f=0; f<faceCount; f++)
+    {
+        triOffset[f+1] += triOffset[f];
+        maxEdge = qMax(maxEdge, faceMaxEdge[f]);
+    }
+
+    const long triCount = triOffset[faceCount];
+    mTri.assign(triCount*3, -1);
+    mPair.assign(triCount*3, -1);
+    std::vector<int> heOfEdge(maxEdge+1, -1);
+
+    parallelFor(0, faceCount, 4096, [&](long from, long to) {
+        std::vector<PolygonMesh::HE_edge*> loop;
+        for(long f=from; f<to; f++)
+        {
+            loop.clear();
+            PolygonMesh::HE_edge* first = mMesh->faceVector->at(f)->edge;
+            PolygonMesh::HE_edge* e = first;
+            if(e==NULL)
+                continue;
+            do { loop.push_back(e); e = e->next; } while(e!=NULL && e!=first);
+
+            const int n = (int)loop.size();
+            for(int j=1; j+1<n; j++)
+            {
+                const int base = (int)(3*(triOffset[f]+j-1));
+                mTri[base] = (int)(loop[0]->prev->vert->index - 1);
+                mTri[base+1] = (int)(loop[j]->prev->vert->index - 1);
+                mTri[base+2] = (int)(loop[j+1]->prev->vert->index - 1);
+
+                if(j==1)
+                    heOfEdge[loop[0]->index] = base;
+                else
+                {
+                    //Fan diagonal shared with the previous triangle
+                    mPair[base] = base-1;
+                    mPair[base-1] = base;
+                }
+                heOfEdge[loop[j]->index] = base+1;
+                if(j==n-2)
+                    heOfEdge[loop[n-1]->index] = base+2;
+            }
+        }
+    });
+
+    parallelFor(0, faceCount, 4096, [&](long from, long to) {
+        for(long f=from; f<to; f++)
+        {
+            PolygonMesh::HE_edge* first = mMesh->faceVector->at(f)->edge;
+            PolygonMesh::HE_edge* e = first;
+            if(e==NULL)
+                continue;
+            do {
+                int h = heOfEdge[e->index];
+                if(h>=0 && e->pair!=NULL && e->pair->pair==e)
+                {
+                    int t = heOfEdge[e->pair->index];
+                    if(t>=0 && mTri[h]==mTri[nextHe(t)] && mTri[nextHe(h)]==mTri[t])
+                        mPair[h] = t;
+                }
+                e = e->next;
+            } while(e!=NULL && e!=first);
+        }
+    });
+
+    mFaceAlive.assign(triCount, 1);
+    mAliveFaces = triCount;
+    for(long t=0; t<triCount; t++)
+    {
+        int a = mTri[t*3], b = mTri[t*3+1], c = mTri[t*3+2];
+        if(a==b || b==c || a==c)
+        {
+            mFaceAlive[t] = 0;
+            mAliveFaces--;
+            for(int k=0; k<3; k++)
+            {
+                int h = (int)(t*3+k);
+                if(mPair[h]>=0)
+                    mPair[mPair[h]] = -1;
+                mPair[h] = -1;
+            }
+        }
+    }
+
+    mOut.assign(vertexCount, -1);
+    std::vector<int> incident(vertexCount, 0);
+    for(int h=0; h<(int)mTri.size(); h++)
+    {
+        if(!mFaceAlive[h/3])
+            continue;
+        mOut[mTri[h]] = h;
+        incident[mTri[h]]++;
+    }
+
+    //Vertices whose fan does not reach every incident face are non-manifold
+    mLocked.assign(vertexCount, 0);
+    mBoundary.assign(vertexCount, 0);
+    parallelFor(0, vertexCount, 4096, [&](long from, long to) {
+        std::vector<int> r;
+        for(long v=from; v<to; v++)
+        {
+            bool closed = ring((int)v, r);
+            mBoundary[v] = closed ? 0 : 1;
+            mLocked[v] = ((int)r.size() != incident[v] || r.size() >= kMaxRing) ? 1 : 0;
+        }
+    });
+    mStamp.assign(vertexCount, 0);
+}
+
+/**
+ * @brief ring
+ * Collects the outgoing half-edges of v by rotating through the twins,
+ * first one way and, if a boundary stops it, the other way.
+ * @return true if the fan is closed (v is an interior vertex)
+ */
+bool MeshDecimator::ring(int v, std::vector<int>& out) const
+{
+    out.clear();
+    const int start = mOut[v];
+    if(start<0)
+        return false;
+
+    int h = start;
+    while(true)
+    {
+        out.push_back(h);
+        int p = mPair[prevHe(h)];
+        if(p<0)
+            break;
+        if(p==start)
+            return true;
+        h = p;
+        if(out.size() >= kMaxRing)
+            return false;
+    }
+
+    h = start;
+    while(mPair[h]>=0 && out.size() < kMaxRing)
+    {
+        h = nextHe(mPair[h]);
+        out.push_back(h);
+    }
+    return false;
+}
+
+void MeshDecimator::computeQuadrics()
+{
+    const long vertexCount = (long)mOut.size();
+    mQuadric.resize(vertexCount);
+    parallelFor(0, vertexCount, 4096, [&](long from, long to) {
+        std::vector<int> r;
+        for(long v=from; v<to; v++)
+        {
+            double* q = mQuadric[v].q;
+            std::fill(q, q+10, 0.0);
+            ring((int)v, r);
+            for(size_t k=0; k<r.size(); k++)
+            {
+                const int f = r[k]/3;
+                const double* p0 = &mPos[mTri[f*3]*3];
+                double n[3];
+                triangleNormal(p0, &mPos[mTri[f*3+1]*3], &mPos[mTri[f*3+2]*3], n);
+                double area2 = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+                if(area2 <= 0.0)
+                    continue;
+                n[0] /= area2; n[1] /= area2; n[2] /= area2;
+                double d = -(n[0]*p0[0] + n[1]*p0[1] + n[2]*p0[2]);
+                addPlane(q, n[0], n[1], n[2], d, 0.5*area2);
+
+                //Planes through open edges, perpendicular to the face
+                const int edges[2] = {r[k], prevHe(r[k])};
+                for(int i=0; i<2; i++)
+                {
+                    const int e = edges[i];
+                    if(mPair[e]>=0)
+                        continue;
+                    const double* a = &mPos[mTri[e]*3];
+                    const double* b = &mPos[mTri[nextHe(e)]*3];
+                    double dir[3] = {b[0]-a[0], b[1]-a[1], b[2]-a[2]};
+                    double bn[3];
+                    cross(dir, n, bn);
+                    double len = sqrt(bn[0]*bn[0] + bn[1]*bn[1] + bn[2]*bn[2]);
+                    if(len <= 0.0)
+                        continue;
+                    bn[0] /= len; bn[1] /= len; bn[2] /= len;
+                    double bd = -(bn[0]*a[0] + bn[1]*a[1] + bn[2]*a[2]);
+                    double w = kBoundaryWeight * (dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2]);
+                    addPlane(q, bn[0], bn[1], bn[2], bd, w);
+                }
+            }
+        }
+    });
+}
+
+/**
+ * @brief edgeCost
+ * Finds the position minimizing the summed quadric of both end points,
+ * falling back to the end points or midpoint when the system is singular
+ * or the optimum lies far from the edge. A vertex on an open boundary keeps
+ * its position when collapsed with an interior one.
+ */
+bool MeshDecimator::edgeCost(int h, float* cost, double* p) const
+{
+    const int a = mTri[h];
+    const int b = mTri[nextHe(h)];
+    double q[10];
+    for(int i=0; i<10; i++)
+        q[i] = mQuadric[a].q[i] + mQuadric[b].q[i];
+
+    const double* pa = &mPos[a*3];
+    const double* pb = &mPos[b*3];
+    if(mBoundary[a] != mBoundary[b])
+    {
+        const double* keep = mBoundary[a] ? pa : pb;
+        std::copy(keep, keep+3, p);
+        *cost = (float)quadricError(q, p);
+        return true;
+    }
+
+    double det = q[0]*(q[4]*q[7] - q[5]*q[5])
+               - q[1]*(q[1]*q[7] - q[5]*q[2])
+               + q[2]*(q[1]*q[5] - q[4]*q[2]);
+    double edge2 = (pb[0]-pa[0])*(pb[0]-pa[0]) + (pb[1]-pa[1])*(pb[1]-pa[1])
+                 + (pb[2]-pa[2])*(pb[2]-pa[2]);
+    bool solved = false;
+    if(fabs(det) > 1e-15)
+    {
+        const double r0 = -q[3], r1 = -q[6], r2 = -q[8];
+        p[0] = (r0*(q[4]*q[7] - q[5]*q[5]) - q[1]*(r1*q[7] - q[5]*r2)
+                + q[2]*(r1*q[5] - q[4]*r2)) / det;
+        p[1] = (q[0]*(r1*q[7] - r2*q[5]) - r0*(q[1]*q[7] - q[5]*q[2])
+                + q[2]*(q[1]*r2 - r1*q[2])) / det;
+        p[2] = (q[0]*(q[4]*r2 - q[5]*r1) - q[1]*(q[1]*r2 - r1*q[2])
+                + r0*(q[1]*q[5] - q[4]*q[2])) / det;
+        double mx = 0.5*(pa[0]+pb[0]) - p[0];
+        double my = 0.5*(pa[1]+pb[1]) - p[1];
+        double mz = 0.5*(pa[2]+pb[2]) - p[2];
+        solved = (mx*mx + my*my + mz*mz) <= 4.0*edge2;
+    }
+
+    if(!solved)
+    {
+        double mid[3] = {0.5*(pa[0]+pb[0]), 0.5*(pa[1]+pb[1]), 0.5*(pa[2]+pb[2])};
+        const double* candidates[3] = {pa, pb, mid};
+        double best = 0.0;
+        for(int i=0; i<3; i++)
+        {
+            double err = quadricError(q, candidates[i]);
+            if(i==0 || err<best)
+            {
+                best = err;
+                std::copy(candidates[i], candidates[i]+3, p);
+            }
+        }
+    }
+
+    *cost = (float)qMax(0.0, quadricError(q, p));
+    return true;
+}
+
+//One half-edge stands for each undirected edge
+int MeshDecimator::canonical(int h) const
+{
+    const int t = mPair[h];
+    return (t<0 || h<t) ? h : t;
+}
+
+bool MeshDecimator::makeEntry(int h, HeapEntry* entry) const
+{
+    double p[3];
+    if(!edgeCost(h, &entry->cost, p))
+        return false;
+    entry->halfEdge = h;
+    entry->from = mTri[h];
+    entry->to = mTri[nextHe(h)];
+    entry->fromStamp = mStamp[entry->from];
+    entry->toStamp = mStamp[entry->to];
+    return true;
+}
+
+bool MeshDecimator::flips(const std::vector<int>& ringV, int moved,
+                          int skipA, int skipB, const double* p) const
+{
+    for(size_t k=0; k<ringV.size(); k++)
+    {
+        const int f = ringV[k]/3;
+        if(f==skipA || f==skipB)
+            continue;
+        const double* old[3];
+        const double* now[3];
+        for(int c=0; c<3; c++)
+        {
+            int v = mTri[f*3+c];
+            old[c] = &mPos[v*3];
+            now[c] = (v==moved) ? p : old[c];
+        }
+        double n0[3], n1[3];
+        triangleNormal(old[0], old[1], old[2], n0);
+        triangleNormal(now[0], now[1], now[2], n1);
+        double len0 = n0[0]*n0[0] + n0[1]*n0[1] + n0[2]*n0[2];
+        double len1 = n1[0]*n1[0] + n1[1]*n1[1] + n1[2]*n1[2];
+        if(len1 <= 1e-12*len0)
+            return true;
+        double dot = n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2];
+        if(dot <= 0.0)
+            return true;
+    }
+    return false;
+}
+
+bool MeshDecimator::canCollapse(int h, const double* p, int partition,
+                                std::vector<int>& ringA, std::vector<int>& ringB) const
+{
+    const int a = mTri[h];
+    const int b = mTri[nextHe(h)];
+    const int hp = mPair[h];
+    if(mLocked[a] || mLocked[b])
+        return false;
+    //An interior edge between two boundary vertices would pinch the surface
+    if(hp>=0 && mBoundary[a] && mBoundary[b])
+        return false;
+
+    const bool closedA = ring(a, ringA);
+    const bool closedB = ring(b, ringB);
+    if(ringA.size() >= kMaxRing || ringB.size() >= kMaxRing)
+        return false;
+    if(closedA && closedB && ringA.size()<=3 && ringB.size()<=3)
+        return false;
+
+    if(partition>=0)
+    {
+        const std::vector<int>* rings[2] = {&ringA, &ringB};
+        for(int r=0; r<2; r++)
+        {
+            for(size_t k=0; k<rings[r]->size(); k++)
+            {
+                const int f = rings[r]->at(k)/3;
+                if(mPartition[mTri[f*3]]!=partition ||
+                   mPartition[mTri[f*3+1]]!=partition ||
+                   mPartition[mTri[f*3+2]]!=partition)
+                    return false;
+            }
+        }
+    }
+
+    //Link condition: the one-rings may only share the opposite vertices
+    std::vector<int> na, nb;
+    for(size_t k=0; k<ringA.size(); k++)
+    {
+        na.push_back(mTri[nextHe(ringA[k])]);
+        na.push_back(mTri[prevHe(ringA[k])]);
+    }
+    for(size_t k=0; k<ringB.size(); k++)
+    {
+        nb.push_back(mTri[nextHe(ringB[k])]);
+        nb.push_back(mTri[prevHe(ringB[k])]);
+    }
+    std::sort(na.begin(), na.end());
+    na.erase(std::unique(na.begin(), na.end()), na.end());
+    std::sort(nb.begin(), nb.end());
+    nb.erase(std::unique(nb.begin(), nb.end()), nb.end());
+    int shared = 0;
+    for(size_t i=0, j=0; i<na.size() && j<nb.size();)
+    {
+        if(na[i]<nb[j]) i++;
+        else if(nb[j]<na[i]) j++;
+        else
+        {
+            if(na[i]!=a && na[i]!=b)
+                shared++;
+            i++; j++;
+        }
+    }
+    if(shared != (hp>=0 ? 2 : 1))
+        return false;
+
+    //Opposite interior vertices must keep a valence of at least three
+    std::vector<int> opposite;
+    const int opp[2] = {mTri[prevHe(h)], hp>=0 ? mTri[prevHe(hp)] : -1};
+    for(int i=0; i<2; i++)
+    {
+        if(opp[i]<0)
+            continue;
+        if(ring(opp[i], opposite) && opposite.size()<=3)
+            return false;
+    }
+
+    const int f0 = h/3;
+    const int f1 = hp>=0 ? hp/3 : -1;
+    return !flips(ringA, a, f0, f1, p) && !flips(ringB, b, f0, f1, p);
+}
+
+/**
+ * @brief collapse
+ * Merges the origin of h into its destination at position p, removes the
+ * one or two triangles on the edge and stitches their outer twins.
+ * @return number of triangles removed
+ */
+int MeshDecimator::collapse(int h, const double* p,
+                            const std::vector<int>& ringA, const std::vector<int>& ringB)
+{
+    const int a = mTri[h];
+    const int b = mTri[nextHe(h)];
+    const int hp = mPair[h];
+
+    const int dead[2] = {h, hp};
+    for(int i=0; i<2; i++)
+    {
+        const int e = dead[i];
+        if(e<0)
+            continue;
+        //o1 leaves the opposite vertex, o2 arrives at it; they become twins
+        const int o1 = mPair[nextHe(e)];
+        const int o2 = mPair[prevHe(e)];
+        const int opp = mTri[prevHe(e)];
+        if(o1>=0) mPair[o1] = o2;
+        if(o2>=0) mPair[o2] = o1;
+        mOut[opp] = (o1>=0) ? o1 : (o2>=0 ? nextHe(o2) : -1);
+    }
+
+    for(size_t k=0; k<ringA.size(); k++)
+        mTri[ringA[k]] = b;
+
+    for(int i=0; i<2; i++)
+    {
+        if(dead[i]<0)
+            continue;
+        const int f = dead[i]/3;
+        mFaceAlive[f] = 0;
+        for(int c=0; c<3; c++)
+            mPair[f*3+c] = -1;
+    }
+
+    mOut[a] = -1;
+    mOut[b] = -1;
+    const std::vector<int>* rings[2] = {&ringA, &ringB};
+    for(int r=0; r<2 && mOut[b]<0; r++)
+    {
+        for(size_t k=0; k<rings[r]->size(); k++)
+        {
+            const int e = rings[r]->at(k);
+            if(mFaceAlive[e/3])
+            {
+                mOut[b] = e;
+                break;
+            }
+        }
+    }
+
+    for(int i=0; i<10; i++)
+        mQuadric[b].q[i] += mQuadric[a].q[i];
+    mPos[b*3] = p[0];
+    mPos[b*3+1] = p[1];
+    mPos[b*3+2] = p[2];
+    mBoundary[b] = mBoundary[a] || mBoundary[b];
+    mStamp[a]++;
+    mStamp[b]++;
+    return hp>=0 ? 2 : 1;
+}
+
+void MeshDecimator::seedHeap(std::vector<HeapEntry>& heap,
+                             const std::vector<int>& halfEdges) const
+{
+    heap.resize(halfEdges.size());
+    std::vector<char> ok(halfEdges.size(), 0);
+    parallelFor(0, (long)halfEdges.size(), 8192, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+            ok[i] = makeEntry(halfEdges[i], &heap[i]) ? 1 : 0;
+    });
+    size_t kept = 0;
+    for(size_t i=0; i<heap.size(); i++)
+    {
+        if(ok[i])
+            heap[kept++] = heap[i];
+    }
+    heap.resize(kept);
+    std::make_heap(heap.begin(), heap.end(), HeapOrder());
+}
+
+/**
+ * @brief runHeap
+ * Collapses the cheapest valid edges until facesToRemove triangles are gone,
+ * the error bound is reached or the heap runs dry. With partition >= 0 only
+ * edges whose one-rings lie inside that partition are touched.
+ * @return number of triangles removed
+ */
+long MeshDecimator::runHeap(std::vector<HeapEntry>& heap, int partition,
+                            long facesToRemove, long* collapses)
+{
+    long removed = 0;
+    std::vector<int> ringA, ringB, ringN;
+    while(!heap.empty() && removed < facesToRemove)
+    {
+        std::pop_heap(heap.begin(), heap.end(), HeapOrder());
+        HeapEntry entry = heap.back();
+        heap.pop_back();
+
+        const int h = entry.halfEdge;
+        if(!mFaceAlive[h/3] || mTri[h]!=entry.from || mTri[nextHe(h)]!=entry.to ||
+           mStamp[entry.from]!=entry.fromStamp || mStamp[entry.to]!=entry.toStamp)
+            continue;
+        if(mMaxError>=0.0 && entry.cost > mMaxError)
+            break;
+
+        float cost;
+        double p[3];
+        if(!edgeCost(h, &cost, p) || !canCollapse(h, p, partition, ringA, ringB))
+            continue;
+
+        const int b = entry.to;
+        removed += collapse(h, p, ringA, ringB);
+        (*collapses)++;
+
+        ring(b, ringN);
+        for(size_t k=0; k<ringN.size(); k++)
+        {
+            const int edges[2] = {canonical(ringN[k]), canonical(prevHe(ringN[k]))};
+            for(int i=0; i<2; i++)
+            {
+                const int e = edges[i];
+                if(partition>=0 && (mPartition[mTri[e]]!=partition ||
+                                    mPartition[mTri[nextHe(e)]]!=partition))
+                    continue;
+                HeapEntry next;
+                if(makeEntry(e, &next))
+                {
+                    heap.push_back(next);
+                    std::push_heap(heap.begin(), heap.end(), HeapOrder());
+                }
+            }
+        }
+    }
+    return removed;
+}
+
+/**
+ * @brief runPartitions
+ * Splits the bounding box into a grid of cells, one heap per cell, and lets
+ * every cell remove its share of the triangles it fully contains.
+ */
+void MeshDecimator::runPartitions(long facesToRemove)
+{
+    const long vertexCount = (long)mOut.size();
+    double lo[3] = {0,0,0}, hi[3] = {0,0,0};
+    for(long v=0; v<vertexCount; v++)
+    {
+        for(int a=0; a<3; a++)
+        {
+            double x = mPos[v*3+a];
+            if(v==0 || x<lo[a]) lo[a] = x;
+            if(v==0 || x>hi[a]) hi[a] = x;
+        }
+    }
+
+    const int grid = qMax(2, (int)ceil(cbrt(4.0 * parallelThreadCount())));
+    const int partitions = grid*grid*grid;
+    mPartition.resize(vertexCount);
+    parallelFor(0, vertexCount, 8192, [&](long from, long to) {
+        for(long v=from; v<to; v++)
+        {
+            int cell[3];
+            for(int a=0; a<3; a++)
+            {
+                double extent = hi[a]-lo[a];
+                int c = extent>0.0 ? (int)((mPos[v*3+a]-lo[a]) / extent * grid) : 0;
+                cell[a] = qBound(0, c, grid-1);
+            }
+            mPartition[v] = (cell[2]*grid + cell[1])*grid + cell[0];
+        }
+    });
+
+    std::vector<std::vector<int> > buckets(partitions);
+    std::vector<long> interiorFaces(partitions, 0);
+    for(int h=0; h<(int)mTri.size(); h++)
+    {
+        if(!mFaceAlive[h/3])
+            continue;
+        const int pa = mPartition[mTri[h]];
+        const int pb = mPartition[mTri[nextHe(h)]];
+        if(pa==pb && canonical(h)==h)
+            buckets[pa].push_back(h);
+        if(h%3==0 && pa==pb && pa==mPartition[mTri[h+2]])
+            interiorFaces[pa]++;
+    }
+
+    const double ratio = (double)facesToRemove / (double)qMax(1L, mAliveFaces);
+    std::atomic<long> removed(0);
+    std::atomic<long> collapses(0);
+    parallelFor(0, partitions, 1, [&](long from, long to) {
+        for(long part=from; part<to; part++)
+        {
+            long quota = (long)(ratio * interiorFaces[part]);
+            if(quota<=0)
+                continue;
+            std::vector<HeapEntry> heap(buckets[part].size());
+            for(size_t i=0; i<buckets[part].size(); i++)
+                makeEntry(buckets[part][i], &heap[i]);
+            std::make_heap(heap.begin(), heap.end(), HeapOrder());
+            long count = 0;
+            removed += runHeap(heap, (int)part, quota, &count);
+            collapses += count;
+        }
+    });
+
+    mAliveFaces -= removed.load();
+    mCollapses += collapses.load();
+}
+
+PolygonMesh* MeshDecimator::buildResult()
+{
+    const long vertexCount = (long)mOut.size();
+    std::vector<int> remap(vertexCount, -1);
+    std::vector<float> positions;
+    std::vector<unsigned int> triangles;
+    triangles.reserve(mAliveFaces*3);
+
+    for(size_t t=0; t<mFaceAlive.size(); t++)
+    {
+        if(!mFaceAlive[t])
+            continue;
+        for(int c=0; c<3; c++)
+        {
+            int v = mTri[t*3+c];
+            if(remap[v]<0)
+            {
+                remap[v] = (int)(positions.size()/3);
+                positions.push_back((float)mPos[v*3]);
+                positions.push_back((float)mPos[v*3+1]);
+                positions.push_back((float)mPos[v*3+2]);
+            }
+            triangles.push_back((unsigned int)remap[v]);
+        }
+    }
+    return MeshBuilder::buildTriangles(positions, triangles);
+}
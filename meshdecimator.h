@@ -0,0 +1,91 @@
+#ifndef MESHDECIMATOR_H
+#define MESHDECIMATOR_H
+
+#include <vector>
+
+#include "trianglemesh.h"
+
+/**
+ * Garland-Heckbert quadric error edge-collapse simplification.
+ *
+ * The input PolygonMesh is copied into a compact index-based half-edge
+ * form (faces fan-triangulated, twins taken from the mesh's pair links)
+ * where next/prev are implicit in the triangle layout. Collapses that
+ * would break the link condition, pinch a boundary or flip a face are
+ * rejected, so a manifold input stays manifold.
+ *
+ * Collapses run first in parallel over a grid of spatial partitions, each
+ * only touching edges whose one-rings lie completely inside it, and then
+ * serially for the edges along partition borders.
+ */
+class MeshDecimator
+{
+public:
+    explicit MeshDecimator(const PolygonMesh* mesh);
+    void setTargetFaceCount(long faces);
+    void setMaxError(double error);
+    void setParallel(bool parallel);
+    //Returns a new mesh; the input mesh is not modified
+    PolygonMesh* decimate();
+    long collapseCount();
+
+private:
+    struct Quadric {
+        double q[10];
+    };
+    //Flat heap entry; stale entries are detected by the vertex stamps
+    struct HeapEntry {
+        float cost;
+        int halfEdge;
+        int from;
+        int to;
+        unsigned int fromStamp;
+        unsigned int toStamp;
+    };
+    struct HeapOrder {
+        bool operator()(const HeapEntry& a, const HeapEntry& b) const {
+            return a.cost > b.cost;
+        }
+    };
+
+    static int nextHe(int h) { return (h%3==2) ? h-2 : h+1; }
+    static int prevHe(int h) { return (h%3==0) ? h+2 : h-1; }
+
+    void buildHalfEdges();
+    void computeQuadrics();
+    bool ring(int v, std::vector<int>& out) const;
+    bool edgeCost(int h, float* cost, double* p) const;
+    int canonical(int h) const;
+    bool makeEntry(int h, HeapEntry* entry) const;
+    bool canCollapse(int h, const double* p, int partition,
+                     std::vector<int>& ringA, std::vector<int>& ringB) const;
+    bool flips(const std::vector<int>& ringV, int moved, int skipA, int skipB,
+               const double* p) const;
+    int collapse(int h, const double* p,
+                 const std::vector<int>& ringA, const std::vector<int>& ringB);
+    void seedHeap(std::vector<HeapEntry>& heap, const std::vector<int>& halfEdges) const;
+    long runHeap(std::vector<HeapEntry>& heap, int partition,
+                 long facesToRemove, long* collapses);
+    void runPartitions(long facesToRemove);
+    PolygonMesh* buildResult();
+
+    const PolygonMesh* mMesh;
+    long mTargetFaces;
+    double mMaxError;
+    bool mParallel;
+    long mCollapses;
+    long mAliveFaces;
+
+    std::vector<double> mPos;
+    std::vector<int> mTri;
+    std::vector<int> mPair;
+    std::vector<int> mOut;
+    std::vector<char> mFaceAlive;
+    std::vector<char> mLocked;
+    std::vector<char> mBoundary;
+    std::vector<unsigned int> mStamp;
+    std::vector<Quadric> mQuadric;
+    std::vector<int> mPartition;
+};
+
+#endif // MESHDECIMATOR_H
@@ -0,0 +1,1116 @@
+#include "meshfileio.h"
+#include "meshbuilder.h"
+#include "meshbuffers.h"
+#include "mfileparser.h"
+#include "vertexwelder.h"
+#include "pathpointwriter.h"
+#include "parallel.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+#include <unordered_map>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+enum PlyType {
+    Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, InvalidType
+};
+
+PlyType plyType(const std::string& name)
+{
+    if(name=="char" || name=="int8") return Int8;
+    if(name=="uchar" || name=="uint8") return UInt8;
+    if(name=="short" || name=="int16") return Int16;
+    if(name=="ushort" || name=="uint16") return UInt16;
+    if(name=="int" || name=="int32") return Int32;
+    if(name=="uint" || name=="uint32") return UInt32;
+    if(name=="float" || name=="float32") return Float32;
+    if(name=="double" || name=="float64") return Float64;
+    return InvalidType;
+}
+
+int plySize(PlyType type)
+{
+    static const int sizes[] = {1, 1, 2, 2, 4, 4, 4, 8, 0};
+    return sizes[type];
+}
+
+bool littleEndianHost()
+{
+    const quint16 probe = 1;
+    return *(const uchar*)&probe == 1;
+}
+
+double plyValue(const uchar* p, PlyType type, bool swap)
+{
+    uchar b[8];
+    const int size = plySize(type);
+    for(int i=0; i<size; i++)
+        b[i] = swap ? p[size-1-i] : p[i];
+    switch(type)
+    {
+    case Int8: return (double)(qint8)b[0];
+    case UInt8: return (double)b[0];
+    case Int16: { qint16 v; memcpy(&v, b, 2); return v; }
+    case UInt16: { quint16 v; memcpy(&v, b, 2); return v; }
+    case Int32: { qint32 v; memcpy(&v, b, 4); return v; }
+    case UInt32: { quint32 v; memcpy(&v, b, 4); return v; }
+    case Float32: { float v; memcpy(&v, b, 4); return v; }
+    case Float64: { double v; memcpy(&v, b, 8); return v; }
+    default: return 0.0;
+    }
+}
+
+struct PlyProperty {
+    std::string name;
+    PlyType type;
+    //A list is a count of countType followed by that many values of type
+    bool list;
+    PlyType countType;
+};
+
+//Length of the list at p, or -1 if the count is negative or the list runs past end
+qint64 plyListLength(const uchar* p, const uchar* end, const PlyProperty& property, bool swap)
+{
+    const int countSize = plySize(property.countType);
+    if(end - p < countSize)
+        return -1;
+    const double n = plyValue(p, property.countType, swap);
+    if(!(n>=0) || n > (double)(end - p - countSize) / plySize(property.type))
+        return -1;
+    return (qint64)n;
+}
+
+struct PlyElement {
+    std::string name;
+    quint64 count;
+    std::vector<PlyProperty> properties;
+
+    //Bytes per item, 0 if the size varies
+    int stride() const
+    {
+        int bytes = 0;
+        for(size_t i=0; i<properties.size(); i++)
+        {
+            if(properties[i].list)
+                return 0;
+            bytes += plySize(properties[i].type);
+        }
+        return bytes;
+    }
+
+    int find(const char* name) const
+    {
+        for(size_t i=0; i<properties.size(); i++)
+            if(properties[i].name==name)
+                return (int)i;
+        return -1;
+    }
+};
+
+//Appends 4 or 8 byte values in little-endian order whatever the host order is
+void appendLittleEndian(std::string& out, const void* value, int size)
+{
+    const char* bytes = (const char*)value;
+    if(littleEndianHost())
+    {
+        out.append(bytes, size);
+        return;
+    }
+    for(int i=size-1; i>=0; i--)
+        out.push_back(bytes[i]);
+}
+
+void appendFloat(std::string& out, float value)
+{
+    appendLittleEndian(out, &value, 4);
+}
+
+void appendInt(std::string& out, qint32 value)
+{
+    appendLittleEndian(out, &value, 4);
+}
+
+void appendText(std::string& out, float value)
+{
+    char number[32];
+    out.append(number, PathPointWriter::formatFloat(value, number));
+}
+
+void appendText(std::string& out, long value)
+{
+    char number[32];
+    out.append(number, PathPointWriter::formatInteger(value, number));
+}
+
+struct PositionKey {
+    quint32 bits[3];
+    bool operator==(const PositionKey& other) const
+    {
+        return bits[0]==other.bits[0] && bits[1]==other.bits[1] && bits[2]==other.bits[2];
+    }
+};
+
+struct PositionKeyHash {
+    size_t operator()(const PositionKey& key) const
+    {
+        quint64 h = key.bits[0] * 0x9E3779B97F4A7C15ULL;
+        h ^= (key.bits[1] + (h >> 29)) * 0xC2B2AE3D27D4EB4FULL;
+        h ^= (key.bits[2] + (h >> 31)) * 0x165667B19E3779F9ULL;
+        return (size_t)(h ^ (h >> 32));
+    }
+};
+
+#ifdef HAVE_ZLIB
+//gzip copy of file at zlib's default level, as `gzip` would write it
+bool gzipFile(QString file, QString target)
+{
+    QFile in(file);
+    if(!in.open(QIODevice::ReadOnly))
+        return false;
+    gzFile out = gzopen(QFile::encodeName(target).constData(), "wb");
+    if(out==NULL)
+        return false;
+    bool ok = true;
+    QByteArray chunk;
+    while(ok && !(chunk = in.read(1 << 20)).isEmpty())
+        ok = gzwrite(out, chunk.constData(), (unsigned)chunk.size()) == chunk.size();
+    return gzclose(out)==Z_OK && ok;
+}
+#endif
+
+}
+
+MeshFileIO::MeshFileIO()
+{
+    mWeldEpsilon = 0.0f;
+    mWelded = 0;
+}
+
+MeshFileIO::Format MeshFileIO::detect(QString fileName)
+{
+    QFile file(fileName);
+    if(file.open(QIODevice::ReadOnly))
+    {
+        QByteArray head = file.read(84);
+        const qint64 size = file.size();
+        file.close();
+        if(head.startsWith("ply\n") || head.startsWith("ply\r\n"))
+            return PLY;
+        //Binary STL: 80 byte header, triangle count, 50 bytes per triangle
+        if(head.size()==84)
+        {
+            quint32 triangles = (uchar)head[80] | ((uchar)head[81] << 8) |
+                                ((uchar)head[82] << 16) | ((quint32)(uchar)head[83] << 24);
+            if(size == 84 + 50*(qint64)triangles)
+                return STL;
+        }
+    }
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    if(suffix=="ply")
+        return PLY;
+    if(suffix=="stl")
+        return STL;
+    return OBJ;
+}
+
+void MeshFileIO::setWeldEpsilon(float epsilon)
+{
+    mWeldEpsilon = epsilon;
+}
+
+long MeshFileIO::weldedVertexCount() const
+{
+    return mWelded;
+}
+
+QString MeshFileIO::error() const
+{
+    return mError;
+}
+
+bool MeshFileIO::fail(QString error)
+{
+    mError = error;
+    qWarning() << "Cannot read mesh:" << error;
+    return false;
+}
+
+PolygonMesh* MeshFileIO::read(QString fileName)
+{
+    QElapsedTimer timer;
+    timer.start();
+    mError = QString();
+    mWelded = 0;
+    mPositions.clear();
+    mNormals.clear();
+    mFaceOffsets.assign(1, 0);
+    mFaceIndices.clear();
+
+    const Format format = detect(fileName);
+    if(format==OBJ)
+    {
+        fail(fileName + " is not a PLY or STL file");
+        return NULL;
+    }
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        fail(file.errorString());
+        return NULL;
+    }
+    const qint64 size = file.size();
+    uchar* data = size>0 ? file.map(0, size) : NULL;
+    if(data==NULL)
+    {
+        fail("unable to map " + fileName);
+        return NULL;
+    }
+    bool ok = format==PLY ? readPly(data, size) : readStl(data, size);
+    file.unmap(data);
+    file.close();
+    if(!ok)
+        return NULL;
+
+    weld();
+    PolygonMesh* mesh = MeshBuilder::build(mPositions, mFaceOffsets, mFaceIndices,
+                                           mNormals.empty() ? NULL : &mNormals);
+    qDebug() << "Loaded" << fileName << ":" << (qulonglong)mesh->vertVector->size() << "vertices,"
+             << (qulonglong)mesh->faceVector->size() << "faces in" << timer.elapsed() << "ms";
+
+    std::vector<float>().swap(mPositions);
+    std::vector<float>().swap(mNormals);
+    std::vector<unsigned int>().swap(mFaceOffsets);
+    std::vector<unsigned int>().swap(mFaceIndices);
+    return mesh;
+}
+
+bool MeshFileIO::readPly(const uchar* data, qint64 size)
+{
+    //The header is text up to and including the end_header line
+    const std::string header((const char*)data, (size_t)qMin<qint64>(size, 1 << 16));
+    const size_t headerEnd = header.find("end_header");
+    const size_t body = headerEnd==std::string::npos ? std::string::npos : header.find('\n', headerEnd);
+    if(body==std::string::npos)
+        return fail("PLY header is not terminated");
+
+    bool binary = false;
+    bool little = true;
+    std::vector<PlyElement> elements;
+    std::istringstream lines(header.substr(0, headerEnd));
+    std::string line;
+    while(std::getline(lines, line))
+    {
+        std::istringstream stream(line);
+        std::vector<std::string> words;
+        std::string word;
+        while(stream >> word)
+            words.push_back(word);
+        if(words.empty())
+            continue;
+        if(words[0]=="format" && words.size()>1)
+        {
+            binary = words[1]!="ascii";
+            little = words[1]=="binary_little_endian";
+        }
+        else if(words[0]=="element" && words.size()>2)
+        {
+            PlyElement element;
+            element.name = words[1];
+            element.count = strtoull(words[2].c_str(), NULL, 10);
+            elements.push_back(element);
+        }
+        else if(words[0]=="property" && words.size()>2 && !elements.empty())
+        {
+            PlyProperty property;
+            property.list = words.size()>4 && words[1]=="list";
+            property.countType = property.list ? plyType(words[2]) : InvalidType;
+            property.type = plyType(words[property.list ? 3 : 1]);
+            property.name = words.back();
+            if(property.type==InvalidType || (property.list && property.countType==InvalidType))
+                return fail("unknown PLY property type in \"" + QString::fromStdString(line) + "\"");
+            elements.back().properties.push_back(property);
+        }
+    }
+    if(!binary)
+        return fail("ASCII PLY is not supported, only binary PLY");
+
+    const bool swap = little != littleEndianHost();
+    const uchar* p = data + body + 1;
+    const uchar* end = data + size;
+    for(size_t el=0; el<elements.size(); el++)
+    {
+        const PlyElement& element = elements[el];
+        const long count = (long)element.count;
+        const int stride = element.stride();
+
+        if(element.name=="vertex")
+        {
+            const int x = element.find("x"), y = element.find("y"), z = element.find("z");
+            const int nx = element.find("nx"), ny = element.find("ny"), nz = element.find("nz");
+            if(stride==0 || x<0 || y<0 || z<0)
+                return fail("PLY vertices need fixed-size x, y and z properties");
+            if(element.count > (quint64)(end - p) / stride)
+                return fail("PLY vertex data is truncated");
+
+            std::vector<int> offsets(element.properties.size(), 0);
+            for(size_t i=1; i<offsets.size(); i++)
+                offsets[i] = offsets[i-1] + plySize(element.properties[i-1].type);
+            const int columns[6] = {x, y, z, nx, ny, nz};
+            const bool normals = nx>=0 && ny>=0 && nz>=0;
+            //Packed little-endian floats are copied as they are
+            const bool packed = !swap && offsets[y]==offsets[x]+4 && offsets[z]==offsets[x]+8 &&
+                    element.properties[x].type==Float32 && element.properties[y].type==Float32 &&
+                    element.properties[z].type==Float32;
+
+            mPositions.resize(count*3);
+            if(normals)
+                mNormals.resize(count*3);
+            parallelFor(0, count, 16384, [&](long from, long to) {
+                for(long i=from; i<to; i++)
+                {
+                    const uchar* v = p + (size_t)i*stride;
+                    if(packed)
+                        memcpy(&mPositions[i*3], v + offsets[x], 12);
+                    else
+                    {
+                        for(int a=0; a<3; a++)
+                            mPositions[i*3+a] = (float)plyValue(v + offsets[columns[a]],
+                                                                element.properties[columns[a]].type, swap);
+                    }
+                    //Same handedness flip as the OBJ parser
+                    mPositions[i*3] = -mPositions[i*3];
+                    //Normals are kept as they are, like OBJ vn records
+                    if(normals)
+                    {
+                        for(int a=0; a<3; a++)
+                            mNormals[i*3+a] = (float)plyValue(v + offsets[columns[a+3]],
+                                                              element.properties[columns[a+3]].type, swap);
+                    }
+                }
+            });
+            p += (size_t)count*stride;
+        }
+        else if(element.name=="face")
+        {
+            int list = element.find("vertex_indices");
+            if(list<0)
+                list = element.find("vertex_index");
+            if(list<0 || !element.properties[list].list)
+                return fail("PLY faces need a vertex_indices list");
+            const PlyProperty& indices = element.properties[list];
+            const int indexSize = plySize(indices.type);
+            //Every face takes at least one byte
+            if(element.count > (quint64)(end - p))
+                return fail("PLY face data is truncated");
+
+            //Lists vary in length, so finding the faces is one sequential scan
+            std::vector<const uchar*> starts(count);
+            mFaceOffsets.resize(count+1);
+            mFaceOffsets[0] = 0;
+            for(long f=0; f<count; f++)
+            {
+                for(size_t k=0; k<element.properties.size(); k++)
+                {
+                    const PlyProperty& property = element.properties[k];
+                    if(!property.list)
+                    {
+                        if(end - p < plySize(property.type))
+                            return fail("PLY face data is truncated");
+                        p += plySize(property.type);
+                        continue;
+                    }
+                    const qint64 n = plyListLength(p, end, property, swap);
+                    if(n<0)
+                        return fail("PLY face data is truncated");
+                    const int countSize = plySize(property.countType);
+                    if((int)k==list)
+                    {
+                        starts[f] = p + countSize;
+                        mFaceOffsets[f+1] = mFaceOffsets[f] + (unsigned int)n;
+                    }
+                    p += countSize + n*plySize(property.type);
+                }
+            }
+
+            mFaceIndices.resize(mFaceOffsets[count]);
+            const unsigned int vertexCount = (unsigned int)(mPositions.size() / 3);
+            std::atomic<bool> outOfRange(false);
+            parallelFor(0, count, 16384, [&](long from, long to) {
+                for(long f=from; f<to; f++)
+                {
+                    const unsigned int first = mFaceOffsets[f];
+                    const unsigned int corners = mFaceOffsets[f+1] - first;
+                    if(!swap && indexSize==4)
+                    {
+                        //Negative int32 indices wrap to values above vertexCount
+                        memcpy(&mFaceIndices[first], starts[f], (size_t)corners*4);
+                        for(unsigned int k=0; k<corners; k++)
+                        {
+                            if(mFaceIndices[first+k] >= vertexCount)
+                                outOfRange = true;
+                        }
+                    }
+                    else
+                    {
+                        for(unsigned int k=0; k<corners; k++)
+                        {
+                            //Range checked before the cast, which is undefined for negatives
+                            const double index = plyValue(starts[f] + (size_t)k*indexSize, indices.type, swap);
+                            if(!(index>=0) || index >= vertexCount)
+                            {
+                                outOfRange = true;
+                                mFaceIndices[first+k] = 0;
+                            }
+                            else
+                                mFaceIndices[first+k] = (unsigned int)index;
+                        }
+                    }
+                }
+            });
+            if(outOfRange)
+                return fail("PLY face refers to a missing vertex");
+        }
+        else if(stride>0 || element.properties.empty())
+        {
+            if(stride>0 && element.count > (quint64)(end - p) / stride)
+                return fail("PLY data is truncated");
+            p += (size_t)count*stride;
+        }
+        else
+        {
+            //Same checks as the face lists, for elements this reader skips
+            for(long i=0; i<count; i++)
+            {
+                for(size_t k=0; k<element.properties.size(); k++)
+                {
+                    const PlyProperty& property = element.properties[k];
+                    if(property.list)
+                    {
+                        const qint64 n = plyListLength(p, end, property, swap);
+                        if(n<0)
+                            return fail("PLY data is truncated");
+                        p += plySize(property.countType) + n*plySize(property.type);
+                    }
+                    else
+                    {
+                        if(end - p < plySize(property.type))
+                            return fail("PLY data is truncated");
+                        p += plySize(property.type);
+                    }
+                }
+            }
+        }
+    }
+    if(mPositions.empty())
+        return fail("PLY file has no vertices");
+    return true;
+}
+
+/**
+ * @brief readStl
+ * Copies the corners of all triangles out of the file in parallel, then
+ * merges corners with identical positions so neighbouring triangles share
+ * vertices and edges.
+ */
+bool MeshFileIO::readStl(const uchar* data, qint64 size)
+{
+    if(size < 84)
+        return fail("STL file is truncated");
+    quint32 triangles = data[80] | (data[81] << 8) | (data[82] << 16) | ((quint32)data[83] << 24);
+    if(size != 84 + 50*(qint64)triangles)
+        return fail("not a binary STL file (ASCII STL is not supported)");
+
+    const long cornerCount = (long)triangles * 3;
+    const bool swap = !littleEndianHost();
+    std::vector<PositionKey> corners(cornerCount);
+    parallelFor(0, (long)triangles, 16384, [&](long from, long to) {
+        for(long t=from; t<to; t++)
+        {
+            const uchar* facet = data + 84 + (size_t)t*50 + 12;
+            for(int c=0; c<9; c++)
+            {
+                float value;
+                if(swap)
+                    value = (float)plyValue(facet + c*4, Float32, true);
+                else
+                    memcpy(&value, facet + c*4, 4);
+                //+0.0f turns -0 into 0 so both merge
+                value += 0.0f;
+                memcpy(&corners[t*3 + c/3].bits[c%3], &value, 4);
+            }
+        }
+    });
+
+    std::unordered_map<PositionKey,unsigned int,PositionKeyHash> vertices;
+    vertices.reserve(cornerCount / 2 + 1);
+    mFaceIndices.resize(cornerCount);
+    for(long c=0; c<cornerCount; c++)
+    {
+        std::pair<std::unordered_map<PositionKey,unsigned int,PositionKeyHash>::iterator,bool> slot =
+                vertices.insert(std::make_pair(corners[c], (unsigned int)(mPositions.size() / 3)));
+        if(slot.second)
+        {
+            float xyz[3];
+            memcpy(xyz, corners[c].bits, 12);
+            mPositions.push_back(-xyz[0]);
+            mPositions.push_back(xyz[1]);
+            mPositions.push_back(xyz[2]);
+        }
+        mFaceIndices[c] = slot.first->second;
+    }
+    mFaceOffsets.resize((size_t)triangles + 1);
+    for(size_t f=0; f<mFaceOffsets.size(); f++)
+        mFaceOffsets[f] = (unsigned int)(f*3);
+    if(mPositions.empty())
+        return fail("STL file has no triangles");
+    return true;
+}
+
+/**
+ * @brief weld
+ * Optionally merges nearby vertices, then drops repeated corners and the
+ * faces left with fewer than three.
+ */
+void MeshFileIO::weld()
+{
+    if(mWeldEpsilon > 0.0f)
+    {
+        VertexWelder welder(mWeldEpsilon);
+        std::vector<long> target = welder.weld(mPositions);
+        mWelded = welder.mergedCount();
+        if(mWelded > 0)
+        {
+            std::vector<unsigned int> remap(target.size());
+            unsigned int kept = 0;
+            for(size_t i=0; i<target.size(); i++)
+            {
+                if(target[i]==(long)i)
+                {
+                    for(int a=0; a<3; a++)
+                        mPositions[kept*3+a] = mPositions[i*3+a];
+                    remap[i] = kept++;
+                }
+                else
+                    remap[i] = remap[target[i]];
+            }
+            mPositions.resize((size_t)kept*3);
+            //File normals belong to the unwelded vertices
+            mNormals.clear();
+            parallelFor(0, (long)mFaceIndices.size(), 65536, [&](long from, long to) {
+                for(long k=from; k<to; k++)
+                    mFaceIndices[k] = remap[mFaceIndices[k]];
+            });
+        }
+    }
+
+    unsigned int out = 0;
+    size_t faces = 0;
+    for(size_t f=0; f+1<mFaceOffsets.size(); f++)
+    {
+        const unsigned int begin = mFaceOffsets[f];
+        const unsigned int end = mFaceOffsets[f+1];
+        const unsigned int start = out;
+        for(unsigned int k=begin; k<end; k++)
+        {
+            if(out==start || mFaceIndices[out-1]!=mFaceIndices[k])
+                mFaceIndices[out++] = mFaceIndices[k];
+        }
+        if(out-start > 1 && mFaceIndices[out-1]==mFaceIndices[start])
+            out--;
+        if(out-start < 3)
+        {
+            out = start;
+            continue;
+        }
+        mFaceOffsets[++faces] = out;
+    }
+    mFaceOffsets.resize(faces+1);
+    mFaceIndices.resize(out);
+}
+
+bool MeshFileIO::writeChunks(QIODevice* device, long count, long grain,
+                             const std::function<void(long,long,std::string&)>& format)
+{
+    const long chunks = (count + grain - 1) / grain;
+    const long batch = 2L * parallelThreadCount();
+    std::vector<std::string> buffers(batch);
+    for(long first=0; first<chunks; first+=batch)
+    {
+        const long last = qMin(chunks, first+batch);
+        parallelFor(first, last, 1, [&](long from, long to) {
+            for(long c=from; c<to; c++)
+            {
+                std::string& out = buffers[c-first];
+                out.clear();
+                format(c*grain, qMin(count, (c+1)*grain), out);
+            }
+        });
+        for(long c=first; c<last; c++)
+        {
+            const std::string& out = buffers[c-first];
+            if(device->write(out.data(), (qint64)out.size()) != (qint64)out.size())
+                return false;
+        }
+    }
+    return true;
+}
+
+bool MeshFileIO::writePly(const PolygonMesh* mesh, QString fileName)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const std::vector<PolygonMesh::HE_vert*>& verts = *mesh->vertVector;
+    const std::vector<PolygonMesh::HE_face*>& faces = *mesh->faceVector;
+    const long vertexCount = (long)verts.size();
+    const long faceCount = (long)faces.size();
+
+    const long maxCorners = parallelReduce(0, faceCount, 16384, 0L,
+        [&](long from, long to) {
+            long most = 0;
+            for(long f=from; f<to; f++)
+            {
+                long n = 0;
+                PolygonMesh::HE_edge* e = faces[f]->edge;
+                if(e!=NULL)
+                {
+                    do { n++; e = e->next; } while(e!=NULL && e!=faces[f]->edge);
+                }
+                most = qMax(most, n);
+            }
+            return most;
+        },
+        [](long a, long b) { return qMax(a, b); });
+    const bool byteCounts = maxCorners <= 255;
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Unable to write PLY:" << file.errorString();
+        return false;
+    }
+    QByteArray header;
+    header += "ply\nformat binary_little_endian 1.0\ncomment OBJViewerQt\n";
+    header += "element vertex " + QByteArray::number((qlonglong)vertexCount) + "\n";
+    header += "property float x\nproperty float y\nproperty float z\n";
+    header += "property float nx\nproperty float ny\nproperty float nz\n";
+    header += "element face " + QByteArray::number((qlonglong)faceCount) + "\n";
+    header += byteCounts ? "property list uchar int vertex_indices\n" : "property list int int vertex_indices\n";
+    header += "end_header\n";
+    bool ok = file.write(header) == header.size();
+
+    //Undo the handedness flip of the positions so the file reads back to this mesh
+    ok = ok && writeChunks(&file, vertexCount, 65536, [&](long from, long to, std::string& out) {
+        out.reserve((size_t)(to-from)*24);
+        for(long i=from; i<to; i++)
+        {
+            const PolygonMesh::HE_vert* v = verts[i];
+            const PolygonMesh::Normal* n = v->normal;
+            appendFloat(out, -v->x);
+            appendFloat(out, v->y);
+            appendFloat(out, v->z);
+            appendFloat(out, n ? n->x : 0.0f);
+            appendFloat(out, n ? n->y : 0.0f);
+            appendFloat(out, n ? n->z : 0.0f);
+        }
+    });
+    ok = ok && writeChunks(&file, faceCount, 65536, [&](long from, long to, std::string& out) {
+        out.reserve((size_t)(to-from)*17);
+        std::vector<qint32> loop;
+        for(long f=from; f<to; f++)
+        {
+            loop.clear();
+            PolygonMesh::HE_edge* e = faces[f]->edge;
+            if(e!=NULL)
+            {
+                do { loop.push_back((qint32)(e->vert->index - 1)); e = e->next; }
+                while(e!=NULL && e!=faces[f]->edge);
+            }
+            if(byteCounts)
+                out.push_back((char)(uchar)loop.size());
+            else
+                appendInt(out, (qint32)loop.size());
+            for(size_t k=0; k<loop.size(); k++)
+                appendInt(out, loop[k]);
+        }
+    });
+    file.close();
+    if(ok)
+        qDebug() << "Wrote" << fileName << "," << QFileInfo(fileName).size() << "bytes in"
+                 << timer.elapsed() << "ms";
+    else
+        qWarning() << "Unable to write PLY:" << file.errorString();
+    return ok;
+}
+
+bool MeshFileIO::writeStl(const PolygonMesh* mesh, QString fileName)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const MeshBuffers* buffers = mesh->renderBuffers();
+    const long triangles = (long)buffers->triangles.size() / 3;
+    const std::vector<PolygonMesh::HE_vert*>& verts = *mesh->vertVector;
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Unable to write STL:" << file.errorString();
+        return false;
+    }
+    std::string header(80, ' ');
+    const char title[] = "binary STL written by OBJViewerQt";
+    memcpy(&header[0], title, sizeof(title)-1);
+    appendInt(header, (qint32)triangles);
+    bool ok = file.write(header.data(), (qint64)header.size()) == (qint64)header.size();
+
+    ok = ok && writeChunks(&file, triangles, 65536, [&](long from, long to, std::string& out) {
+        out.reserve((size_t)(to-from)*50);
+        for(long t=from; t<to; t++)
+        {
+            //Corners in file coordinates, i.e. with x flipped back
+            float p[9];
+            for(int c=0; c<3; c++)
+            {
+                const PolygonMesh::HE_vert* v = verts[buffers->triangles[t*3+c]];
+                p[c*3] = -v->x;
+                p[c*3+1] = v->y;
+                p[c*3+2] = v->z;
+            }
+            const float u[3] = {p[3]-p[0], p[4]-p[1], p[5]-p[2]};
+            const float w[3] = {p[6]-p[0], p[7]-p[1], p[8]-p[2]};
+            float n[3] = {u[1]*w[2]-u[2]*w[1], u[2]*w[0]-u[0]*w[2], u[0]*w[1]-u[1]*w[0]};
+            const float length = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+            for(int a=0; a<3; a++)
+                appendFloat(out, length>0.0f ? n[a]/length : 0.0f);
+            for(int c=0; c<9; c++)
+                appendFloat(out, p[c]);
+            out.append(2, '\0');
+        }
+    });
+    file.close();
+    if(ok)
+        qDebug() << "Wrote" << fileName << "," << QFileInfo(fileName).size() << "bytes in"
+                 << timer.elapsed() << "ms";
+    else
+        qWarning() << "Unable to write STL:" << file.errorString();
+    return ok;
+}
+
+bool MeshFileIO::writeObj(const PolygonMesh* mesh, QString fileName)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const std::vector<PolygonMesh::HE_vert*>& verts = *mesh->vertVector;
+    const std::vector<PolygonMesh::HE_face*>& faces = *mesh->faceVector;
+    const long vertexCount = (long)verts.size();
+    const long faceCount = (long)faces.size();
+    const long missingNormals = parallelReduce(0, vertexCount, 65536, 0L,
+        [&](long from, long to) {
+            long missing = 0;
+            for(long i=from; i<to; i++)
+                if(verts[i]->normal==NULL)
+                    missing++;
+            return missing;
+        },
+        [](long a, long b) { return a + b; });
+    //Normal i belongs to vertex i, so faces refer to both with one index
+    const bool normals = missingNormals==0;
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Unable to write OBJ:" << file.errorString();
+        return false;
+    }
+    std::string header = "# OBJViewerQt\n# ";
+    appendText(header, vertexCount);
+    header += " vertices, ";
+    appendText(header, faceCount);
+    header += " faces\n";
+    bool ok = file.write(header.data(), (qint64)header.size()) == (qint64)header.size();
+
+    //The parser flips x on load, so it is flipped back here
+    ok = ok && writeChunks(&file, vertexCount, 65536, [&](long from, long to, std::string& out) {
+        out.reserve((size_t)(to-from)*40);
+        for(long i=from; i<to; i++)
+        {
+            out.append("v ", 2);
+            appendText(out, -verts[i]->x);
+            out.push_back(' ');
+            appendText(out, verts[i]->y);
+            out.push_back(' ');
+            appendText(out, verts[i]->z);
+            out.push_back('\n');
+        }
+    });
+    if(normals)
+    {
+        ok = ok && writeChunks(&file, vertexCount, 65536, [&](long from, long to, std::string& out) {
+            out.reserve((size_t)(to-from)*40);
+            for(long i=from; i<to; i++)
+            {
+                const PolygonMesh::Normal* n = verts[i]->normal;
+                out.append("vn ", 3);
+                appendText(out, n->x);
+                out.push_back(' ');
+                appendText(out, n->y);
+                out.push_back(' ');
+                appendText(out, n->z);
+                out.push_back('\n');
+            }
+        });
+    }
+    ok = ok && writeChunks(&file, faceCount, 65536, [&](long from, long to, std::string& out) {
+        out.reserve((size_t)(to-from)*36);
+        for(long f=from; f<to; f++)
+        {
+            out.push_back('f');
+            PolygonMesh::HE_edge* e = faces[f]->edge;
+            if(e!=NULL)
+            {
+                do {
+                    out.push_back(' ');
+                    appendText(out, e->vert->index);
+                    if(normals)
+                    {
+                        out.append("//", 2);
+                        appendText(out, e->vert->index);
+                    }
+                    e = e->next;
+                } while(e!=NULL && e!=faces[f]->edge);
+            }
+            out.push_back('\n');
+        }
+    });
+    file.close();
+    if(ok)
+        qDebug() << "Wrote" << fileName << "," << QFileInfo(fileName).size() << "bytes in"
+                 << timer.elapsed() << "ms";
+    else
+        qWarning() << "Unable to write OBJ:" << file.errorString();
+    return ok;
+}
+
+bool MeshFileIO::compareWithLoader(const PolygonMesh* mesh, QString objFile)
+{
+    OBJFileParser parser;
+    PolygonMesh* loaded = parser.parseFile(objFile);
+    if(loaded==NULL)
+    {
+        qWarning() << "Round trip: unable to read" << objFile;
+        return false;
+    }
+    const std::vector<PolygonMesh::HE_vert*>& verts = *mesh->vertVector;
+    const std::vector<PolygonMesh::HE_face*>& faces = *mesh->faceVector;
+    const std::vector<PolygonMesh::HE_vert*>& loadedVerts = *loaded->vertVector;
+    const std::vector<PolygonMesh::HE_face*>& loadedFaces = *loaded->faceVector;
+    if(loadedVerts.size()!=verts.size() || loadedFaces.size()!=faces.size())
+    {
+        qWarning() << "Round trip: read" << (qulonglong)loadedVerts.size() << "vertices and"
+                   << (qulonglong)loadedFaces.size() << "faces instead of" << (qulonglong)verts.size()
+                   << "and" << (qulonglong)faces.size();
+        delete loaded;
+        return false;
+    }
+
+    //The parser only keeps file normals when every vertex is used by a face
+    const long isolated = parallelReduce(0, (long)verts.size(), 65536, 0L,
+        [&](long from, long to) {
+            long count = 0;
+            for(long i=from; i<to; i++)
+                if(verts[i]->edge==NULL || verts[i]->normal==NULL)
+                    count++;
+            return count;
+        },
+        [](long a, long b) { return a + b; });
+    const bool normals = isolated==0;
+
+    const long vertexMismatch = parallelReduce(0, (long)verts.size(), 65536, -1L,
+        [&](long from, long to) {
+            for(long i=from; i<to; i++)
+            {
+                const PolygonMesh::HE_vert* a = verts[i];
+                const PolygonMesh::HE_vert* b = loadedVerts[i];
+                if(a->x!=b->x || a->y!=b->y || a->z!=b->z)
+                    return i;
+                if(normals && (b->normal==NULL || a->normal->x!=b->normal->x ||
+                               a->normal->y!=b->normal->y || a->normal->z!=b->normal->z))
+                    return i;
+            }
+            return -1L;
+        },
+        [](long a, long b) { return a>=0 ? a : b; });
+    const long faceMismatch = parallelReduce(0, (long)faces.size(), 16384, -1L,
+        [&](long from, long to) {
+            for(long f=from; f<to; f++)
+            {
+                const PolygonMesh::HE_edge* a = faces[f]->edge;
+                const PolygonMesh::HE_edge* b = loadedFaces[f]->edge;
+                do {
+                    if(a==NULL || b==NULL || a->vert->index!=b->vert->index)
+                        return f;
+                    a = a->next;
+                    b = b->next;
+                } while(a!=faces[f]->edge && b!=loadedFaces[f]->edge);
+                //Both loops have to close at the same corner
+                if(a!=faces[f]->edge || b!=loadedFaces[f]->edge)
+                    return f;
+            }
+            return -1L;
+        },
+        [](long a, long b) { return a>=0 ? a : b; });
+    delete loaded;
+
+    if(vertexMismatch>=0)
+        qWarning() << "Round trip: vertex" << vertexMismatch+1 << "differs in" << objFile;
+    if(faceMismatch>=0)
+        qWarning() << "Round trip: face" << faceMismatch+1 << "differs in" << objFile;
+    if(vertexMismatch<0 && faceMismatch<0)
+        qDebug() << "Round trip of" << objFile << "is identical"
+                 << (normals ? "including normals" : "(normals recomputed by the parser)");
+    return vertexMismatch<0 && faceMismatch<0;
+}
+
+bool MeshFileIO::write(const PolygonMesh* mesh, QString fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    if(suffix=="obj")
+        return writeObj(mesh, fileName);
+    if(suffix=="ply")
+        return writePly(mesh, fileName);
+    if(suffix=="stl")
+        return writeStl(mesh, fileName);
+    qWarning() << "Unknown mesh format:" << fileName;
+    return false;
+}
+
+bool MeshFileIO::compareWithObj(QString objFile, QString outputFile)
+{
+    QElapsedTimer timer;
+    QJsonObject result;
+    result["model"] = QFileInfo(objFile).absoluteFilePath();
+    result["threads"] = parallelThreadCount();
+
+    timer.start();
+    OBJFileParser parser;
+    PolygonMesh* mesh = parser.parseFile(objFile);
+    double objMs = timer.nsecsElapsed() / 1.0e6;
+    if(mesh==NULL)
+        return false;
+    result["vertices"] = (qint64)mesh->vertVector->size();
+    result["faces"] = (qint64)mesh->faceVector->size();
+
+    QJsonObject obj;
+    obj["bytes"] = QFileInfo(objFile).size();
+    obj["load_ms"] = objMs;
+    obj["load_mb_per_s"] = QFileInfo(objFile).size() / 1.0e3 / qMax(objMs, 1e-3);
+
+    QFileInfo output(outputFile);
+    QString base = output.dir().filePath(QFileInfo(objFile).completeBaseName());
+    //A new name, so the model itself is never overwritten
+    QString writtenObj = base + "_written.obj";
+    timer.restart();
+    if(!writeObj(mesh, writtenObj))
+    {
+        delete mesh;
+        return false;
+    }
+    double objWriteMs = timer.nsecsElapsed() / 1.0e6;
+    obj["written_file"] = QFileInfo(writtenObj).absoluteFilePath();
+    obj["written_bytes"] = QFileInfo(writtenObj).size();
+    obj["write_ms"] = objWriteMs;
+    obj["write_mb_per_s"] = QFileInfo(writtenObj).size() / 1.0e3 / qMax(objWriteMs, 1e-3);
+    obj["round_trip_identical"] = compareWithLoader(mesh, writtenObj);
+    result["obj"] = obj;
+#ifdef HAVE_ZLIB
+    //The written OBJ loaded plain and gzip-compressed, to price the decompression
+    QString gzObj = writtenObj + ".gz";
+    if(gzipFile(writtenObj, gzObj))
+    {
+        timer.restart();
+        OBJFileParser plainParser;
+        PolygonMesh* plain = plainParser.parseFile(writtenObj);
+        double plainMs = timer.nsecsElapsed() / 1.0e6;
+        timer.restart();
+        OBJFileParser gzParser;
+        PolygonMesh* unpacked = gzParser.parseFile(gzObj);
+        double gzMs = timer.nsecsElapsed() / 1.0e6;
+        if(plain!=NULL && unpacked!=NULL)
+        {
+            const qint64 plainBytes = QFileInfo(writtenObj).size();
+            const qint64 gzBytes = QFileInfo(gzObj).size();
+            QJsonObject gz;
+            gz["file"] = QFileInfo(gzObj).absoluteFilePath();
+            gz["bytes"] = gzBytes;
+            gz["compression_ratio"] = plainBytes / (double)qMax(gzBytes, (qint64)1);
+            gz["plain_load_ms"] = plainMs;
+            gz["load_ms"] = gzMs;
+            //Throughput in uncompressed OBJ text, comparable with the plain load
+            gz["load_mb_per_s"] = plainBytes / 1.0e3 / qMax(gzMs, 1e-3);
+            gz["slowdown_over_plain"] = gzMs / qMax(plainMs, 1e-3);
+            result["gzip"] = gz;
+            qDebug() << "gzip:" << gzBytes << "bytes, loaded in" << gzMs
+                     << "ms against" << plainMs << "ms uncompressed";
+        }
+        delete plain;
+        delete unpacked;
+    }
+#endif
+    const char* formats[2] = {"ply", "stl"};
+    bool ok = true;
+    for(int i=0; i<2 && ok; i++)
+    {
+        QString file = base + "." + formats[i];
+        timer.restart();
+        ok = write(mesh, file);
+        double writeMs = timer.nsecsElapsed() / 1.0e6;
+
+        timer.restart();
+        MeshFileIO reader;
+        PolygonMesh* loaded = ok ? reader.read(file) : NULL;
+        double readMs = timer.nsecsElapsed() / 1.0e6;
+        ok = loaded!=NULL;
+        if(!ok)
+            break;
+
+        QJsonObject entry;
+        entry["file"] = QFileInfo(file).absoluteFilePath();
+        entry["bytes"] = QFileInfo(file).size();
+        entry["write_ms"] = writeMs;
+        entry["load_ms"] = readMs;
+        entry["load_mb_per_s"] = QFileInfo(file).size() / 1.0e3 / qMax(readMs, 1e-3);
+        entry["speedup_over_obj"] = objMs / qMax(readMs, 1e-3);
+        entry["vertices"] = (qint64)loaded->vertVector->size();
+        entry["faces"] = (qint64)loaded->faceVector->size();
+        result[formats[i]] = entry;
+        qDebug() << formats[i] << ":" << QFileInfo(file).size() << "bytes, loaded in" << readMs
+                 << "ms against" << objMs << "ms for OBJ";
+        delete loaded;
+    }
+    delete mesh;
+    if(!ok)
+        return false;
+
+    QFile file(outputFile);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qCritical() << "Unable to write benchmark results:" << file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(result).toJson(QJsonDocument::Indented));
+    file.close();
+    qDebug() << "Mesh I/O benchmark written to" << outputFile;
+    return true;
+}
@@ -0,0 +1,96 @@
+#ifndef MESHFILEIO_H
+#define MESHFILEIO_H
+
+#include <QString>
+#include <QIODevice>
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "trianglemesh.h"
+
+/**
+ * Mesh files next to the OBJ parser: reads and writes little- or big-endian
+ * binary PLY and binary STL, and writes OBJ.
+ *
+ * Readers map the file and copy the vertex and face arrays out of it in
+ * parallel, then build the half-edge mesh with MeshBuilder, so the result
+ * matches what the OBJ parser produces for the same geometry (including
+ * its handedness flip of x; normals are taken as they are). STL stores
+ * every triangle corner separately; identical positions are merged so the
+ * triangles connect. Writers stream the mesh in chunks that are formatted
+ * in parallel and undo the flip, so a written file reads back to the same
+ * mesh.
+ */
+class MeshFileIO
+{
+public:
+    enum Format {
+        OBJ,
+        PLY,
+        STL
+    };
+
+    explicit MeshFileIO();
+
+    //By magic bytes, then by extension; anything unknown is treated as OBJ
+    static Format detect(QString fileName);
+
+    //Merge vertices closer than epsilon before building edges; 0 disables
+    void setWeldEpsilon(float epsilon);
+    long weldedVertexCount() const;
+
+    //PLY or STL; NULL with error() set if the file cannot be read
+    PolygonMesh* read(QString fileName);
+    QString error() const;
+
+    static bool writePly(const PolygonMesh* mesh, QString fileName);
+    static bool writeStl(const PolygonMesh* mesh, QString fileName);
+    //v, vn and f v//vn records with the shortest floats that read back exactly
+    static bool writeObj(const PolygonMesh* mesh, QString fileName);
+    //Picks the writer by extension
+    static bool write(const PolygonMesh* mesh, QString fileName);
+
+    /**
+     * @brief compareWithLoader
+     * Reads objFile back with OBJFileParser and checks that positions,
+     * vertex normals and face loops are identical to mesh.
+     * @return false at the first difference, which is logged
+     */
+    static bool compareWithLoader(const PolygonMesh* mesh, QString objFile);
+
+    /**
+     * @brief compareWithObj
+     * Loads objFile, writes it as PLY and STL next to outputFile, reads both
+     * back and writes the sizes, load times and throughput of all three to
+     * the JSON outputFile. Also times writeObj and checks its round trip,
+     * and with zlib times loading the written OBJ plain and gzip-compressed.
+     * @return false if a file could not be read or written
+     */
+    static bool compareWithObj(QString objFile, QString outputFile);
+
+    /**
+     * @brief writeChunks
+     * Formats count items in chunks of grain with format(from, to, out) on
+     * all cores and writes the chunks in order, a few at a time, so the
+     * output is never held in memory as a whole.
+     */
+    static bool writeChunks(QIODevice* device, long count, long grain,
+                            const std::function<void(long,long,std::string&)>& format);
+
+private:
+    bool readPly(const uchar* data, qint64 size);
+    bool readStl(const uchar* data, qint64 size);
+    bool fail(QString error);
+    void weld();
+
+    std::vector<float> mPositions;
+    std::vector<float> mNormals;
+    std::vector<unsigned int> mFaceOffsets;
+    std::vector<unsigned int> mFaceIndices;
+    float mWeldEpsilon;
+    long mWelded;
+    QString mError;
+};
+
+#endif // MESHFILEIO_H
@@ -0,0 +1,144 @@
+#include "meshlod.h"
+#include "parallel.h"
+#include "meshbuffers.h"
+
+#include <algorithm>
+#include <cmath>
+
+std::vector<LodLevel*> MeshLod::buildChain(const PolygonMesh* mesh,
+                                           int maxLevels,
+                                           long minTriangles,
+                                           const CancellationToken* token)
+{
+    std::vector<LodLevel*> chain;
+    LodLevel* base = baseLevel(mesh);
+    const long vertexCount = (long)base->positions.size() / 3;
+
+    //Surface meshes put roughly resolution^2 vertices on the grid
+    int resolution = (int)(sqrt((double)vertexCount) / 2.0);
+    while((int)chain.size() < maxLevels && resolution >= 8)
+    {
+        if(token!=NULL && token->isCancelled())
+            break;
+        LodLevel* level = clusterLevel(*base, resolution);
+        const long finer = chain.empty() ? base->triangleCount()
+                                         : chain.back()->triangleCount();
+        if(level->triangleCount() >= finer || level->triangleCount() == 0)
+        {
+            delete level;
+            break;
+        }
+        chain.push_back(level);
+        if(level->triangleCount() < minTriangles)
+            break;
+        resolution /= 2;
+    }
+
+    delete base;
+    return chain;
+}
+
+//Triangulated copy of the mesh with its vertex normals
+LodLevel* MeshLod::baseLevel(const PolygonMesh* mesh)
+{
+    LodLevel* level = new LodLevel();
+    const long vertexCount = (long)mesh->vertVector->size();
+    level->positions.resize(vertexCount*3);
+    level->normals.resize(vertexCount*3);
+    parallelFor(0, vertexCount, 8192, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            PolygonMesh::HE_vert* v = mesh->vertVector->at(i);
+            level->positions[i*3] = v->x;
+            level->positions[i*3+1] = v->y;
+            level->positions[i*3+2] = v->z;
+            PolygonMesh::Normal* n = v->normal;
+            level->normals[i*3] = n ? n->x : 0.0f;
+            level->normals[i*3+1] = n ? n->y : 0.0f;
+            level->normals[i*3+2] = n ? n->z : 1.0f;
+        }
+    });
+
+    //The mesh's cached ear-clipped triangles
+    level->triangles = mesh->renderBuffers()->triangles;
+    return level;
+}
+
+/**
+ * @brief clusterLevel
+ * Merges all vertices in the same grid cell into their mean position and
+ * drops triangles that collapse. Normals of merged vertices are averaged.
+ */
+LodLevel* MeshLod::clusterLevel(const LodLevel& base, int resolution)
+{
+    const long vertexCount = (long)base.positions.size() / 3;
+    float lo[3] = {0,0,0}, hi[3] = {0,0,0};
+    for(long i=0; i<vertexCount; i++)
+    {
+        for(int a=0; a<3; a++)
+        {
+            float p = base.positions[i*3+a];
+            if(i==0 || p<lo[a]) lo[a] = p;
+            if(i==0 || p>hi[a]) hi[a] = p;
+        }
+    }
+    float extent = qMax(hi[0]-lo[0], qMax(hi[1]-lo[1], hi[2]-lo[2]));
+    float cell = (extent > 0.0f ? extent : 1.0f) / resolution;
+
+    //Sort vertices by cell so each cluster is a contiguous run
+    std::vector<std::pair<quint64,unsigned int> > keyed(vertexCount);
+    parallelFor(0, vertexCount, 8192, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            quint64 key = 0;
+            for(int a=0; a<3; a++)
+            {
+                quint64 c = (quint64)qBound(0, (int)((base.positions[i*3+a]-lo[a]) / cell), resolution);
+                key = key * (quint64)(resolution+1) + c;
+            }
+            keyed[i] = std::make_pair(key, (unsigned int)i);
+        }
+    });
+    std::sort(keyed.begin(), keyed.end());
+
+    LodLevel* level = new LodLevel();
+    std::vector<unsigned int> remap(vertexCount);
+    size_t run = 0;
+    while(run < keyed.size())
+    {
+        size_t end = run;
+        float p[3] = {0,0,0}, n[3] = {0,0,0};
+        while(end < keyed.size() && keyed[end].first == keyed[run].first)
+        {
+            unsigned int v = keyed[end].second;
+            for(int a=0; a<3; a++)
+            {
+                p[a] += base.positions[v*3+a];
+                n[a] += base.normals[v*3+a];
+            }
+            remap[v] = (unsigned int)(level->positions.size() / 3);
+            end++;
+        }
+        float count = (float)(end - run);
+        float len = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        for(int a=0; a<3; a++)
+        {
+            level->positions.push_back(p[a] / count);
+            level->normals.push_back(len > 0.0f ? n[a] / len : 0.0f);
+        }
+        run = end;
+    }
+
+    for(size_t t=0; t+2<base.triangles.size(); t+=3)
+    {
+        unsigned int a = remap[base.triangles[t]];
+        unsigned int b = remap[base.triangles[t+1]];
+        unsigned int c = remap[base.triangles[t+2]];
+        if(a==b || b==c || a==c)
+            continue;
+        level->triangles.push_back(a);
+        level->triangles.push_back(b);
+        level->triangles.push_back(c);
+    }
+    return level;
+}
@@ -0,0 +1,42 @@
+#ifndef MESHLOD_H
+#define MESHLOD_H
+
+#include <vector>
+
+#include "trianglemesh.h"
+#include "parallel.h"
+
+/**
+ * One simplified, render-only version of a mesh: indexed triangles with
+ * per-vertex normals, drawn with client-side arrays.
+ */
+struct LodLevel {
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<unsigned int> triangles;
+    long triangleCount() const { return (long)triangles.size() / 3; }
+};
+
+class MeshLod
+{
+public:
+    /**
+     * @brief buildChain
+     * Builds progressively coarser levels by vertex clustering on a uniform
+     * grid, each with about a quarter of the previous level's vertices.
+     * The full-resolution mesh itself is not part of the chain.
+     * Safe to call from a worker thread; the mesh is only read. Stops
+     * adding levels once token is cancelled.
+     */
+    static std::vector<LodLevel*> buildChain(const PolygonMesh* mesh,
+                                             int maxLevels = 5,
+                                             long minTriangles = 1000,
+                                             const CancellationToken* token = NULL);
+    //Triangulated copy of the full mesh with its vertex normals
+    static LodLevel* baseLevel(const PolygonMesh* mesh);
+
+private:
+    static LodLevel* clusterLevel(const LodLevel& base, int resolution);
+};
+
+#endif // MESHLOD_H
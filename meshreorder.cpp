@@ -0,0 +1,441 @@
+#include "meshreorder.h"
+#include "parallel.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+
+namespace {
+
+const int kHilbertBits = 10;
+const int kTipsifyCache = 16;
+
+//Skilling, "Programming the Hilbert curve" (2004): axes to transposed index
+quint64 hilbertKey(unsigned int x, unsigned int y, unsigned int z)
+{
+    unsigned int X[3] = {x, y, z};
+    const unsigned int M = 1u << (kHilbertBits-1);
+    for(unsigned int Q=M; Q>1; Q>>=1)
+    {
+        const unsigned int P = Q-1;
+        for(int i=0; i<3; i++)
+        {
+            if(X[i] & Q)
+                X[0] ^= P;
+            else
+            {
+                unsigned int t = (X[0]^X[i]) & P;
+                X[0] ^= t;
+                X[i] ^= t;
+            }
+        }
+    }
+    for(int i=1; i<3; i++)
+        X[i] ^= X[i-1];
+    unsigned int t = 0;
+    for(unsigned int Q=M; Q>1; Q>>=1)
+    {
+        if(X[2] & Q)
+            t ^= Q-1;
+    }
+    for(int i=0; i<3; i++)
+        X[i] ^= t;
+
+    quint64 key = 0;
+    for(int b=kHilbertBits-1; b>=0; b--)
+    {
+        for(int i=0; i<3; i++)
+            key = (key << 1) | ((X[i] >> b) & 1u);
+    }
+    return key;
+}
+
+}
+
+MeshReorder::Stats MeshReorder::optimize(PolygonMesh* mesh)
+{
+    Stats stats;
+    stats.traversalMsBefore = traversalTime(mesh);
+    stats.acmrBefore = acmr(mesh);
+
+    QElapsedTimer timer;
+    timer.start();
+    const long vertexCount = (long)mesh->vertVector->size();
+    const long faceCount = (long)mesh->faceVector->size();
+
+    std::vector<long> vertOrder = hilbertOrder(mesh);
+    std::vector<long> rank(vertexCount);
+    for(long i=0; i<vertexCount; i++)
+        rank[vertOrder[i]] = i;
+
+    //Face loops in the new vertex numbering
+    std::vector<long> faceOffsets(faceCount+1, 0);
+    std::vector<long> faceVerts;
+    faceVerts.reserve(faceCount*3);
+    for(long f=0; f<faceCount; f++)
+    {
+        PolygonMesh::HE_edge* first = mesh->faceVector->at(f)->edge;
+        PolygonMesh::HE_edge* e = first;
+        if(e!=NULL)
+        {
+            do {
+                faceVerts.push_back(rank[e->vert->index-1]);
+                e = e->next;
+            } while(e!=NULL && e!=first);
+        }
+        faceOffsets[f+1] = (long)faceVerts.size();
+    }
+
+    std::vector<long> faceOrder = tipsify(faceOffsets, faceVerts, vertexCount, kTipsifyCache);
+    relocate(mesh, vertOrder, faceOrder);
+    stats.reorderMs = timer.nsecsElapsed() / 1.0e6;
+
+    stats.traversalMsAfter = traversalTime(mesh);
+    stats.acmrAfter = acmr(mesh);
+    qDebug() << "Reordered in" << stats.reorderMs << "ms; traversal"
+             << stats.traversalMsBefore << "->" << stats.traversalMsAfter << "ms, ACMR"
+             << stats.acmrBefore << "->" << stats.acmrAfter;
+    return stats;
+}
+
+std::vector<long> MeshReorder::hilbertOrder(const PolygonMesh* mesh)
+{
+    const long vertexCount = (long)mesh->vertVector->size();
+    float lo[3] = {0,0,0}, hi[3] = {0,0,0};
+    for(long i=0; i<vertexCount; i++)
+    {
+        PolygonMesh::HE_vert* v = mesh->vertVector->at(i);
+        const float p[3] = {v->x, v->y, v->z};
+        for(int a=0; a<3; a++)
+        {
+            if(i==0 || p[a]<lo[a]) lo[a] = p[a];
+            if(i==0 || p[a]>hi[a]) hi[a] = p[a];
+        }
+    }
+    float scale[3];
+    for(int a=0; a<3; a++)
+        scale[a] = hi[a]>lo[a] ? ((1<<kHilbertBits)-1) / (hi[a]-lo[a]) : 0.0f;
+    const int maxCell = (1<<kHilbertBits)-1;
+
+    std::vector<std::pair<quint64,long> > keyed(vertexCount);
+    parallelFor(0, vertexCount, 8192, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            PolygonMesh::HE_vert* v = mesh->vertVector->at(i);
+            unsigned int x = (unsigned int)qBound(0, (int)((v->x-lo[0])*scale[0]), maxCell);
+            unsigned int y = (unsigned int)qBound(0, (int)((v->y-lo[1])*scale[1]), maxCell);
+            unsigned int z = (unsigned int)qBound(0, (int)((v->z-lo[2])*scale[2]), maxCell);
+            keyed[i] = std::make_pair(hilbertKey(x,y,z), i);
+        }
+    });
+    std::sort(keyed.begin(), keyed.end());
+
+    std::vector<long> order(vertexCount);
+    for(long i=0; i<vertexCount; i++)
+        order[i] = keyed[i].second;
+    return order;
+}
+
+/**
+ * @brief tipsify
+ * Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality
+ * and Reduced Overdraw" (2007). Fans around one vertex at a time, moving on
+ * to the neighbour most likely to still be in the cache. Dead ends fall
+ * back to recently used vertices, then to the next vertex in memory order.
+ * Works on polygons as well as triangles.
+ */
+std::vector<long> MeshReorder::tipsify(const std::vector<long>& faceOffsets,
+                                       const std::vector<long>& faceVerts,
+                                       long vertexCount, int cacheSize)
+{
+    const long faceCount = (long)faceOffsets.size() - 1;
+
+    //Vertex to face adjacency
+    std::vector<long> adjOffsets(vertexCount+1, 0);
+    for(size_t k=0; k<faceVerts.size(); k++)
+        adjOffsets[faceVerts[k]+1]++;
+    for(long v=0; v<vertexCount; v++)
+        adjOffsets[v+1] += adjOffsets[v];
+    std::vector<long> adjFaces(faceVerts.size());
+    std::vector<long> fill(adjOffsets.begin(), adjOffsets.end()-1);
+    for(long f=0; f<faceCount; f++)
+    {
+        for(long k=faceOffsets[f]; k<faceOffsets[f+1]; k++)
+            adjFaces[fill[faceVerts[k]]++] = f;
+    }
+
+    std::vector<long> live(vertexCount);
+    for(long v=0; v<vertexCount; v++)
+        live[v] = adjOffsets[v+1] - adjOffsets[v];
+    std::vector<long> cacheTime(vertexCount, 0);
+    std::vector<char> emitted(faceCount, 0);
+    std::vector<long> deadEnd;
+    std::vector<long> candidates;
+    std::vector<long> order;
+    order.reserve(faceCount);
+
+    long time = cacheSize + 1;
+    long cursor = 0;
+    long fan = vertexCount > 0 ? 0 : -1;
+    while(fan >= 0)
+    {
+        candidates.clear();
+        for(long a=adjOffsets[fan]; a<adjOffsets[fan+1]; a++)
+        {
+            const long f = adjFaces[a];
+            if(emitted[f])
+                continue;
+            emitted[f] = 1;
+            order.push_back(f);
+            for(long k=faceOffsets[f]; k<faceOffsets[f+1]; k++)
+            {
+                const long v = faceVerts[k];
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if(time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+        }
+
+        //Prefer the candidate that stays in the cache the longest
+        long next = -1;
+        long best = 0;
+        for(size_t c=0; c<candidates.size(); c++)
+        {
+            const long v = candidates[c];
+            if(live[v] <= 0)
+                continue;
+            long priority = 0;
+            if(time - cacheTime[v] + 2*live[v] <= cacheSize)
+                priority = time - cacheTime[v];
+            if(priority > best)
+            {
+                best = priority;
+                next = v;
+            }
+        }
+
+        while(next < 0 && !deadEnd.empty())
+        {
+            const long v = deadEnd.back();
+            deadEnd.pop_back();
+            if(live[v] > 0)
+                next = v;
+        }
+        while(next < 0 && cursor < vertexCount)
+        {
+            if(live[cursor] > 0)
+                next = cursor;
+            cursor++;
+        }
+        fan = next;
+    }
+
+    //Faces without vertices keep their relative order at the end
+    for(long f=0; f<faceCount; f++)
+    {
+        if(!emitted[f])
+            order.push_back(f);
+    }
+    return order;
+}
+
+/**
+ * @brief relocate
+ * Copies the vertex, face and half-edge nodes into pools in the given
+ * order and remaps every pointer. While copying, the old nodes' index
+ * fields hold their slot in the new pool.
+ */
+void MeshReorder::relocate(PolygonMesh* mesh,
+                           const std::vector<long>& vertOrder,
+                           const std::vector<long>& faceOrder)
+{
+    const long vertexCount = (long)vertOrder.size();
+    const long faceCount = (long)faceOrder.size();
+
+    //Remember which copied edge entries were stored, by their original node
+    std::vector<PolygonMesh::HE_edge*> listed;
+    listed.reserve(mesh->edgeVector->size());
+    for(size_t k=0; k<mesh->edgeVector->size(); k++)
+    {
+        PolygonMesh::HE_edge& copy = mesh->edgeVector->at(k);
+        if(copy.next!=NULL)
+            listed.push_back(copy.next->prev);
+    }
+
+    std::vector<PolygonMesh::HE_vert*> oldVerts(vertexCount);
+    for(long i=0; i<vertexCount; i++)
+    {
+        oldVerts[i] = mesh->vertVector->at(vertOrder[i]);
+        oldVerts[i]->index = i;
+    }
+    std::vector<PolygonMesh::HE_face*> oldFaces(faceCount);
+    std::vector<PolygonMesh::HE_edge*> oldEdges;
+    oldEdges.reserve(mesh->edgeVector->size());
+    for(long i=0; i<faceCount; i++)
+    {
+        PolygonMesh::HE_face* face = mesh->faceVector->at(faceOrder[i]);
+        oldFaces[i] = face;
+        face->index = i;
+        PolygonMesh::HE_edge* e = face->edge;
+        if(e==NULL)
+            continue;
+        do {
+            e->index = (long)oldEdges.size();
+            oldEdges.push_back(e);
+            e = e->next;
+        } while(e!=NULL && e!=face->edge);
+    }
+    const long edgeCount = (long)oldEdges.size();
+
+    PolygonMesh::HE_vert* verts = new PolygonMesh::HE_vert[vertexCount];
+    PolygonMesh::HE_face* faces = new PolygonMesh::HE_face[faceCount];
+    PolygonMesh::HE_edge* edges = new PolygonMesh::HE_edge[edgeCount];
+
+    parallelFor(0, vertexCount, 8192, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            const PolygonMesh::HE_vert* v = oldVerts[i];
+            verts[i] = *v;
+            verts[i].index = i+1;
+            verts[i].edge = v->edge ? &edges[v->edge->index] : NULL;
+        }
+    });
+    parallelFor(0, faceCount, 8192, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            const PolygonMesh::HE_face* f = oldFaces[i];
+            faces[i] = *f;
+            faces[i].index = i+1;
+            faces[i].edge = f->edge ? &edges[f->edge->index] : NULL;
+        }
+    });
+    parallelFor(0, edgeCount, 8192, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            const PolygonMesh::HE_edge* e = oldEdges[i];
+            PolygonMesh::HE_edge& n = edges[i];
+            n.index = i+1;
+            n.vert = &verts[e->vert->index];
+            n.face = &faces[e->face->index];
+            n.pair = e->pair ? &edges[e->pair->index] : NULL;
+            n.prev = e->prev ? &edges[e->prev->index] : NULL;
+            n.next = e->next ? &edges[e->next->index] : NULL;
+        }
+    });
+
+    std::vector<long> listedSlots(listed.size());
+    for(size_t k=0; k<listed.size(); k++)
+        listedSlots[k] = listed[k]->index;
+    std::sort(listedSlots.begin(), listedSlots.end());
+    mesh->edgeVector->clear();
+    for(size_t k=0; k<listedSlots.size(); k++)
+        mesh->edgeVector->push_back(edges[listedSlots[k]]);
+
+    if(mesh->first_vertex!=NULL)
+        mesh->first_vertex = &verts[mesh->first_vertex->index];
+    for(long i=0; i<vertexCount; i++)
+        mesh->vertVector->at(i) = &verts[i];
+    for(long i=0; i<faceCount; i++)
+        mesh->faceVector->at(i) = &faces[i];
+
+    //Nodes of a mesh that was reordered before live in the old pools
+    if(mesh->vertPool!=NULL)
+    {
+        delete[] mesh->vertPool;
+        delete[] mesh->facePool;
+        delete[] mesh->edgePool;
+    }
+    else
+    {
+        for(long i=0; i<vertexCount; i++)
+            delete oldVerts[i];
+        for(long i=0; i<faceCount; i++)
+            delete oldFaces[i];
+        for(long i=0; i<edgeCount; i++)
+            delete oldEdges[i];
+    }
+    mesh->vertPool = verts;
+    mesh->facePool = faces;
+    mesh->edgePool = edges;
+    mesh->releaseRenderBuffers();
+}
+
+double MeshReorder::acmr(const PolygonMesh* mesh, int cacheSize)
+{
+    const long vertexCount = (long)mesh->vertVector->size();
+    std::vector<long> entered(vertexCount, -(long)cacheSize-1);
+    long misses = 0;
+    long triangles = 0;
+    std::vector<long> loop;
+    for(size_t f=0; f<mesh->faceVector->size(); f++)
+    {
+        PolygonMesh::HE_edge* first = mesh->faceVector->at(f)->edge;
+        PolygonMesh::HE_edge* e = first;
+        if(e==NULL)
+            continue;
+        loop.clear();
+        do { loop.push_back(e->vert->index-1); e = e->next; }
+        while(e!=NULL && e!=first);
+
+        for(size_t k=1; k+1<loop.size(); k++)
+        {
+            const long tri[3] = {loop[0], loop[k], loop[k+1]};
+            for(int c=0; c<3; c++)
+            {
+                //FIFO: a vertex stays cached for cacheSize further misses
+                if(misses - entered[tri[c]] >= cacheSize)
+                    entered[tri[c]] = misses++;
+            }
+            triangles++;
+        }
+    }
+    return triangles>0 ? (double)misses / (double)triangles : 0.0;
+}
+
+double MeshReorder::traversalTime(const PolygonMesh* mesh)
+{
+    const long vertexCount = (long)mesh->vertVector->size();
+    QElapsedTimer timer;
+    timer.start();
+
+    //One-ring walk: outgoing edge, then prev->pair to the next outgoing edge
+    double sum = 0.0;
+    for(long i=0; i<vertexCount; i++)
+    {
+        PolygonMesh::HE_vert* v = mesh->vertVector->at(i);
+        PolygonMesh::HE_edge* e = v->edge;
+        int steps = 0;
+        while(e!=NULL && steps<64)
+        {
+            sum += e->vert->x;
+            e = e->prev ? e->prev->pair : NULL;
+            if(e==v->edge)
+                break;
+            steps++;
+        }
+    }
+
+    std::vector<float> normals(vertexCount*3, 0.0f);
+    for(size_t f=0; f<mesh->faceVector->size(); f++)
+    {
+        PolygonMesh::HE_face* face = mesh->faceVector->at(f);
+        PolygonMesh::HE_edge* e = face->edge;
+        if(e==NULL || face->normal==NULL)
+            continue;
+        do {
+            float* n = &normals[(e->vert->index-1)*3];
+            n[0] += face->normal->x;
+            n[1] += face->normal->y;
+            n[2] += face->normal->z;
+            e = e->next;
+        } while(e!=NULL && e!=face->edge);
+    }
+    for(long i=0; i<vertexCount*3; i++)
+        sum += normals[i];
+
+    volatile double sink = sum;
+    Q_UNUSED(sink);
+    return timer.nsecsElapsed() / 1.0e6;
+}
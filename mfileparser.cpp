@@ -1,10 +1,46 @@
 #include "mfileparser.h"
+#include "parallel.h"
+#include "vertexwelder.h"
+#include "facetriangulator.h"
+#include "meshfileio.h"
+#include "compressedinput.h"
 #include <QString>
 
 static const bool showDebug = false;
 
 OBJFileParser::OBJFileParser()
-{}
+{
+    mWeldEpsilon = 0.0f;
+    mWelded = 0;
+}
+
+void OBJFileParser::setWeldEpsilon(float epsilon)
+{
+    mWeldEpsilon = epsilon;
+}
+
+long OBJFileParser::weldedVertexCount() const
+{
+    return mWelded;
+}
+
+void OBJFileParser::setCancellationToken(const CancellationToken& token)
+{
+    mToken = token;
+}
+
+QString OBJFileParser::error() const
+{
+    return mError;
+}
+
+//Records why parsing failed; the caller decides how to show it
+PolygonMesh* OBJFileParser::fail(QString error)
+{
+    mError = error;
+    qWarning() << "Cannot read mesh:" << error;
+    return NULL;
+}
 
 int getNumberOfDigits(long number)
 {
@@ -29,23 +65,37 @@ QString debugPrintEdge(PolygonMesh::HE_edge* edge){
             + " -> " + QString::number(edge->vert->index);
 }
 
-PolygonMesh OBJFileParser::getTriangleMesh(QString fileName){
-    PolygonMesh* mesh = parseFile(fileName);
-    return *mesh;
-}
-
 PolygonMesh* OBJFileParser::parseFile(QString fileName){
+    mError = QString();
     if(showDebug)
         qDebug() << "Mesh " << fileName << " to be opened:\n";
+    //Compressed files, pipes and stdin are decompressed while they are parsed
+    const bool streamed = CompressedInput::handles(fileName);
+    if(!streamed && MeshFileIO::detect(fileName)!=MeshFileIO::OBJ)
+    {
+        MeshFileIO reader;
+        reader.setWeldEpsilon(mWeldEpsilon);
+        PolygonMesh* mesh = reader.read(fileName);
+        mWelded = reader.weldedVertexCount();
+        mError = reader.error();
+        return mesh;
+    }
     QFile file(fileName);
-    if(!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::information(0,"error",file.errorString());
-        return NULL;
+    CompressedInput stream;
+    QIODevice* input = &file;
+    if(streamed)
+    {
+        if(!stream.open(fileName))
+            return fail(fileName + ": " + stream.error());
+        input = &stream;
     }
+    else
+    {
+        if(!file.open(QIODevice::ReadOnly))
+            return fail(fileName + ": " + file.errorString());
 
-    if (!file.isReadable()) {
-        QMessageBox::information(0,"Unable to read file %s, aborting\n", file.fileName().toStdString().c_str());
-        return NULL;
+        if (!file.isReadable())
+            return fail("Unable to read file " + fileName);
     }
 
     PolygonMesh* mesh = new PolygonMesh();
@@ -68,8 +118,16 @@ PolygonMesh* OBJFileParser::parseFile(QString fileName){
     unsigned long face_count=1;
     unsigned long vertex_normal_count=1;
 
-    QTextStream in(&file);
+    QTextStream in(input);
+    bool cancelled = false;
+    bool invalid = false;
+    long lineCount = 0;
     while (!in.atEnd()) {
+        //Checked every few thousand lines so closing the window stops a long load
+        if((++lineCount & 4095)==0 && mToken.isCancelled()) {
+            cancelled = true;
+            break;
+        }
         QString line = in.readLine();
 
         /// processing
@@ -105,8 +163,9 @@ PolygonMesh* OBJFileParser::parseFile(QString fileName){
                 }
                 else
                 {
-                    QMessageBox::information(0,"Unable to read file, error in type conversion %s, aborting\n", file.fileName().toStdString().c_str());
-                    return NULL;
+                    delete vert;
+                    invalid = true;
+                    break;
                 }
             }
 
@@ -174,7 +233,29 @@ PolygonMesh* OBJFileParser::parseFile(QString fileName){
             }
         }
     }
-    file.close();
+    input->close();
+
+    //A truncated or corrupt stream would give a partial mesh
+    if(cancelled || invalid || (streamed && stream.failed()))
+    {
+        if(cancelled)
+            qDebug() << "Parsing" << fileName << "cancelled";
+        else if(invalid)
+            fail("Unable to read " + fileName + ", error in type conversion at line " + QString::number(lineCount));
+        else
+            fail(fileName + ": " + stream.error());
+        qDeleteAll(*vertMap);
+        qDeleteAll(normalList);
+        qDeleteAll(*faceDataList);
+        delete faceDataList;
+        delete vert2faceMap;
+        delete normalMap;
+        delete edgeMap;
+        delete faceMap;
+        delete vertMap;
+        delete mesh;
+        return NULL;
+    }
 
 
     //Find the translation vector
@@ -192,19 +273,56 @@ PolygonMesh* OBJFileParser::parseFile(QString fileName){
     float a=1/ll;
     QVector3D sr(a,a,a);
 
-    //Normalize vertexes and move to origin
-    QMap<quint64,PolygonMesh::HE_vert*>::iterator i = vertMap->begin();
-    while (i != vertMap->end()) {
-        PolygonMesh::HE_vert* vert = i.value();
-        QVector3D* vertV = new QVector3D(vert->x,vert->y,vert->z);
-        scaleAndMoveToOrigin(sr,tr,vertV);
-        vert->x = vertV->x();
-        vert->y = vertV->y();
-        vert->z = vertV->z();
-        delete vertV;
-        ++i;
+    mesh->vertVector->reserve(vertMap->size());
+    QMap<quint64,PolygonMesh::HE_vert*>::iterator ivv = vertMap->begin();
+    while (ivv != vertMap->end()) {
+        mesh->vertVector->push_back(ivv.value());
+        ++ivv;
+    }
+
+    //Weld duplicated vertices before any edge is keyed on their indices
+    mWelded = 0;
+    if(mWeldEpsilon > 0.0f)
+    {
+        VertexWelder welder(mWeldEpsilon);
+        std::vector<long> target = welder.weld(*mesh->vertVector);
+        mWelded = welder.mergedCount();
+        if(mWelded > 0)
+        {
+            //Face corners still use the file's ids, which now resolve to the kept vertex
+            std::vector<PolygonMesh::HE_vert*> kept;
+            kept.reserve(mesh->vertVector->size() - mWelded);
+            QMap<quint64,PolygonMesh::HE_vert*>::iterator iw = vertMap->begin();
+            for(size_t i=0; i<target.size(); i++, ++iw)
+            {
+                if(target[i]==(long)i)
+                    kept.push_back(iw.value());
+                else
+                {
+                    delete iw.value();
+                    iw.value() = (*mesh->vertVector)[target[i]];
+                }
+            }
+            for(size_t i=0; i<kept.size(); i++)
+                kept[i]->index = (long)i + 1;
+            mesh->vertVector->swap(kept);
+        }
     }
 
+    //Normalize vertexes and move to origin
+    std::vector<PolygonMesh::HE_vert*>& verts = *mesh->vertVector;
+    parallelFor(0, (long)verts.size(), 16384, [&](long from, long to) {
+        for(long v=from; v<to; v++)
+        {
+            PolygonMesh::HE_vert* vert = verts[v];
+            QVector3D vertV(vert->x,vert->y,vert->z);
+            scaleAndMoveToOrigin(sr,tr,&vertV);
+            vert->x = vertV.x();
+            vert->y = vertV.y();
+            vert->z = vertV.z();
+        }
+    });
+
     //Normalize and assign the max vector
     mesh->maxVector->setX(max.x());
     mesh->maxVector->setY(max.y());
@@ -221,12 +339,13 @@ PolygonMesh* OBJFileParser::parseFile(QString fileName){
     int power_factor = getNumberOfDigits(vertex_count);
     long units = pow(10,power_factor) * 1000;
     long edgeCount=0;
+    long dropped=0;
 
     QListIterator<TempFace*> iter(*faceDataList);
     while(iter.hasNext())
     {
         TempFace* facedata = iter.next();
-        long index = facedata->faceId;
+        long index = faceMap->size() + 1;
 
         if(showDebug)
             qDebug() <<"\n" << "Face id: " << index << ", number of vertices in face: " << facedata->vertexList.size();
@@ -236,11 +355,19 @@ PolygonMesh* OBJFileParser::parseFile(QString fileName){
         for(vid_count=0;vid_count<facedata->vertexList.size();vid_count++)
         {
             PolygonMesh::HE_vert* vert = vertMap->value(facedata->vertexList.at(vid_count),NULL);
-            if(vert!=NULL)
+            //Welded corners may repeat; a zero-length edge would have no valid pair
+            if(vert!=NULL && (vList.isEmpty() || vList.last()!=vert))
             {
-                vList.push_back(vertMap->value(facedata->vertexList.at(vid_count),NULL));
+                vList.push_back(vert);
             }
         }
+        if(vList.size()>1 && vList.first()==vList.last())
+            vList.removeLast();
+        if(vList.size()<3)
+        {
+            dropped++;
+            continue;
+        }
 
         if(showDebug)
             qDebug() <<"\n" << "Number of HE_vert in list: " << vList.size();
@@ -318,25 +445,36 @@ PolygonMesh* OBJFileParser::parseFile(QString fileName){
     }
 
 
-    //Assign surface normal
-    QMap<quint64,PolygonMesh::HE_face*>::iterator iv = faceMap->begin();
-    while (iv != faceMap->end()) {
-        iv.value()->normal = calculateFaceNormal(iv.value());
-        iv.value()->centroid = calculateFaceCentroid(iv.value());
-        ++iv;
+    mesh->faceVector->reserve(faceMap->size());
+    QMap<quint64,PolygonMesh::HE_face*>::iterator ifv = faceMap->begin();
+    while (ifv != faceMap->end()) {
+        mesh->faceVector->push_back(ifv.value());
+        ++ifv;
     }
 
-    //Assign vertex normals
-    if(normalMap->size()==0 || normalMap->size()!=vertMap->size())
+    //Assign surface normal and centroid in one pass over the face loops
+    std::vector<PolygonMesh::HE_face*>& faces = *mesh->faceVector;
+    parallelFor(0, (long)faces.size(), 8192, [&](long from, long to) {
+        for(long f=from; f<to; f++)
+        {
+            faces[f]->normal = calculateFaceNormal(faces[f]);
+            faces[f]->centroid = calculateFaceCentroid(faces[f]);
+        }
+    });
+
+    if(mWelded > 0)
+        qDebug() << "Welded" << mWelded << "vertices," << dropped << "faces collapsed";
+
+    //Assign vertex normals; file normals belong to the unwelded vertices
+    if(mWelded > 0 || normalMap->size()==0 || normalMap->size()!=vertMap->size())
     {
         qDebug() << "Calculating vertex normals";
-        QMap<quint64,PolygonMesh::HE_vert*>::iterator im = vertMap->begin();
-        while (im != vertMap->end()) {
-            quint64 vertIndex = im.value()->index;
-            QList<PolygonMesh::HE_face*> faces = vert2faceMap->values(vertIndex);
-            im.value()->normal = calculateVertexNormal(faces);
-            ++im;
-        }
+        //Only read from here on, so the tasks can share it
+        const QMultiMap<quint64,PolygonMesh::HE_face*>& vertFaces = *vert2faceMap;
+        parallelFor(0, (long)verts.size(), 8192, [&](long from, long to) {
+            for(long v=from; v<to; v++)
+                verts[v]->normal = calculateVertexNormal(vertFaces.values(verts[v]->index));
+        });
     }
     else
     {
@@ -365,6 +503,15 @@ PolygonMesh* OBJFileParser::parseFile(QString fileName){
         ++ig;
     }
 
+    //The mesh owns the nodes now; only the lookup structures go
+    qDeleteAll(*faceDataList);
+    delete faceDataList;
+    delete vert2faceMap;
+    delete normalMap;
+    delete edgeMap;
+    delete faceMap;
+    delete vertMap;
+
     return mesh;
 }
 
@@ -420,48 +567,48 @@ void OBJFileParser::scaleAndMoveToOrigin(
 
 /**
  * @brief calculateFaceNormal
+ * Newell normal over all corners; for a triangle this is the cross product
+ * of two edges, with a length of twice the face area.
  * @param TriangleMesh::HE_face
  * @return TriangleMesh::HE_normal
  */
 PolygonMesh::Normal* OBJFileParser::calculateFaceNormal(PolygonMesh::HE_face* face)
 {
-    PolygonMesh::HE_vert* p1 = face->edge->vert;
-    PolygonMesh::HE_vert* p2 = face->edge->next->vert;
-    PolygonMesh::HE_vert* p3 = face->edge->prev->vert;
-
-    PolygonMesh::HE_vert U;
-    U.x = p2->x - p1->x;
-    U.y = p2->y - p1->y;
-    U.z = p2->z - p1->z;
-
-    PolygonMesh::HE_vert V;
-    V.x = p3->x - p1->x;
-    V.y = p3->y - p1->y;
-    V.z = p3->z - p1->z;
+    float n[3];
+    FaceTriangulator::newellNormal(face, n);
 
     PolygonMesh::Normal* normal = new PolygonMesh::Normal();
-    normal->x = (U.y*V.z) - (U.z*V.y);
-    normal->y = (U.z*V.x) - (U.x*V.z);
-    normal->z = (U.x*V.y) - (U.y*V.x);
+    normal->x = n[0];
+    normal->y = n[1];
+    normal->z = n[2];
 
     return normal;
 }
 
 /**
  * @brief calculateFaceCentroid
+ * Area centroid of the polygon, using face->normal once it is set.
  * @param TriangleMesh::HE_face
  * @return TriangleMesh::HE_vert
  */
 PolygonMesh::HE_vert* OBJFileParser::calculateFaceCentroid(PolygonMesh::HE_face* face)
 {
-    PolygonMesh::HE_vert* p1 = face->edge->vert;
-    PolygonMesh::HE_vert* p2 = face->edge->next->vert;
-    PolygonMesh::HE_vert* p3 = face->edge->prev->vert;
+    float n[3];
+    if(face->normal!=NULL)
+    {
+        n[0] = face->normal->x;
+        n[1] = face->normal->y;
+        n[2] = face->normal->z;
+    }
+    else
+        FaceTriangulator::newellNormal(face, n);
 
+    float c[3];
+    FaceTriangulator::centroid(face, n, c);
     PolygonMesh::HE_vert* centroid = new PolygonMesh::HE_vert();
-    centroid->x = (p3->x + p2->x + p1->x)/3;
-    centroid->y = (p3->y + p2->y + p1->y)/3;
-    centroid->z = (p3->z + p2->z + p1->z)/3;
+    centroid->x = c[0];
+    centroid->y = c[1];
+    centroid->z = c[2];
 
     return centroid;
 }
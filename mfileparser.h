@@ -3,6 +3,7 @@
 
 #include "trianglemesh.h"
 #include "viewportwidget.h"
+#include "parallel.h"
 #include <QtWidgets>
 #include <map>
 #include <QMatrix4x4>
@@ -11,14 +12,29 @@ class OBJFileParser
 {
 public:
     OBJFileParser();
-    PolygonMesh getTriangleMesh(QString fileName);
     PolygonMesh* parseFile(QString fileName);
+    //Merge vertices closer than epsilon (in OBJ units) before building edges; 0 disables
+    void setWeldEpsilon(float epsilon);
+    //Vertices merged by the last parseFile()
+    long weldedVertexCount() const;
+    //parseFile() stops reading and returns NULL once token is cancelled
+    void setCancellationToken(const CancellationToken& token);
+    //Why the last parseFile() returned NULL, empty if it was cancelled
+    QString error() const;
     void scaleAndMoveToOrigin(QVector3D scaleV,
                               QVector3D transV,
                               QVector3D* vertV);
     PolygonMesh::Normal* calculateFaceNormal(PolygonMesh::HE_face* face);
     PolygonMesh::HE_vert* calculateFaceCentroid(PolygonMesh::HE_face* face);
     PolygonMesh::Normal* calculateVertexNormal(QList<PolygonMesh::HE_face*> faces);
+
+private:
+    PolygonMesh* fail(QString error);
+
+    float mWeldEpsilon;
+    QString mError;
+    long mWelded;
+    CancellationToken mToken;
 };
 
 #endif // MFILEPARSER_H
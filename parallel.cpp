@@ -0,0 +1,297 @@
+#include "parallel.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+
+struct TaskGroupState {
+    std::atomic<long> pending;
+    CancellationToken token;
+    std::mutex lock;
+    std::condition_variable done;
+};
+
+namespace {
+
+struct Task {
+    std::function<void()> body;
+    std::shared_ptr<TaskGroupState> group;
+};
+
+struct TaskQueue {
+    std::mutex lock;
+    std::deque<Task*> tasks;
+};
+
+//Index of the pool worker running on this thread, -1 elsewhere
+thread_local int tWorker = -1;
+
+class Scheduler
+{
+public:
+    static Scheduler& instance()
+    {
+        static Scheduler scheduler;
+        return scheduler;
+    }
+
+    int workerCount() const { return (int)mThreads.size(); }
+
+    void submit(Task* task)
+    {
+        TaskQueue& queue = tWorker>=0 ? *mQueues[tWorker] : mShared;
+        {
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.tasks.push_back(task);
+        }
+        {
+            std::lock_guard<std::mutex> guard(mSleepLock);
+            mQueued++;
+        }
+        mWake.notify_one();
+    }
+
+    /**
+     * @brief take
+     * Removes a task to run: the newest of this worker's own, else the
+     * oldest shared or stolen one. With group set, only tasks of that group
+     * are taken, which is what a waiting thread may safely run.
+     */
+    Task* take(const TaskGroupState* group)
+    {
+        Task* task = NULL;
+        if(tWorker>=0)
+            task = popBack(*mQueues[tWorker], group);
+        if(task==NULL)
+            task = popFront(mShared, group);
+        const int count = (int)mQueues.size();
+        const int start = tWorker>=0 ? tWorker+1 : 0;
+        for(int i=0; task==NULL && i<count; i++)
+            task = popFront(*mQueues[(start+i) % count], group);
+        if(task!=NULL)
+        {
+            std::lock_guard<std::mutex> guard(mSleepLock);
+            mQueued--;
+        }
+        return task;
+    }
+
+    static void execute(Task* task)
+    {
+        TaskGroupState* group = task->group.get();
+        if(!group->token.isCancelled())
+            task->body();
+        std::shared_ptr<TaskGroupState> keep = task->group;
+        delete task;
+        if(--group->pending == 0)
+        {
+            std::lock_guard<std::mutex> guard(group->lock);
+            group->done.notify_all();
+        }
+    }
+
+private:
+    Scheduler()
+    {
+        //The calling thread helps while it waits, but tasks queued by run()
+        //from the GUI thread are never waited for, so at least one worker runs
+        unsigned int n = std::thread::hardware_concurrency();
+        const int workers = n>2 ? (int)n - 1 : 1;
+        mQueued = 0;
+        mStop = false;
+        for(int i=0; i<workers; i++)
+            mQueues.push_back(new TaskQueue());
+        for(int i=0; i<workers; i++)
+            mThreads.push_back(std::thread(&Scheduler::work, this, i));
+    }
+
+    ~Scheduler()
+    {
+        {
+            std::lock_guard<std::mutex> guard(mSleepLock);
+            mStop = true;
+        }
+        mWake.notify_all();
+        for(size_t i=0; i<mThreads.size(); i++)
+            mThreads[i].join();
+        for(size_t i=0; i<mQueues.size(); i++)
+            delete mQueues[i];
+    }
+
+    void work(int index)
+    {
+        tWorker = index;
+        while(true)
+        {
+            Task* task = take(NULL);
+            if(task!=NULL)
+            {
+                execute(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(mSleepLock);
+            mWake.wait(guard, [this]() { return mQueued>0 || mStop; });
+            if(mStop)
+                return;
+        }
+    }
+
+    static Task* popBack(TaskQueue& queue, const TaskGroupState* group)
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        for(std::deque<Task*>::reverse_iterator it=queue.tasks.rbegin(); it!=queue.tasks.rend(); ++it)
+        {
+            if(group==NULL || (*it)->group.get()==group)
+            {
+                Task* task = *it;
+                queue.tasks.erase(std::next(it).base());
+                return task;
+            }
+        }
+        return NULL;
+    }
+
+    static Task* popFront(TaskQueue& queue, const TaskGroupState* group)
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        for(std::deque<Task*>::iterator it=queue.tasks.begin(); it!=queue.tasks.end(); ++it)
+        {
+            if(group==NULL || (*it)->group.get()==group)
+            {
+                Task* task = *it;
+                queue.tasks.erase(it);
+                return task;
+            }
+        }
+        return NULL;
+    }
+
+    std::vector<TaskQueue*> mQueues;
+    TaskQueue mShared;
+    std::vector<std::thread> mThreads;
+    std::mutex mSleepLock;
+    std::condition_variable mWake;
+    long mQueued;
+    bool mStop;
+};
+
+}
+
+CancellationToken::CancellationToken()
+    : mFlag(new std::atomic<bool>(false))
+{
+}
+
+void CancellationToken::cancel()
+{
+    *mFlag = true;
+}
+
+bool CancellationToken::isCancelled() const
+{
+    return *mFlag;
+}
+
+TaskGroup::TaskGroup(const CancellationToken& token)
+    : mState(new TaskGroupState())
+{
+    mState->pending = 0;
+    mState->token = token;
+}
+
+TaskGroup::~TaskGroup()
+{
+    wait();
+}
+
+void TaskGroup::run(const std::function<void()>& task)
+{
+    Task* t = new Task();
+    t->body = task;
+    t->group = mState;
+    mState->pending++;
+    Scheduler::instance().submit(t);
+}
+
+void TaskGroup::wait()
+{
+    Scheduler& scheduler = Scheduler::instance();
+    while(mState->pending > 0)
+    {
+        Task* task = scheduler.take(mState.get());
+        if(task!=NULL)
+        {
+            Scheduler::execute(task);
+            continue;
+        }
+        //Everything left is running elsewhere
+        std::unique_lock<std::mutex> guard(mState->lock);
+        mState->done.wait_for(guard, std::chrono::milliseconds(1),
+                              [this]() { return mState->pending == 0; });
+    }
+}
+
+bool TaskGroup::isIdle() const
+{
+    return mState->pending == 0;
+}
+
+void TaskGroup::cancel()
+{
+    mState->token.cancel();
+}
+
+bool TaskGroup::isCancelled() const
+{
+    return mState->token.isCancelled();
+}
+
+CancellationToken TaskGroup::token() const
+{
+    return mState->token;
+}
+
+int parallelThreadCount()
+{
+    return Scheduler::instance().workerCount() + 1;
+}
+
+void parallelFor(long begin, long end, long grain,
+                 const std::function<void(long,long)>& body,
+                 const CancellationToken* token)
+{
+    if(end<=begin)
+        return;
+    if(grain<1)
+        grain = 1;
+
+    const long chunks = (end - begin + grain - 1) / grain;
+    const int runners = (int)qMin<long>(chunks, parallelThreadCount());
+    if(runners<=1)
+    {
+        if(token==NULL || !token->isCancelled())
+            body(begin,end);
+        return;
+    }
+
+    std::atomic<long> next(0);
+    auto runner = [&]() {
+        long chunk;
+        while((chunk = next.fetch_add(1)) < chunks)
+        {
+            if(token!=NULL && token->isCancelled())
+                return;
+            long from = begin + chunk*grain;
+            long to = qMin(end, from + grain);
+            body(from,to);
+        }
+    };
+
+    TaskGroup group;
+    for(int i=1; i<runners; i++)
+        group.run(runner);
+    runner();
+    group.wait();
+}
@@ -0,0 +1,113 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <QtGlobal>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * One process-wide work-stealing thread pool shared by parsing, mesh
+ * processing and export. It has one worker per hardware thread minus one,
+ * but at least one; a thread that waits for work (parallelFor,
+ * TaskGroup::wait) runs tasks of that work itself, so nested parallelism
+ * neither deadlocks nor oversubscribes the machine.
+ *
+ * Workers push and pop their own tasks at the back of a private deque and
+ * steal from the front of the others' when they run dry. Tasks submitted
+ * from outside the pool go to a shared queue.
+ */
+
+/**
+ * Shared cancellation flag. Copies refer to the same flag; tasks that have
+ * not started when it is set are skipped, running tasks may poll it.
+ */
+class CancellationToken
+{
+public:
+    CancellationToken();
+    void cancel();
+    bool isCancelled() const;
+
+private:
+    std::shared_ptr<std::atomic<bool> > mFlag;
+};
+
+struct TaskGroupState;
+
+/**
+ * Set of tasks on the pool that can be waited for together, e.g. the
+ * background jobs of a widget or the chunks of one parallelFor.
+ */
+class TaskGroup
+{
+public:
+    explicit TaskGroup(const CancellationToken& token = CancellationToken());
+    //Waits for the tasks still running
+    ~TaskGroup();
+
+    void run(const std::function<void()>& task);
+    //Returns once every task has finished, running queued ones meanwhile
+    void wait();
+    bool isIdle() const;
+
+    void cancel();
+    bool isCancelled() const;
+    CancellationToken token() const;
+
+private:
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+
+    std::shared_ptr<TaskGroupState> mState;
+};
+
+/**
+ * @brief parallelThreadCount
+ * @return number of threads working on a parallelFor, i.e. the pool
+ * workers plus the calling thread
+ */
+int parallelThreadCount();
+
+/**
+ * @brief parallelFor
+ * Splits [begin,end) into chunks of at most grain items and calls
+ * body(chunkBegin,chunkEnd) for each chunk on the shared pool. Chunks are
+ * handed out dynamically; returns once every chunk is done. With a token,
+ * chunks that have not started when it is cancelled are skipped.
+ */
+void parallelFor(long begin, long end, long grain,
+                 const std::function<void(long,long)>& body,
+                 const CancellationToken* token = NULL);
+
+/**
+ * @brief parallelReduce
+ * Maps every chunk of [begin,end) to a value with map(chunkBegin,chunkEnd)
+ * in parallel and folds the values with combine in chunk order, so the
+ * result does not depend on scheduling.
+ */
+template<class T, class Map, class Combine>
+T parallelReduce(long begin, long end, long grain, const T& identity,
+                 const Map& map, const Combine& combine)
+{
+    if(end<=begin)
+        return identity;
+    grain = qMax(1L, grain);
+    const long chunks = (end - begin + grain - 1) / grain;
+    std::vector<T> partial(chunks, identity);
+    parallelFor(0, chunks, 1, [&](long from, long to) {
+        for(long c=from; c<to; c++)
+        {
+            const long b = begin + c*grain;
+            partial[c] = map(b, qMin(end, b + grain));
+        }
+    });
+    T result = identity;
+    for(long c=0; c<chunks; c++)
+        result = combine(result, partial[c]);
+    return result;
+}
+
+#endif // PARALLEL_H
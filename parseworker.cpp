@@ -1,39 +1,68 @@
 #include "parseworker.h"
+#include "meshreorder.h"
 
 ParseWorker::ParseWorker(QObject *parent) : QObject(parent)
 {
-
+    mReorder = false;
+    mWeldEpsilon = 0.0f;
 }
 
-QSharedPointer<PolygonMesh> sOutMesh;
-class ParseThread : public QThread
+ParseWorker::~ParseWorker()
 {
-public:
-    ParseThread(QString fileName){
-        sFileName = fileName;
-    }
-
-private:
-    void run()
-    {
-        OBJFileParser mFileParser;
-        sOutMesh = QSharedPointer<PolygonMesh>(mFileParser.parseFile( sFileName ));
-        qDebug() << "Parse Complete";
-    }
-    QString sFileName;
-};
+    mJobs.cancel();
+}
 
 void ParseWorker::parse()
 {
-    ParseThread* t = new ParseThread(mFileName);
-    QObject::connect(t, SIGNAL(finished()), this, SLOT(parseDoneInThread()));
-    t->start();
+    QString fileName = mFileName;
+    bool reorder = mReorder;
+    float weldEpsilon = mWeldEpsilon;
+    mJobs.run([this, fileName, reorder, weldEpsilon]() {
+        OBJFileParser mFileParser;
+        mFileParser.setWeldEpsilon(weldEpsilon);
+        mFileParser.setCancellationToken(mJobs.token());
+        PolygonMesh* mesh = mFileParser.parseFile( fileName );
+        if(mJobs.isCancelled())
+        {
+            delete mesh;
+            return;
+        }
+        if(mesh!=NULL && reorder)
+            MeshReorder::optimize(mesh);
+        qDebug() << "Parse Complete";
+        Parsed parsed;
+        parsed.mesh = QSharedPointer<PolygonMesh>(mesh);
+        parsed.welded = weldEpsilon > 0.0f ? mFileParser.weldedVertexCount() : -1;
+        parsed.error = mFileParser.error();
+        QMutexLocker locker(&mLock);
+        mParsed.append(parsed);
+        QMetaObject::invokeMethod(this, "parseDoneInThread", Qt::QueuedConnection);
+    });
 }
 
 void ParseWorker::setFileName(QString fileName){
     mFileName = fileName;
 }
 
+void ParseWorker::setReorder(bool reorder){
+    mReorder = reorder;
+}
+
+void ParseWorker::setWeldEpsilon(float epsilon){
+    mWeldEpsilon = epsilon;
+}
+
 void ParseWorker::parseDoneInThread(){
-    emit parseComplete(sOutMesh);
+    Parsed parsed;
+    {
+        QMutexLocker locker(&mLock);
+        if(mParsed.isEmpty())
+            return;
+        parsed = mParsed.takeFirst();
+    }
+    if(!parsed.mesh.isNull() && parsed.welded >= 0)
+        emit verticesWelded(parsed.welded);
+    emit parseComplete(parsed.mesh);
+    if(parsed.mesh.isNull())
+        emit parseFailed(parsed.error);
 }
@@ -2,25 +2,51 @@
 #define PARSEWORKER_H
 
 #include <QObject>
+#include <QMutex>
+#include <QList>
 
 #include "mfileparser.h"
+#include "parallel.h"
 
+/**
+ * Parses OBJ files as tasks on the shared thread pool and hands the
+ * meshes back on the thread the worker lives in, in the order they finish.
+ */
 class ParseWorker : public QObject
 {
     Q_OBJECT
 public:
     explicit ParseWorker(QObject *parent = 0);
+    //Cancels the parses that are still queued or running
+    ~ParseWorker();
 
 signals:
     void parseComplete(QSharedPointer<PolygonMesh>);
+    //Sent before parseComplete when welding is enabled
+    void verticesWelded(long count);
+    //Sent after parseComplete with a NULL mesh when the file could not be read
+    void parseFailed(QString error);
 
 public slots:
     void parse();
     void parseDoneInThread();
     void setFileName(QString fileName);
+    void setReorder(bool reorder);
+    void setWeldEpsilon(float epsilon);
 
 private:
     QString mFileName;
+    bool mReorder;
+    float mWeldEpsilon;
+    struct Parsed {
+        QSharedPointer<PolygonMesh> mesh;
+        long welded;
+        QString error;
+    };
+    QMutex mLock;
+    QList<Parsed> mParsed;
+    //Declared last so running parses finish before the members above go away
+    TaskGroup mJobs;
 };
 
 #endif // PARSEWORKER_H
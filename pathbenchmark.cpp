@@ -0,0 +1,155 @@
+#include "pathbenchmark.h"
+#include "mfileparser.h"
+#include "meshcomponents.h"
+#include "clustergraph.h"
+#include "parallel.h"
+
+#include <QJsonDocument>
+#include <QElapsedTimer>
+#include <QScopedPointer>
+#include <random>
+
+PathBenchmark::PathBenchmark()
+{
+    mOutputFile = "path_benchmark.json";
+    mQueries = 10000;
+    mClusterSize = 256;
+}
+
+void PathBenchmark::setModelFile(QString fileName){
+    mModelFile = fileName;
+}
+
+void PathBenchmark::setOutputFile(QString fileName){
+    mOutputFile = fileName;
+}
+
+void PathBenchmark::setQueryCount(int queries){
+    mQueries = qMax(1,queries);
+}
+
+void PathBenchmark::setClusterSize(int faces){
+    mClusterSize = faces;
+}
+
+int PathBenchmark::run()
+{
+    OBJFileParser parser;
+    QScopedPointer<PolygonMesh> parsed(parser.parseFile(mModelFile));
+    PolygonMesh* mesh = parsed.data();
+    if(mesh==NULL || mesh->faceVector->empty())
+    {
+        qCritical() << "Benchmark model could not be parsed:" << mModelFile;
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    FaceGraph graph;
+    graph.build(mesh);
+    qint64 graphMs = timer.elapsed();
+
+    //Queries between unreachable islands would only measure the flood fill
+    MeshComponents components(mesh);
+    components.label();
+    std::vector<int> nodes;
+    for(int n=0; n<graph.nodeCount(); n++)
+    {
+        if(components.faceComponent(n)==0)
+            nodes.push_back(n);
+    }
+
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<int> pick(0, (int)nodes.size()-1);
+    std::vector<PathFinder::Query> queries(mQueries);
+    for(int q=0; q<mQueries; q++)
+    {
+        queries[q].start = nodes[pick(random)];
+        queries[q].goal = nodes[pick(random)];
+    }
+
+    PathFinder finder(&graph);
+    PathFinder::SearchState state;
+    std::vector<PathFinder::Result> serial(queries.size());
+    timer.restart();
+    for(size_t q=0; q<queries.size(); q++)
+        finder.findPath(queries[q].start, queries[q].goal, state, &serial[q]);
+    double serialMs = timer.nsecsElapsed() / 1.0e6;
+
+    timer.restart();
+    std::vector<PathFinder::Result> batch = finder.findPaths(queries);
+    double batchMs = timer.nsecsElapsed() / 1.0e6;
+
+    timer.restart();
+    ClusterGraph clusters(&graph);
+    clusters.setClusterSize(mClusterSize);
+    clusters.build();
+    double clusterBuildMs = timer.nsecsElapsed() / 1.0e6;
+    timer.restart();
+    std::vector<PathFinder::Result> hierarchical = clusters.findPaths(queries);
+    double hierarchicalMs = timer.nsecsElapsed() / 1.0e6;
+
+    //Hierarchical paths are near-optimal; record how far off they are
+    double excess = 0.0;
+    long compared = 0;
+    for(size_t q=0; q<queries.size(); q++)
+    {
+        if(batch[q].found && hierarchical[q].found && batch[q].cost > 0.0f)
+        {
+            excess += hierarchical[q].cost / batch[q].cost - 1.0;
+            compared++;
+        }
+    }
+
+    QJsonObject result;
+    result["model"] = QFileInfo(mModelFile).absoluteFilePath();
+    result["nodes"] = graph.nodeCount();
+    result["links"] = (qint64)graph.linkCount();
+    result["graph_build_ms"] = graphMs;
+    result["component_nodes"] = (int)nodes.size();
+    result["queries"] = mQueries;
+    result["threads"] = parallelThreadCount();
+    result["single_thread"] = summarize(serial, serialMs);
+    result["batch"] = summarize(batch, batchMs);
+    QJsonObject hier = summarize(hierarchical, hierarchicalMs);
+    hier["cluster_size"] = mClusterSize;
+    hier["clusters"] = clusters.clusterCount();
+    hier["portals"] = clusters.abstractNodeCount();
+    hier["build_ms"] = clusterBuildMs;
+    hier["mean_cost_excess"] = compared>0 ? excess / compared : 0.0;
+    result["hierarchical"] = hier;
+
+    QFile file(mOutputFile);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qCritical() << "Unable to write benchmark results:" << file.errorString();
+        return 1;
+    }
+    file.write(QJsonDocument(result).toJson(QJsonDocument::Indented));
+    file.close();
+    qDebug() << "Path benchmark written to" << mOutputFile;
+    return 0;
+}
+
+QJsonObject PathBenchmark::summarize(const std::vector<PathFinder::Result>& results, double ms)
+{
+    long found = 0;
+    double expanded = 0.0;
+    double length = 0.0;
+    for(size_t q=0; q<results.size(); q++)
+    {
+        if(results[q].found)
+            found++;
+        expanded += results[q].expanded;
+        length += results[q].path.size();
+    }
+    const double count = qMax<double>(1.0, results.size());
+
+    QJsonObject summary;
+    summary["total_ms"] = ms;
+    summary["queries_per_second"] = ms>0.0 ? results.size() * 1000.0 / ms : 0.0;
+    summary["found"] = (qint64)found;
+    summary["mean_expanded"] = expanded / count;
+    summary["mean_path_nodes"] = length / count;
+    return summary;
+}
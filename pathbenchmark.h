@@ -0,0 +1,35 @@
+#ifndef PATHBENCHMARK_H
+#define PATHBENCHMARK_H
+
+#include <QString>
+#include <QJsonObject>
+#include <vector>
+
+#include "pathfinder.h"
+
+/**
+ * Measures path query throughput on a mesh: random start/goal faces inside
+ * the largest connected component, answered once on a single thread and
+ * once as a parallel batch, and by the hierarchical cluster graph, written
+ * to JSON.
+ */
+class PathBenchmark
+{
+public:
+    PathBenchmark();
+    void setModelFile(QString fileName);
+    void setOutputFile(QString fileName);
+    void setQueryCount(int queries);
+    void setClusterSize(int faces);
+    int run();
+
+private:
+    QJsonObject summarize(const std::vector<PathFinder::Result>& results, double ms);
+
+    QString mModelFile;
+    QString mOutputFile;
+    int mQueries;
+    int mClusterSize;
+};
+
+#endif // PATHBENCHMARK_H
@@ -0,0 +1,176 @@
+#include "pathfinder.h"
+#include "parallel.h"
+
+#include <algorithm>
+
+PathFinder::SearchState::SearchState()
+{
+    stamp = 0;
+}
+
+void PathFinder::SearchState::prepare(int nodeCount)
+{
+    if((int)g.size() != nodeCount)
+    {
+        g.assign(nodeCount, 0.0f);
+        parent.assign(nodeCount, -1);
+        seen.assign(nodeCount, 0);
+        closed.assign(nodeCount, 0);
+        stamp = 0;
+    }
+    if(++stamp == 0)
+    {
+        //Stamps wrapped around; start over with clean arrays
+        std::fill(seen.begin(), seen.end(), 0);
+        std::fill(closed.begin(), closed.end(), 0);
+        stamp = 1;
+    }
+    open.clear();
+}
+
+PathFinder::PathFinder(const FaceGraph* graph)
+{
+    mGraph = graph;
+}
+
+PathFinder::~PathFinder()
+{
+    for(size_t i=0; i<mFreeStates.size(); i++)
+        delete mFreeStates[i];
+}
+
+bool PathFinder::findPath(int start, int goal, SearchState& state, Result* result,
+                          const std::vector<int>* regions, int region) const
+{
+    const FaceGraph& graph = *mGraph;
+    result->found = false;
+    result->cost = 0.0f;
+    result->expanded = 0;
+    result->path.clear();
+    if(start<0 || goal<0 || start>=graph.nodeCount() || goal>=graph.nodeCount())
+        return false;
+
+    state.prepare(graph.nodeCount());
+    const unsigned int stamp = state.stamp;
+    SearchState::OpenOrder order;
+
+    state.g[start] = 0.0f;
+    state.parent[start] = -1;
+    state.seen[start] = stamp;
+    SearchState::OpenEntry first = {graph.distance(start, goal), 0.0f, start};
+    state.open.push_back(first);
+
+    while(!state.open.empty())
+    {
+        std::pop_heap(state.open.begin(), state.open.end(), order);
+        const SearchState::OpenEntry current = state.open.back();
+        state.open.pop_back();
+        const int n = current.node;
+        //Stale entry left behind by a later improvement
+        if(state.closed[n]==stamp || current.g > state.g[n])
+            continue;
+        state.closed[n] = stamp;
+        result->expanded++;
+
+        if(n==goal)
+        {
+            result->found = true;
+            result->cost = state.g[n];
+            for(int p=goal; p>=0; p=state.parent[p])
+                result->path.push_back(p);
+            std::reverse(result->path.begin(), result->path.end());
+            return true;
+        }
+
+        for(int k=graph.offsets[n]; k<graph.offsets[n+1]; k++)
+        {
+            const int m = graph.targets[k];
+            if(state.closed[m]==stamp || (regions!=NULL && (*regions)[m]!=region))
+                continue;
+            const float g = current.g + graph.weights[k];
+            if(state.seen[m]==stamp && g >= state.g[m])
+                continue;
+            state.seen[m] = stamp;
+            state.g[m] = g;
+            state.parent[m] = n;
+            SearchState::OpenEntry entry = {g + graph.distance(m, goal), g, m};
+            state.open.push_back(entry);
+            std::push_heap(state.open.begin(), state.open.end(), order);
+        }
+    }
+    return false;
+}
+
+long PathFinder::flood(int start, SearchState& state,
+                       const std::vector<int>* regions, int region) const
+{
+    long expanded = 0;
+    const FaceGraph& graph = *mGraph;
+    state.prepare(graph.nodeCount());
+    const unsigned int stamp = state.stamp;
+    SearchState::OpenOrder order;
+
+    state.g[start] = 0.0f;
+    state.parent[start] = -1;
+    state.seen[start] = stamp;
+    SearchState::OpenEntry first = {0.0f, 0.0f, start};
+    state.open.push_back(first);
+
+    while(!state.open.empty())
+    {
+        std::pop_heap(state.open.begin(), state.open.end(), order);
+        const SearchState::OpenEntry current = state.open.back();
+        state.open.pop_back();
+        const int n = current.node;
+        if(state.closed[n]==stamp || current.g > state.g[n])
+            continue;
+        state.closed[n] = stamp;
+        expanded++;
+
+        for(int k=graph.offsets[n]; k<graph.offsets[n+1]; k++)
+        {
+            const int m = graph.targets[k];
+            if(state.closed[m]==stamp || (regions!=NULL && (*regions)[m]!=region))
+                continue;
+            const float g = current.g + graph.weights[k];
+            if(state.seen[m]==stamp && g >= state.g[m])
+                continue;
+            state.seen[m] = stamp;
+            state.g[m] = g;
+            state.parent[m] = n;
+            SearchState::OpenEntry entry = {g, g, m};
+            state.open.push_back(entry);
+            std::push_heap(state.open.begin(), state.open.end(), order);
+        }
+    }
+    return expanded;
+}
+
+std::vector<PathFinder::Result> PathFinder::findPaths(const std::vector<Query>& queries)
+{
+    std::vector<Result> results(queries.size());
+    const long grain = qMax(1L, (long)queries.size() / (parallelThreadCount()*8));
+    parallelFor(0, (long)queries.size(), grain, [&](long from, long to) {
+        SearchState* state = acquireState();
+        for(long q=from; q<to; q++)
+            findPath(queries[q].start, queries[q].goal, *state, &results[q]);
+        releaseState(state);
+    });
+    return results;
+}
+
+PathFinder::SearchState* PathFinder::acquireState()
+{
+    std::lock_guard<std::mutex> lock(mStateLock);
+    if(mFreeStates.empty())
+        return new SearchState();
+    SearchState* state = mFreeStates.back();
+    mFreeStates.pop_back();
+    return state;
+}
+
+void PathFinder::releaseState(SearchState* state)
+{
+    std::lock_guard<std::mutex> lock(mStateLock);
+    mFreeStates.push_back(state);
+}
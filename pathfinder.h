@@ -0,0 +1,81 @@
+#ifndef PATHFINDER_H
+#define PATHFINDER_H
+
+#include <vector>
+#include <mutex>
+
+#include "facegraph.h"
+
+/**
+ * A* over a FaceGraph with the Euclidean centroid distance as heuristic,
+ * which is admissible because every link weighs the centroid distance.
+ *
+ * A SearchState holds all per-node scratch arrays; generation stamps make
+ * it reusable without clearing, so a query does not allocate once the
+ * state has grown to the graph size. findPaths() answers a batch of
+ * queries in parallel with one state per worker thread, kept between
+ * batches.
+ *
+ * Searches can be confined to one region of a node labelling (e.g. the
+ * clusters of a ClusterGraph) by passing the labels and the region id.
+ */
+class PathFinder
+{
+public:
+    struct Query {
+        int start;
+        int goal;
+    };
+    struct Result {
+        bool found;
+        float cost;
+        long expanded;
+        //Node sequence from start to goal, empty if not found
+        std::vector<int> path;
+    };
+
+    class SearchState
+    {
+    public:
+        explicit SearchState();
+        void prepare(int nodeCount);
+
+        struct OpenEntry {
+            float f;
+            float g;
+            int node;
+        };
+        struct OpenOrder {
+            bool operator()(const OpenEntry& a, const OpenEntry& b) const {
+                return a.f > b.f;
+            }
+        };
+        std::vector<float> g;
+        std::vector<int> parent;
+        std::vector<unsigned int> seen;
+        std::vector<unsigned int> closed;
+        std::vector<OpenEntry> open;
+        unsigned int stamp;
+    };
+
+    explicit PathFinder(const FaceGraph* graph);
+    ~PathFinder();
+
+    bool findPath(int start, int goal, SearchState& state, Result* result,
+                  const std::vector<int>* regions = NULL, int region = -1) const;
+    //Dijkstra from start over its region; distances are left in state.g
+    //for every node with state.closed == state.stamp. Returns the node count
+    long flood(int start, SearchState& state,
+               const std::vector<int>* regions = NULL, int region = -1) const;
+    std::vector<Result> findPaths(const std::vector<Query>& queries);
+
+private:
+    SearchState* acquireState();
+    void releaseState(SearchState* state);
+
+    const FaceGraph* mGraph;
+    std::mutex mStateLock;
+    std::vector<SearchState*> mFreeStates;
+};
+
+#endif // PATHFINDER_H
@@ -0,0 +1,399 @@
+#ifndef PATHGRAPHFILE_H
+#define PATHGRAPHFILE_H
+
+/**
+ * Binary path graph (.pgraph) layout and a header-only reader.
+ *
+ * The file holds the same graph as the pedestrian_path_points JSON: node n
+ * is the face with index n+1 at its centroid, linked to the faces it
+ * shares an edge with. All values are little-endian and every section
+ * starts on a 16 byte boundary:
+ *
+ *   PathGraphHeader                      64 bytes
+ *   centroids  float32[3*nodeCount]      xyz per node
+ *   offsets    uint32[nodeCount+1]       links of n: offsets[n] .. offsets[n+1]
+ *   targets    uint32[linkCount]         neighbour nodes
+ *   weights    float32[linkCount]        optional, centroid distance per link
+ *   normals    float32[3*nodeCount]      optional, face normal per node
+ *
+ * Absent optional sections have offset 0.
+ *
+ * A tiled export splits the graph into .pgtile files, one per grid cell
+ * on the x/z plane, and a JSON index. A tile has the same sections minus
+ * normals, plus:
+ *
+ *   faceIds    uint32[nodeCount]         global node of every local node
+ *   externals  PathGraphExternal[n]      targets >= nodeCount refer to
+ *                                        externals[target-nodeCount]
+ *
+ * The readers map the file and hand out pointers into the mapping; nothing
+ * is parsed or copied. Opening checks the header, the section bounds and,
+ * in one pass over the adjacency, that offsets never decrease and every
+ * target is a valid node, so a corrupt file is rejected instead of making
+ * the caller read out of bounds. They only depend on the C++ standard library and
+ * the OS mapping API so they can be dropped into a game loader as is.
+ */
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+#ifdef _WIN32
+    #include <Windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#define PATHGRAPH_MAGIC "OBJPGRPH"
+#define PATHGRAPH_VERSION 1
+#define PATHGRAPH_TILE_MAGIC "OBJPTILE"
+#define PATHGRAPH_TILE_VERSION 1
+
+enum PathGraphFlags {
+    PATHGRAPH_WEIGHTS = 1,
+    PATHGRAPH_NORMALS = 2
+};
+
+struct PathGraphHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t nodeCount;
+    uint32_t linkCount;
+    //Byte offsets of the sections from the start of the file
+    uint64_t centroidsOffset;
+    uint64_t offsetsOffset;
+    uint64_t targetsOffset;
+    uint64_t weightsOffset;
+    uint64_t normalsOffset;
+};
+
+struct PathGraphTileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t nodeCount;
+    uint32_t linkCount;
+    //Grid cell of the tile; its id in the index is z*gridWidth+x
+    int32_t tileX;
+    int32_t tileZ;
+    uint32_t externalCount;
+    uint32_t reserved;
+    uint64_t centroidsOffset;
+    uint64_t offsetsOffset;
+    uint64_t targetsOffset;
+    uint64_t weightsOffset;
+    uint64_t faceIdsOffset;
+    uint64_t externalsOffset;
+};
+
+//Link target in another tile
+struct PathGraphExternal {
+    uint32_t tile;
+    uint32_t node;
+};
+
+/**
+ * Read-only mapping of a whole file, shared by the readers below.
+ */
+class PathGraphMapping
+{
+public:
+    PathGraphMapping()
+    {
+        mData = NULL;
+        mSize = 0;
+        mMapped = false;
+        mError = "";
+#ifdef _WIN32
+        mFile = INVALID_HANDLE_VALUE;
+        mMapping = NULL;
+#endif
+    }
+
+    ~PathGraphMapping()
+    {
+        close();
+    }
+
+    bool map(const char* fileName)
+    {
+        close();
+#ifdef _WIN32
+        mFile = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(mFile==INVALID_HANDLE_VALUE)
+            return fail("cannot open file");
+        LARGE_INTEGER size;
+        if(!GetFileSizeEx(mFile, &size) || size.QuadPart==0)
+            return fail("cannot read file size");
+        mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mMapping==NULL)
+            return fail("cannot map file");
+        mData = (const unsigned char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+        mSize = (size_t)size.QuadPart;
+#else
+        int fd = ::open(fileName, O_RDONLY);
+        if(fd<0)
+            return fail("cannot open file");
+        struct stat info;
+        if(fstat(fd, &info)!=0 || info.st_size==0)
+        {
+            ::close(fd);
+            return fail("cannot read file size");
+        }
+        void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        mData = data==MAP_FAILED ? NULL : (const unsigned char*)data;
+        mSize = (size_t)info.st_size;
+#endif
+        if(mData==NULL)
+            return fail("cannot map file");
+        mMapped = true;
+        return true;
+    }
+
+    void use(const void* data, size_t size)
+    {
+        close();
+        mData = (const unsigned char*)data;
+        mSize = size;
+    }
+
+    void close()
+    {
+        if(mMapped && mData!=NULL)
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(mData);
+#else
+            munmap((void*)mData, mSize);
+#endif
+        }
+#ifdef _WIN32
+        if(mMapping!=NULL)
+            CloseHandle(mMapping);
+        if(mFile!=INVALID_HANDLE_VALUE)
+            CloseHandle(mFile);
+        mMapping = NULL;
+        mFile = INVALID_HANDLE_VALUE;
+#endif
+        mData = NULL;
+        mSize = 0;
+        mMapped = false;
+    }
+
+    bool fail(const char* error)
+    {
+        close();
+        mError = error;
+        return false;
+    }
+
+    //Checks a section of bytes at offset; offset 0 means absent
+    bool fits(uint64_t offset, uint64_t bytes, bool optional, size_t headerSize) const
+    {
+        if(offset==0)
+            return optional;
+        return offset%4==0 && offset>=headerSize &&
+               offset<=mSize && bytes<=mSize-offset;
+    }
+
+    bool checkHost()
+    {
+        const uint16_t probe = 1;
+        if(*(const unsigned char*)&probe!=1)
+            return fail("big-endian hosts are not supported");
+        return true;
+    }
+
+    //Offsets must not decrease and end at links; targets must be below limit
+    bool checkLinks(const uint32_t* offsets, uint64_t nodes,
+                    const uint32_t* targets, uint64_t links, uint64_t limit)
+    {
+        if(offsets[nodes]!=links)
+            return fail("adjacency does not match the link count");
+        for(uint64_t n=0; n<nodes; n++)
+            if(offsets[n]>offsets[n+1])
+                return fail("adjacency offsets decrease");
+        for(uint64_t k=0; k<links; k++)
+            if(targets[k]>=limit)
+                return fail("link target out of range");
+        return true;
+    }
+
+    template<class T> const T* section(uint64_t offset) const
+    {
+        return offset==0 ? NULL : (const T*)(mData + offset);
+    }
+
+    const unsigned char* mData;
+    size_t mSize;
+    const char* mError;
+
+private:
+    PathGraphMapping(const PathGraphMapping&);
+    PathGraphMapping& operator=(const PathGraphMapping&);
+
+    bool mMapped;
+#ifdef _WIN32
+    HANDLE mFile;
+    HANDLE mMapping;
+#endif
+};
+
+class PathGraphFile
+{
+public:
+    /**
+     * @brief open
+     * Maps fileName read-only and checks the header, the section bounds and
+     * the adjacency.
+     * @return false with error() set if the file is not a usable path graph
+     */
+    bool open(const char* fileName)
+    {
+        return mFile.map(fileName) && validate();
+    }
+
+    /**
+     * @brief openMemory
+     * Uses a graph that is already in memory (e.g. from a package file).
+     * The data must stay valid and 4-byte aligned while this object is used.
+     */
+    bool openMemory(const void* data, size_t size)
+    {
+        mFile.use(data, size);
+        return validate();
+    }
+
+    void close() { mFile.close(); }
+    bool isOpen() const { return mFile.mData!=NULL; }
+    const char* error() const { return mFile.mError; }
+
+    const PathGraphHeader* header() const { return (const PathGraphHeader*)mFile.mData; }
+    uint32_t nodeCount() const { return header()->nodeCount; }
+    uint32_t linkCount() const { return header()->linkCount; }
+    const float* centroids() const { return mFile.section<float>(header()->centroidsOffset); }
+    const uint32_t* offsets() const { return mFile.section<uint32_t>(header()->offsetsOffset); }
+    const uint32_t* targets() const { return mFile.section<uint32_t>(header()->targetsOffset); }
+    //NULL when the file was written without the attribute
+    const float* weights() const { return mFile.section<float>(header()->weightsOffset); }
+    const float* normals() const { return mFile.section<float>(header()->normalsOffset); }
+
+private:
+    bool validate()
+    {
+        if(!mFile.checkHost())
+            return false;
+        if(mFile.mSize<sizeof(PathGraphHeader))
+            return mFile.fail("file too small");
+        const PathGraphHeader* h = header();
+        if(memcmp(h->magic, PATHGRAPH_MAGIC, 8)!=0)
+            return mFile.fail("not a path graph file");
+        if(h->version!=PATHGRAPH_VERSION)
+            return mFile.fail("unsupported version");
+        const uint64_t nodes = h->nodeCount;
+        const uint64_t links = h->linkCount;
+        const size_t hs = sizeof(PathGraphHeader);
+        if(!mFile.fits(h->centroidsOffset, nodes*12, false, hs) ||
+           !mFile.fits(h->offsetsOffset, (nodes+1)*4, false, hs) ||
+           !mFile.fits(h->targetsOffset, links*4, false, hs) ||
+           !mFile.fits(h->weightsOffset, links*4, (h->flags & PATHGRAPH_WEIGHTS)==0, hs) ||
+           !mFile.fits(h->normalsOffset, nodes*12, (h->flags & PATHGRAPH_NORMALS)==0, hs))
+            return mFile.fail("section out of bounds");
+        return mFile.checkLinks(offsets(), nodes, targets(), links, nodes);
+    }
+
+    PathGraphMapping mFile;
+};
+
+/**
+ * Reader for one .pgtile of a tiled export, used like PathGraphFile.
+ */
+class PathGraphTileFile
+{
+public:
+    bool open(const char* fileName)
+    {
+        return mFile.map(fileName) && validate();
+    }
+
+    bool openMemory(const void* data, size_t size)
+    {
+        mFile.use(data, size);
+        return validate();
+    }
+
+    void close() { mFile.close(); }
+    bool isOpen() const { return mFile.mData!=NULL; }
+    const char* error() const { return mFile.mError; }
+
+    const PathGraphTileHeader* header() const { return (const PathGraphTileHeader*)mFile.mData; }
+    uint32_t nodeCount() const { return header()->nodeCount; }
+    uint32_t linkCount() const { return header()->linkCount; }
+    uint32_t externalCount() const { return header()->externalCount; }
+    const float* centroids() const { return mFile.section<float>(header()->centroidsOffset); }
+    const uint32_t* offsets() const { return mFile.section<uint32_t>(header()->offsetsOffset); }
+    const uint32_t* targets() const { return mFile.section<uint32_t>(header()->targetsOffset); }
+    const float* weights() const { return mFile.section<float>(header()->weightsOffset); }
+    const uint32_t* faceIds() const { return mFile.section<uint32_t>(header()->faceIdsOffset); }
+    const PathGraphExternal* externals() const
+    {
+        return mFile.section<PathGraphExternal>(header()->externalsOffset);
+    }
+    bool isExternal(uint32_t target) const { return target>=nodeCount(); }
+
+    /**
+     * @brief validateExternals
+     * Checks the externals against the tile index, which open() cannot see:
+     * every tile must be below tileCount (grid_width*grid_height) and, when
+     * nodeCounts is given, every node below nodeCounts[tile], the "nodes" of
+     * that tile in the index (0 for empty cells). Call it before following
+     * external links of an untrusted tile.
+     */
+    bool validateExternals(uint32_t tileCount, const uint32_t* nodeCounts)
+    {
+        const PathGraphExternal* e = externals();
+        for(uint32_t i=0; i<externalCount(); i++)
+        {
+            if(e[i].tile>=tileCount)
+                return mFile.fail("external tile out of range");
+            if(nodeCounts!=NULL && e[i].node>=nodeCounts[e[i].tile])
+                return mFile.fail("external node out of range");
+        }
+        return true;
+    }
+
+private:
+    bool validate()
+    {
+        if(!mFile.checkHost())
+            return false;
+        if(mFile.mSize<sizeof(PathGraphTileHeader))
+            return mFile.fail("file too small");
+        const PathGraphTileHeader* h = header();
+        if(memcmp(h->magic, PATHGRAPH_TILE_MAGIC, 8)!=0)
+            return mFile.fail("not a path graph tile");
+        if(h->version!=PATHGRAPH_TILE_VERSION)
+            return mFile.fail("unsupported version");
+        const uint64_t nodes = h->nodeCount;
+        const uint64_t links = h->linkCount;
+        const size_t hs = sizeof(PathGraphTileHeader);
+        if(!mFile.fits(h->centroidsOffset, nodes*12, false, hs) ||
+           !mFile.fits(h->offsetsOffset, (nodes+1)*4, false, hs) ||
+           !mFile.fits(h->targetsOffset, links*4, false, hs) ||
+           !mFile.fits(h->weightsOffset, links*4, (h->flags & PATHGRAPH_WEIGHTS)==0, hs) ||
+           !mFile.fits(h->faceIdsOffset, nodes*4, false, hs) ||
+           !mFile.fits(h->externalsOffset, (uint64_t)h->externalCount*8, h->externalCount==0, hs))
+            return mFile.fail("section out of bounds");
+        return mFile.checkLinks(offsets(), nodes, targets(), links, nodes + h->externalCount);
+    }
+
+    PathGraphMapping mFile;
+};
+
+#endif // PATHGRAPHFILE_H
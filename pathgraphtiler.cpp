@@ -0,0 +1,339 @@
+#include "pathgraphtiler.h"
+#include "pathgraphfile.h"
+#include "parallel.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QStringList>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDebug>
+#include <atomic>
+#include <cmath>
+#include <string>
+
+namespace {
+
+const float kFacesPerTile = 4096.0f;
+//Upper bound on grid cells, so the bucketing arrays stay small for tiny tiles
+const double kMaxCells = 1 << 20;
+
+//Appends 32-bit values in little-endian order whatever the host order is
+void appendWords(std::string& out, const void* words, size_t count)
+{
+    const uint16_t probe = 1;
+    if(*(const unsigned char*)&probe==1)
+    {
+        out.append((const char*)words, count*4);
+        return;
+    }
+    const uint32_t* in = (const uint32_t*)words;
+    for(size_t i=0; i<count; i++)
+    {
+        const uint32_t v = in[i];
+        const char bytes[4] = {(char)(v & 0xff), (char)((v>>8) & 0xff),
+                               (char)((v>>16) & 0xff), (char)(v>>24)};
+        out.append(bytes, 4);
+    }
+}
+
+void appendWord(std::string& out, uint32_t value)
+{
+    appendWords(out, &value, 1);
+}
+
+void appendOffset(std::string& out, uint64_t value)
+{
+    appendWord(out, (uint32_t)(value & 0xffffffffu));
+    appendWord(out, (uint32_t)(value >> 32));
+}
+
+void appendHeader(std::string& out, const PathGraphTileHeader& header)
+{
+    out.append(header.magic, 8);
+    appendWord(out, header.version);
+    appendWord(out, header.flags);
+    appendWord(out, header.nodeCount);
+    appendWord(out, header.linkCount);
+    appendWord(out, (uint32_t)header.tileX);
+    appendWord(out, (uint32_t)header.tileZ);
+    appendWord(out, header.externalCount);
+    appendWord(out, header.reserved);
+    appendOffset(out, header.centroidsOffset);
+    appendOffset(out, header.offsetsOffset);
+    appendOffset(out, header.targetsOffset);
+    appendOffset(out, header.weightsOffset);
+    appendOffset(out, header.faceIdsOffset);
+    appendOffset(out, header.externalsOffset);
+}
+
+//Removes <base>_<x>_<z>.pgtile files left by an earlier export to the same index
+void removeTiles(QDir dir, const QString& base)
+{
+    QStringList names = dir.entryList(QStringList() << base + "_*_*.pgtile", QDir::Files);
+    for(int i=0; i<names.size(); i++)
+    {
+        //Skip other indexes whose name starts with base, e.g. <base>_old
+        QString cell = names[i].mid(base.size()+1);
+        cell.chop(7);
+        QStringList xz = cell.split('_');
+        bool xOk = false, zOk = false;
+        if(xz.size()==2)
+        {
+            xz[0].toInt(&xOk);
+            xz[1].toInt(&zOk);
+        }
+        if(xOk && zOk && !dir.remove(names[i]))
+            qWarning() << "Unable to remove old path graph tile" << names[i];
+    }
+}
+
+uint64_t align16(uint64_t offset)
+{
+    return (offset + 15) & ~(uint64_t)15;
+}
+
+}
+
+PathGraphTiler::PathGraphTiler()
+{
+    mTileSize = 0.0f;
+    mWeights = true;
+}
+
+void PathGraphTiler::setTileSize(float size){
+    mTileSize = qMax(0.0f, size);
+}
+
+void PathGraphTiler::setWeights(bool enabled){
+    mWeights = enabled;
+}
+
+int PathGraphTiler::write(const PolygonMesh* mesh, QString indexFile)
+{
+    FaceGraph graph;
+    graph.build(mesh);
+    return write(graph, indexFile);
+}
+
+int PathGraphTiler::write(const FaceGraph& graph, QString indexFile)
+{
+    const int nodeCount = graph.nodeCount();
+    if(nodeCount==0)
+        return -1;
+
+    float minX = graph.centroids[0], maxX = minX;
+    float minZ = graph.centroids[2], maxZ = minZ;
+    for(int n=1; n<nodeCount; n++)
+    {
+        minX = qMin(minX, graph.centroids[n*3]);
+        maxX = qMax(maxX, graph.centroids[n*3]);
+        minZ = qMin(minZ, graph.centroids[n*3+2]);
+        maxZ = qMax(maxZ, graph.centroids[n*3+2]);
+    }
+    const float extentX = maxX - minX;
+    const float extentZ = maxZ - minZ;
+    float tileSize = mTileSize;
+    if(tileSize<=0.0f)
+    {
+        //Assumes the faces are spread evenly over the bounding rectangle
+        const float tileCount = qMax(1.0f, nodeCount / kFacesPerTile);
+        tileSize = sqrtf(extentX * extentZ / tileCount);
+        //A strip narrower than a tile is one row of tiles along its length
+        if(tileSize >= qMin(extentX, extentZ))
+            tileSize = qMax(extentX, extentZ) / tileCount;
+        if(!(tileSize>0.0f))
+            tileSize = 1.0f;
+    }
+    //Bound the grid for degenerate extents or tiny sizes
+    while((extentX/(double)tileSize + 1.0) * (extentZ/(double)tileSize + 1.0) > kMaxCells)
+        tileSize *= 2.0f;
+    const int gridWidth = qMax(1, (int)floorf((maxX-minX)/tileSize) + 1);
+    const int gridHeight = qMax(1, (int)floorf((maxZ-minZ)/tileSize) + 1);
+    const int cellCount = gridWidth * gridHeight;
+
+    //Bucket the nodes by tile; nodes keep their global order inside a tile
+    std::vector<int> nodeTile(nodeCount);
+    std::vector<int> tileStart(cellCount+1, 0);
+    for(int n=0; n<nodeCount; n++)
+    {
+        int x = qMin(gridWidth-1, (int)((graph.centroids[n*3]-minX)/tileSize));
+        int z = qMin(gridHeight-1, (int)((graph.centroids[n*3+2]-minZ)/tileSize));
+        nodeTile[n] = z*gridWidth + x;
+        tileStart[nodeTile[n]+1]++;
+    }
+    for(int c=0; c<cellCount; c++)
+        tileStart[c+1] += tileStart[c];
+    std::vector<int> tileNodes(nodeCount);
+    std::vector<int> localIndex(nodeCount);
+    {
+        std::vector<int> fill(tileStart.begin(), tileStart.end()-1);
+        for(int n=0; n<nodeCount; n++)
+        {
+            int slot = fill[nodeTile[n]]++;
+            tileNodes[slot] = n;
+            localIndex[n] = slot - tileStart[nodeTile[n]];
+        }
+    }
+    std::vector<int> tiles;
+    for(int c=0; c<cellCount; c++)
+    {
+        if(tileStart[c+1]>tileStart[c])
+            tiles.push_back(c);
+    }
+
+    QFileInfo info(indexFile);
+    const QString base = info.completeBaseName();
+    const QDir dir = info.dir();
+    //A finer grid than last time would otherwise leave stale tiles behind
+    removeTiles(dir, base);
+    std::vector<long> tileLinks(tiles.size());
+    std::vector<long> tileExternals(tiles.size());
+    std::atomic<bool> failed(false);
+
+    parallelFor(0, (long)tiles.size(), 1, [&](long from, long to) {
+        std::string out;
+        std::vector<uint32_t> offsets, targets, faceIds;
+        std::vector<float> centroids, weights;
+        std::vector<PathGraphExternal> externals;
+        for(long t=from; t<to; t++)
+        {
+            const int cell = tiles[t];
+            const int begin = tileStart[cell];
+            const uint32_t count = (uint32_t)(tileStart[cell+1] - begin);
+            offsets.assign(1, 0);
+            targets.clear();
+            faceIds.clear();
+            centroids.clear();
+            weights.clear();
+            externals.clear();
+            for(uint32_t i=0; i<count; i++)
+            {
+                const int n = tileNodes[begin+i];
+                faceIds.push_back((uint32_t)n);
+                centroids.insert(centroids.end(), &graph.centroids[n*3], &graph.centroids[n*3]+3);
+                for(int k=graph.offsets[n]; k<graph.offsets[n+1]; k++)
+                {
+                    const int m = graph.targets[k];
+                    if(nodeTile[m]==cell)
+                        targets.push_back((uint32_t)localIndex[m]);
+                    else
+                    {
+                        targets.push_back(count + (uint32_t)externals.size());
+                        PathGraphExternal ref = {(uint32_t)nodeTile[m], (uint32_t)localIndex[m]};
+                        externals.push_back(ref);
+                    }
+                    weights.push_back(graph.weights[k]);
+                }
+                offsets.push_back((uint32_t)targets.size());
+            }
+
+            PathGraphTileHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, PATHGRAPH_TILE_MAGIC, 8);
+            header.version = PATHGRAPH_TILE_VERSION;
+            header.flags = mWeights ? PATHGRAPH_WEIGHTS : 0;
+            header.nodeCount = count;
+            header.linkCount = (uint32_t)targets.size();
+            header.tileX = cell % gridWidth;
+            header.tileZ = cell / gridWidth;
+            header.externalCount = (uint32_t)externals.size();
+            uint64_t end = sizeof(header);
+            header.centroidsOffset = align16(end);
+            end = header.centroidsOffset + centroids.size()*4;
+            header.offsetsOffset = align16(end);
+            end = header.offsetsOffset + offsets.size()*4;
+            header.targetsOffset = align16(end);
+            end = header.targetsOffset + targets.size()*4;
+            if(mWeights)
+            {
+                header.weightsOffset = align16(end);
+                end = header.weightsOffset + weights.size()*4;
+            }
+            header.faceIdsOffset = align16(end);
+            end = header.faceIdsOffset + faceIds.size()*4;
+            if(!externals.empty())
+                header.externalsOffset = align16(end);
+
+            out.clear();
+            appendHeader(out, header);
+            out.resize((size_t)header.centroidsOffset, '\0');
+            appendWords(out, centroids.data(), centroids.size());
+            out.resize((size_t)header.offsetsOffset, '\0');
+            appendWords(out, offsets.data(), offsets.size());
+            out.resize((size_t)header.targetsOffset, '\0');
+            appendWords(out, targets.data(), targets.size());
+            if(mWeights)
+            {
+                out.resize((size_t)header.weightsOffset, '\0');
+                appendWords(out, weights.data(), weights.size());
+            }
+            out.resize((size_t)header.faceIdsOffset, '\0');
+            appendWords(out, faceIds.data(), faceIds.size());
+            if(!externals.empty())
+            {
+                out.resize((size_t)header.externalsOffset, '\0');
+                //Each external is a (tile, node) pair of words
+                appendWords(out, externals.data(), externals.size()*2);
+            }
+
+            QFile file(dir.filePath(QString("%1_%2_%3.pgtile").arg(base)
+                                    .arg(header.tileX).arg(header.tileZ)));
+            if(!file.open(QIODevice::WriteOnly) ||
+               file.write(out.data(), (qint64)out.size()) != (qint64)out.size())
+                failed = true;
+            file.close();
+            tileLinks[t] = (long)targets.size();
+            tileExternals[t] = (long)externals.size();
+        }
+    });
+    if(failed)
+    {
+        qWarning() << "Unable to write path graph tiles next to" << indexFile;
+        return -1;
+    }
+
+    QJsonArray tileArray;
+    for(size_t t=0; t<tiles.size(); t++)
+    {
+        const int x = tiles[t] % gridWidth;
+        const int z = tiles[t] / gridWidth;
+        QJsonObject tile;
+        tile["id"] = tiles[t];
+        tile["x"] = x;
+        tile["z"] = z;
+        tile["file"] = QString("%1_%2_%3.pgtile").arg(base).arg(x).arg(z);
+        tile["nodes"] = tileStart[tiles[t]+1] - tileStart[tiles[t]];
+        tile["links"] = (qint64)tileLinks[t];
+        tile["external_links"] = (qint64)tileExternals[t];
+        QJsonArray bounds;
+        bounds.append(minX + x*tileSize);
+        bounds.append(minZ + z*tileSize);
+        bounds.append(minX + (x+1)*tileSize);
+        bounds.append(minZ + (z+1)*tileSize);
+        tile["bounds"] = bounds;
+        tileArray.append(tile);
+    }
+    QJsonObject index;
+    index["format"] = "pgtile";
+    index["version"] = PATHGRAPH_TILE_VERSION;
+    index["origin_x"] = minX;
+    index["origin_z"] = minZ;
+    index["tile_size"] = tileSize;
+    index["grid_width"] = gridWidth;
+    index["grid_height"] = gridHeight;
+    index["nodes"] = nodeCount;
+    index["tiles"] = tileArray;
+
+    QFile file(indexFile);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Unable to write path graph index:" << file.errorString();
+        return -1;
+    }
+    file.write(QJsonDocument(index).toJson(QJsonDocument::Indented));
+    file.close();
+    return (int)tiles.size();
+}
@@ -0,0 +1,38 @@
+#ifndef PATHGRAPHTILER_H
+#define PATHGRAPHTILER_H
+
+#include <QString>
+
+#include "facegraph.h"
+
+/**
+ * Splits the face graph into square tiles on the x/z plane by centroid and
+ * writes one .pgtile per non-empty tile (layout in pathgraphfile.h), so a
+ * game can stream the graph around the player instead of loading it whole.
+ *
+ * Links that leave a tile are stored as external references to the tile id
+ * and local node of the target. The JSON index lists the grid origin, tile
+ * size, grid width and every tile with its file, bounds and counts.
+ */
+class PathGraphTiler
+{
+public:
+    explicit PathGraphTiler();
+    //Edge length of a tile in model units; 0 picks about 4096 faces per tile
+    void setTileSize(float size);
+    void setWeights(bool enabled);
+
+    /**
+     * @brief write
+     * Writes <name>_<x>_<z>.pgtile files next to indexFile, in parallel.
+     * @return number of tiles written, -1 on failure
+     */
+    int write(const PolygonMesh* mesh, QString indexFile);
+    int write(const FaceGraph& graph, QString indexFile);
+
+private:
+    float mTileSize;
+    bool mWeights;
+};
+
+#endif // PATHGRAPHTILER_H
@@ -0,0 +1,189 @@
+#include "pathgraphwriter.h"
+#include "pathgraphfile.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDebug>
+#include <string>
+
+namespace {
+
+//Appends 32-bit values in little-endian order whatever the host order is
+void appendWords(std::string& out, const void* words, size_t count)
+{
+    const uint16_t probe = 1;
+    if(*(const unsigned char*)&probe==1)
+    {
+        out.append((const char*)words, count*4);
+        return;
+    }
+    const uint32_t* in = (const uint32_t*)words;
+    for(size_t i=0; i<count; i++)
+    {
+        const uint32_t v = in[i];
+        const char bytes[4] = {(char)(v & 0xff), (char)((v>>8) & 0xff),
+                               (char)((v>>16) & 0xff), (char)(v>>24)};
+        out.append(bytes, 4);
+    }
+}
+
+void appendWord(std::string& out, uint32_t value)
+{
+    appendWords(out, &value, 1);
+}
+
+void appendOffset(std::string& out, uint64_t value)
+{
+    appendWord(out, (uint32_t)(value & 0xffffffffu));
+    appendWord(out, (uint32_t)(value >> 32));
+}
+
+uint64_t align16(uint64_t offset)
+{
+    return (offset + 15) & ~(uint64_t)15;
+}
+
+}
+
+PathGraphWriter::PathGraphWriter()
+{
+    mWeights = true;
+    mNormals = false;
+}
+
+void PathGraphWriter::setWeights(bool enabled){
+    mWeights = enabled;
+}
+
+void PathGraphWriter::setNormals(bool enabled){
+    mNormals = enabled;
+}
+
+bool PathGraphWriter::write(const PolygonMesh* mesh, QString fileName)
+{
+    FaceGraph graph;
+    graph.build(mesh);
+    return write(graph, mesh, fileName);
+}
+
+bool PathGraphWriter::write(const FaceGraph& graph, const PolygonMesh* mesh, QString fileName)
+{
+    const uint64_t nodes = (uint64_t)graph.nodeCount();
+    const uint64_t links = (uint64_t)graph.linkCount();
+    const bool normals = mNormals && mesh!=NULL;
+
+    uint64_t end = sizeof(PathGraphHeader);
+    const uint64_t centroidsOffset = align16(end);
+    end = centroidsOffset + nodes*12;
+    const uint64_t offsetsOffset = align16(end);
+    end = offsetsOffset + (nodes+1)*4;
+    const uint64_t targetsOffset = align16(end);
+    end = targetsOffset + links*4;
+    const uint64_t weightsOffset = mWeights ? align16(end) : 0;
+    if(mWeights)
+        end = weightsOffset + links*4;
+    const uint64_t normalsOffset = normals ? align16(end) : 0;
+    if(normals)
+        end = normalsOffset + nodes*12;
+
+    std::string out;
+    out.reserve((size_t)end);
+    out.append(PATHGRAPH_MAGIC, 8);
+    appendWord(out, PATHGRAPH_VERSION);
+    appendWord(out, (mWeights ? PATHGRAPH_WEIGHTS : 0) | (normals ? PATHGRAPH_NORMALS : 0));
+    appendWord(out, (uint32_t)nodes);
+    appendWord(out, (uint32_t)links);
+    appendOffset(out, centroidsOffset);
+    appendOffset(out, offsetsOffset);
+    appendOffset(out, targetsOffset);
+    appendOffset(out, weightsOffset);
+    appendOffset(out, normalsOffset);
+
+    out.resize((size_t)centroidsOffset, '\0');
+    appendWords(out, graph.centroids.data(), graph.centroids.size());
+    out.resize((size_t)offsetsOffset, '\0');
+    appendWords(out, graph.offsets.data(), graph.offsets.size());
+    out.resize((size_t)targetsOffset, '\0');
+    appendWords(out, graph.targets.data(), graph.targets.size());
+    if(mWeights)
+    {
+        out.resize((size_t)weightsOffset, '\0');
+        appendWords(out, graph.weights.data(), graph.weights.size());
+    }
+    if(normals)
+    {
+        out.resize((size_t)normalsOffset, '\0');
+        for(uint64_t n=0; n<nodes; n++)
+        {
+            PolygonMesh::Normal* normal = mesh->faceVector->at(n)->normal;
+            const float xyz[3] = {normal ? normal->x : 0.0f,
+                                  normal ? normal->y : 0.0f,
+                                  normal ? normal->z : 0.0f};
+            appendWords(out, xyz, 3);
+        }
+    }
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Unable to write path graph:" << file.errorString();
+        return false;
+    }
+    bool ok = file.write(out.data(), (qint64)out.size()) == (qint64)out.size();
+    file.close();
+    return ok;
+}
+
+void PathGraphWriter::compareWithJson(QString binaryFile, QString jsonFile)
+{
+    QElapsedTimer timer;
+
+    //What a loader has to do with the JSON: parse it and fill the same arrays
+    timer.start();
+    std::vector<float> centroids;
+    std::vector<int> offsets(1, 0);
+    std::vector<int> targets;
+    QFile file(jsonFile);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "Unable to read" << jsonFile;
+        return;
+    }
+    QJsonArray points = QJsonDocument::fromJson(file.readAll()).object()
+            .value("pedestrian_path_points").toArray();
+    file.close();
+    for(int i=0; i<points.size(); i++)
+    {
+        QJsonObject point = points.at(i).toObject();
+        centroids.push_back((float)point.value("x").toDouble());
+        centroids.push_back((float)point.value("y").toDouble());
+        centroids.push_back((float)point.value("z").toDouble());
+        QJsonArray linked = point.value("linked_indexes").toArray();
+        for(int k=0; k<linked.size(); k++)
+            targets.push_back(linked.at(k).toObject().value("end_index").toInt() - 1);
+        offsets.push_back((int)targets.size());
+    }
+    double jsonMs = timer.nsecsElapsed() / 1.0e6;
+
+    //The binary graph is used in place; touch every link so it is paged in
+    timer.restart();
+    PathGraphFile graph;
+    if(!graph.open(binaryFile.toLocal8Bit().constData()))
+    {
+        qWarning() << "Unable to map" << binaryFile << ":" << graph.error();
+        return;
+    }
+    uint64_t checksum = 0;
+    for(uint32_t l=0; l<graph.linkCount(); l++)
+        checksum += graph.targets()[l];
+    double binaryMs = timer.nsecsElapsed() / 1.0e6;
+
+    qDebug() << "JSON:" << QFileInfo(jsonFile).size() << "bytes," << points.size()
+             << "points loaded in" << jsonMs << "ms";
+    qDebug() << "Binary:" << QFileInfo(binaryFile).size() << "bytes," << graph.nodeCount()
+             << "nodes mapped in" << binaryMs << "ms (checksum" << (qulonglong)checksum << ")";
+}
@@ -0,0 +1,35 @@
+#ifndef PATHGRAPHWRITER_H
+#define PATHGRAPHWRITER_H
+
+#include <QString>
+
+#include "facegraph.h"
+
+/**
+ * Writes the face graph of a mesh in the binary .pgraph layout described
+ * in pathgraphfile.h, the compact alternative to the path point JSON.
+ * Link weights and face normals are optional sections.
+ */
+class PathGraphWriter
+{
+public:
+    explicit PathGraphWriter();
+    void setWeights(bool enabled);
+    void setNormals(bool enabled);
+    bool write(const PolygonMesh* mesh, QString fileName);
+    //mesh is only read for the normals and may be NULL without them
+    bool write(const FaceGraph& graph, const PolygonMesh* mesh, QString fileName);
+
+    /**
+     * @brief compareWithJson
+     * Logs the size of both files and the time to load each one into
+     * arrays: QJsonDocument parsing versus mapping the binary graph.
+     */
+    static void compareWithJson(QString binaryFile, QString jsonFile);
+
+private:
+    bool mWeights;
+    bool mNormals;
+};
+
+#endif // PATHGRAPHWRITER_H
@@ -0,0 +1,387 @@
+#include "pathpointwriter.h"
+#include "parallel.h"
+
+#include <QFile>
+#include <QDebug>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <clocale>
+
+namespace {
+
+//Faces formatted by one task; a window of chunks is formatted, then written
+const long kChunkFaces = 8192;
+
+inline void append(std::string& out, const char* text)
+{
+    out.append(text);
+}
+
+//QCoreApplication adopts the system locale, which may use a decimal comma
+inline void fixDecimalPoint(char* buffer, int length)
+{
+    const char point = localeconv()->decimal_point[0];
+    if(point=='.')
+        return;
+    for(int i=0; i<length; i++)
+    {
+        if(buffer[i]==point)
+            buffer[i] = '.';
+    }
+}
+
+//10^n for the digit counts of a float
+const unsigned long long kPowers[11] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL
+};
+
+//Decimal powers over the whole float range and the 9 digits below it
+double powerOf10(int exponent)
+{
+    static const std::vector<double> powers = []() {
+        std::vector<double> table(128);
+        for(int i=0; i<128; i++)
+            table[i] = std::pow(10.0, i-64);
+        return table;
+    }();
+    return powers[exponent+64];
+}
+
+}
+
+PathPointWriter::PathPointWriter()
+{
+    mPretty = true;
+    mPortals = false;
+    mFaceComponent = NULL;
+    mFaceCosts = NULL;
+    mComponent = -1;
+}
+
+void PathPointWriter::setPretty(bool pretty)
+{
+    mPretty = pretty;
+}
+
+void PathPointWriter::setPortals(bool portals)
+{
+    mPortals = portals;
+}
+
+void PathPointWriter::setFaceCosts(const std::vector<float>* costs)
+{
+    mFaceCosts = costs;
+}
+
+void PathPointWriter::setFaceFilter(const std::vector<int>* faceComponent, int component)
+{
+    mFaceComponent = faceComponent;
+    mComponent = component;
+}
+
+int PathPointWriter::formatInteger(long value, char* buffer)
+{
+    char digits[24];
+    int n = 0;
+    unsigned long v = value<0 ? 0UL-(unsigned long)value : (unsigned long)value;
+    do {
+        digits[n++] = (char)('0' + v%10);
+        v /= 10;
+    } while(v!=0);
+    int length = 0;
+    if(value<0)
+        buffer[length++] = '-';
+    while(n>0)
+        buffer[length++] = digits[--n];
+    buffer[length] = '\0';
+    return length;
+}
+
+int PathPointWriter::formatFloat(float value, char* buffer)
+{
+    if(!std::isfinite(value))
+    {
+        strcpy(buffer, "null");
+        return 4;
+    }
+    int length = 0;
+    if(std::signbit(value))
+        buffer[length++] = '-';
+    if(value==0.0f)
+    {
+        buffer[length++] = '0';
+        buffer[length] = '\0';
+        return length;
+    }
+
+    //Any decimal strictly between the midpoints to the neighbouring floats
+    //reads back to value. Both midpoints are exact in double.
+    const float magnitude = std::fabs(value);
+    const double v = magnitude;
+    const double below = ((double)nextafterf(magnitude, 0.0f) + v) / 2;
+    const float next = nextafterf(magnitude, HUGE_VALF);
+    const double above = std::isinf(next) ? v + (v - below) : ((double)next + v) / 2;
+    //log10(2) times the binary exponent is at most one decade low
+    int binary = 0;
+    std::frexp(v, &binary);
+    int exponent = (int)std::floor((binary-1) * 0.30102999566398120);
+    if(powerOf10(exponent+1) <= v)
+        exponent++;
+
+    //Rounds to the nearest decimal with the given number of significant
+    //digits and checks that it lands in that interval
+    unsigned long long digits = 0;
+    int shift = 0;
+    auto roundsBack = [&](int precision) -> bool {
+        digits = (unsigned long long)(v * powerOf10(precision-1-exponent) + 0.5);
+        //Rounded up to the next power of ten, e.g. 9.99 to 10
+        shift = digits==kPowers[precision] ? 1 : 0;
+        if(shift)
+            digits /= 10;
+        const double candidate = (double)digits * powerOf10(exponent+shift-precision+1);
+        //Scaling in double is off by a few ulp; let strtof settle near-ties
+        const double margin = v * 1e-15;
+        if(candidate > below + margin && candidate < above - margin)
+            return true;
+        if(std::fabs(candidate-below) > margin && std::fabs(candidate-above) > margin)
+            return false;
+        char check[32];
+        snprintf(check, sizeof(check), "%llue%d", digits, exponent+shift-precision+1);
+        return strtof(check, NULL)==magnitude;
+    };
+
+    //Most coordinates need 6 to 9 digits, so search outwards from 6
+    int precision = 6;
+    if(roundsBack(precision))
+    {
+        unsigned long long shortest = digits;
+        int shortestShift = shift;
+        while(precision>1 && roundsBack(precision-1))
+        {
+            precision--;
+            shortest = digits;
+            shortestShift = shift;
+        }
+        digits = shortest;
+        shift = shortestShift;
+    }
+    else
+    {
+        for(precision=7; precision<=9; precision++)
+        {
+            if(roundsBack(precision))
+                break;
+        }
+    }
+    if(precision>9)
+    {
+        length += snprintf(buffer+length, 32-length, "%.9g", v);
+        fixDecimalPoint(buffer, length);
+        return length;
+    }
+    exponent += shift;
+    while(precision>1 && digits%10==0)
+    {
+        digits /= 10;
+        precision--;
+    }
+
+    char text[10];
+    for(int i=precision-1; i>=0; i--)
+    {
+        text[i] = (char)('0' + digits%10);
+        digits /= 10;
+    }
+    //Plain notation for typical coordinates, exponent notation otherwise
+    const int point = exponent + 1;
+    if(exponent<-4 || exponent>=9)
+    {
+        buffer[length++] = text[0];
+        if(precision>1)
+        {
+            buffer[length++] = '.';
+            memcpy(buffer+length, text+1, precision-1);
+            length += precision-1;
+        }
+        length += snprintf(buffer+length, 32-length, "e%d", exponent);
+        return length;
+    }
+    if(point<=0)
+    {
+        buffer[length++] = '0';
+        buffer[length++] = '.';
+        for(int i=point; i<0; i++)
+            buffer[length++] = '0';
+        memcpy(buffer+length, text, precision);
+        length += precision;
+    }
+    else if(point>=precision)
+    {
+        memcpy(buffer+length, text, precision);
+        length += precision;
+        for(int i=precision; i<point; i++)
+            buffer[length++] = '0';
+    }
+    else
+    {
+        memcpy(buffer+length, text, point);
+        length += point;
+        buffer[length++] = '.';
+        memcpy(buffer+length, text+point, precision-point);
+        length += precision-point;
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+const char* PathPointWriter::header() const
+{
+    return mPretty ? "{\n    \"pedestrian_path_points\": [\n"
+                   : "{\"pedestrian_path_points\":[";
+}
+
+const char* PathPointWriter::footer(bool empty) const
+{
+    if(!mPretty)
+        return "]}";
+    return empty ? "    ]\n}\n" : "\n    ]\n}\n";
+}
+
+void PathPointWriter::formatFace(PolygonMesh::HE_face* face, std::string& out) const
+{
+    char number[32];
+    const long index = face->index;
+
+    append(out, mPretty ? "        {\n" : "{");
+    if(mFaceCosts!=NULL)
+    {
+        append(out, mPretty ? "            \"cost\": " : "\"cost\":");
+        out.append(number, formatFloat(mFaceCosts->at(index-1), number));
+        append(out, mPretty ? ",\n" : ",");
+    }
+    append(out, mPretty ? "            \"index\": " : "\"index\":");
+    out.append(number, formatInteger(index, number));
+    append(out, mPretty ? ",\n            \"linked_indexes\": [\n" : ",\"linked_indexes\":[");
+
+    //Neighbours across every twinned edge, starting at face->edge and going backwards
+    bool first = true;
+    PolygonMesh::HE_edge* curr = face->edge;
+    while(curr!=NULL)
+    {
+        if(curr->pair!=NULL && (mFaceComponent==NULL ||
+                                mFaceComponent->at(curr->pair->face->index-1)==mComponent))
+        {
+            if(!first)
+                append(out, mPretty ? ",\n" : ",");
+            first = false;
+            append(out, mPretty ? "                {\n                    \"end_index\": "
+                                : "{\"end_index\":");
+            out.append(number, formatInteger(curr->pair->face->index, number));
+            if(mPortals)
+            {
+                const PolygonMesh::HE_vert* ends[2] = {curr->prev->vert, curr->vert};
+                append(out, mPretty ? ",\n                    \"portal\": [\n" : ",\"portal\":[");
+                for(int k=0; k<6; k++)
+                {
+                    const PolygonMesh::HE_vert* v = ends[k/3];
+                    const float value = k%3==0 ? v->x : (k%3==1 ? v->y : v->z);
+                    if(mPretty)
+                        append(out, "                        ");
+                    out.append(number, formatFloat(value, number));
+                    if(k<5)
+                        append(out, mPretty ? ",\n" : ",");
+                }
+                append(out, mPretty ? "\n                    ]" : "]");
+            }
+            append(out, mPretty ? ",\n                    \"start_index\": " : ",\"start_index\":");
+            out.append(number, formatInteger(index, number));
+            append(out, mPretty ? "\n                }" : "}");
+        }
+        curr = curr->prev;
+        if(curr==face->edge)
+            break;
+    }
+    if(mPretty)
+        append(out, first ? "            ],\n" : "\n            ],\n");
+    else
+        append(out, "],");
+
+    const float coords[3] = {face->centroid->x, face->centroid->y, face->centroid->z};
+    const char* keys[3] = {"\"x\"", "\"y\"", "\"z\""};
+    for(int a=0; a<3; a++)
+    {
+        if(mPretty)
+            append(out, "            ");
+        append(out, keys[a]);
+        append(out, mPretty ? ": " : ":");
+        out.append(number, formatFloat(coords[a], number));
+        if(a<2)
+            append(out, mPretty ? ",\n" : ",");
+    }
+    append(out, mPretty ? "\n        }" : "}");
+}
+
+long PathPointWriter::formatFaces(const PolygonMesh* mesh, long from, long to, std::string& out) const
+{
+    long written = 0;
+    for(long f=from; f<to; f++)
+    {
+        PolygonMesh::HE_face* face = mesh->faceVector->at(f);
+        if(face->edge==NULL || face->centroid==NULL)
+            continue;
+        if(mFaceComponent!=NULL && mFaceComponent->at(face->index-1)!=mComponent)
+            continue;
+        append(out, mPretty ? ",\n" : ",");
+        formatFace(face, out);
+        written++;
+    }
+    return written;
+}
+
+bool PathPointWriter::write(const PolygonMesh* mesh, QString fileName)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Unable to write path points:" << file.errorString();
+        return false;
+    }
+
+    const long faceCount = (long)mesh->faceVector->size();
+    const long chunkCount = (faceCount + kChunkFaces - 1) / kChunkFaces;
+    //Two chunks per thread keep the workers busy while bounding memory
+    const long window = qMax(1L, (long)parallelThreadCount()*2);
+    std::vector<std::string> buffers((size_t)qMin(window, qMax(1L, chunkCount)));
+    std::vector<long> counts(buffers.size());
+
+    bool ok = file.write(header(), strlen(header())) >= 0;
+    long written = 0;
+    for(long first=0; ok && first<chunkCount; first+=window)
+    {
+        const long count = qMin(window, chunkCount-first);
+        parallelFor(0, count, 1, [&](long from, long to) {
+            for(long c=from; c<to; c++)
+            {
+                const long begin = (first+c)*kChunkFaces;
+                buffers[c].clear();
+                counts[c] = formatFaces(mesh, begin, qMin(faceCount, begin+kChunkFaces), buffers[c]);
+            }
+        });
+        //Concatenate in face order; the first object has no separator in front of it
+        for(long c=0; ok && c<count; c++)
+        {
+            size_t skip = 0;
+            if(written==0 && counts[c]>0)
+                skip = mPretty ? 2 : 1;
+            written += counts[c];
+            ok = file.write(buffers[c].data()+skip, buffers[c].size()-skip) >= 0;
+        }
+    }
+    if(ok)
+        ok = file.write(footer(written==0), strlen(footer(written==0))) >= 0;
+    file.close();
+    return ok;
+}
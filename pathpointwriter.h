@@ -0,0 +1,61 @@
+#ifndef PATHPOINTWRITER_H
+#define PATHPOINTWRITER_H
+
+#include <QString>
+#include <string>
+#include <vector>
+
+#include "trianglemesh.h"
+
+/**
+ * Streams the pedestrian_path_points JSON of a mesh to a file, one object
+ * per face, without building a QJsonDocument.
+ *
+ * The schema and key order are the ones QJsonDocument produced:
+ * {"pedestrian_path_points":[{"index","linked_indexes":[{"end_index",
+ * "start_index"}],"x","y","z"}]}. Pretty mode reproduces the layout of
+ * QJsonDocument::Indented, compact mode drops all whitespace. Coordinates
+ * are written with the fewest digits that read back to the same float.
+ * With portals enabled every link also carries the shared edge as
+ * "portal": [x1,y1,z1,x2,y2,z2].
+ *
+ * write() formats ranges of faces into separate buffers in parallel and
+ * writes them in face order, so the file is identical to a sequential run.
+ */
+class PathPointWriter
+{
+public:
+    explicit PathPointWriter();
+    void setPretty(bool pretty);
+    //Only faces whose entry in faceComponent equals component are written and linked
+    void setFaceFilter(const std::vector<int>* faceComponent, int component);
+    //Writes "cost" per face, indexed by face->index-1
+    void setFaceCosts(const std::vector<float>* costs);
+    void setPortals(bool portals);
+    bool write(const PolygonMesh* mesh, QString fileName);
+
+    /**
+     * @brief formatFaces
+     * Appends the objects of faces [from,to) of faceVector to out, each
+     * preceded by the array separator.
+     * @return number of faces written
+     */
+    long formatFaces(const PolygonMesh* mesh, long from, long to, std::string& out) const;
+
+    //Shortest decimal that parses back to value; returns the length
+    static int formatFloat(float value, char* buffer);
+    static int formatInteger(long value, char* buffer);
+
+private:
+    void formatFace(PolygonMesh::HE_face* face, std::string& out) const;
+    const char* header() const;
+    const char* footer(bool empty) const;
+
+    bool mPretty;
+    bool mPortals;
+    const std::vector<int>* mFaceComponent;
+    const std::vector<float>* mFaceCosts;
+    int mComponent;
+};
+
+#endif // PATHPOINTWRITER_H
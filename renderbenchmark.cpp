@@ -0,0 +1,235 @@
+#include "renderbenchmark.h"
+#include "mfileparser.h"
+#include "meshreorder.h"
+
+#include <QtOpenGL>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+
+RenderBenchmark::RenderBenchmark()
+{
+    mOutputFile = "benchmark.json";
+    mFrames = 360;
+    mWarmupFrames = 10;
+    mWidth = 1024;
+    mHeight = 768;
+    mReorder = false;
+}
+
+void RenderBenchmark::setModelFile(QString fileName){
+    mModelFile = fileName;
+}
+
+void RenderBenchmark::setOutputFile(QString fileName){
+    mOutputFile = fileName;
+}
+
+void RenderBenchmark::setFrameCount(int frames){
+    mFrames = qMax(1,frames);
+}
+
+void RenderBenchmark::setWarmupFrames(int frames){
+    mWarmupFrames = qMax(0,frames);
+}
+
+void RenderBenchmark::setViewportSize(int w, int h){
+    mWidth = qMax(1,w);
+    mHeight = qMax(1,h);
+}
+
+void RenderBenchmark::setReorder(bool reorder){
+    mReorder = reorder;
+}
+
+const char* RenderBenchmark::renderTypeName(ViewPortWidget::RENDER_TYPE type)
+{
+    switch(type)
+    {
+    case ViewPortWidget::POINTS:
+        return "POINTS";
+    case ViewPortWidget::WIREFRAME:
+        return "WIREFRAME";
+    case ViewPortWidget::FLAT_SHADING:
+        return "FLAT_SHADING";
+    case ViewPortWidget::SMOOTH_SHADING:
+        return "SMOOTH_SHADING";
+    }
+    return "UNKNOWN";
+}
+
+int RenderBenchmark::run()
+{
+    if(!QFileInfo(mModelFile).isReadable())
+    {
+        qCritical() << "Benchmark model not readable:" << mModelFile;
+        return 1;
+    }
+
+    QElapsedTimer loadTimer;
+    loadTimer.start();
+    OBJFileParser parser;
+    PolygonMesh* mesh = parser.parseFile(mModelFile);
+    qint64 loadMs = loadTimer.elapsed();
+    if(mesh==NULL)
+    {
+        qCritical() << "Benchmark model could not be parsed:" << mModelFile;
+        return 1;
+    }
+    MeshReorder::Stats reorderStats;
+    if(mReorder)
+        reorderStats = MeshReorder::optimize(mesh);
+    //Owns the mesh from here on, also on the early returns
+    MeshSnapshot snapshot(mesh);
+
+    ViewPortWidget viewport;
+    viewport.resize(mWidth,mHeight);
+    viewport.show();
+    QCoreApplication::processEvents();
+    if(!viewport.isValid())
+    {
+        qCritical() << "No OpenGL context available for the benchmark";
+        return 1;
+    }
+    viewport.setMesh(snapshot);
+
+    viewport.makeCurrent();
+    QJsonObject result;
+    result["model"] = QFileInfo(mModelFile).absoluteFilePath();
+    result["edges"] = (qint64)mesh->edgeVector->size();
+    result["load_ms"] = loadMs;
+    if(mReorder)
+    {
+        QJsonObject reorder;
+        reorder["reorder_ms"] = reorderStats.reorderMs;
+        reorder["traversal_ms_before"] = reorderStats.traversalMsBefore;
+        reorder["traversal_ms_after"] = reorderStats.traversalMsAfter;
+        reorder["acmr_before"] = reorderStats.acmrBefore;
+        reorder["acmr_after"] = reorderStats.acmrAfter;
+        result["reorder"] = reorder;
+    }
+    result["width"] = mWidth;
+    result["height"] = mHeight;
+    result["frames"] = mFrames;
+    result["warmup_frames"] = mWarmupFrames;
+    result["gl_vendor"] = QString((const char*)glGetString(GL_VENDOR));
+    result["gl_renderer"] = QString((const char*)glGetString(GL_RENDERER));
+    result["gl_version"] = QString((const char*)glGetString(GL_VERSION));
+
+    QJsonArray modes;
+    const ViewPortWidget::RENDER_TYPE types[] = {
+        ViewPortWidget::POINTS,
+        ViewPortWidget::WIREFRAME,
+        ViewPortWidget::FLAT_SHADING,
+        ViewPortWidget::SMOOTH_SHADING
+    };
+    for(int t=0; t<4; t++)
+    {
+        modes.append(runRenderType(&viewport,types[t]));
+    }
+    result["render_types"] = modes;
+
+    QFile file(mOutputFile);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qCritical() << "Unable to write benchmark results:" << file.errorString();
+        return 1;
+    }
+    file.write(QJsonDocument(result).toJson(QJsonDocument::Indented));
+    file.close();
+    qDebug() << "Benchmark written to" << mOutputFile;
+    return 0;
+}
+
+/**
+ * @brief applyOrbit
+ * Moves the camera to the given frame of a full yaw orbit with a gentle
+ * pitch and zoom oscillation. Only depends on the frame number.
+ */
+void RenderBenchmark::applyOrbit(ViewPortWidget* viewport, int frame, float* zoom)
+{
+    const float phase = 2.0f * (float)M_PI * frame / mFrames;
+    viewport->setXAxisRotation(22.0f + 15.0f * sin(phase));
+    viewport->setYAxisRotation(360.0f * frame / mFrames);
+
+    //changeCameraZoom is relative, so apply the delta to the target zoom
+    float target = 2.0f * sin(phase);
+    viewport->changeCameraZoom(target - *zoom);
+    *zoom = target;
+}
+
+QJsonObject RenderBenchmark::runRenderType(ViewPortWidget* viewport,
+                                           ViewPortWidget::RENDER_TYPE type)
+{
+    //Suppress the repaint each setter triggers; frames are painted explicitly
+    viewport->setUpdatesEnabled(false);
+    viewport->setRenderType(type);
+    viewport->setPerspectiveProjection(true);
+
+    std::vector<double> times;
+    times.reserve(mFrames);
+    QJsonArray frameTimes;
+    QJsonArray drawCalls;
+    QJsonArray vertices;
+    float zoom = 0.0f;
+
+    QElapsedTimer timer;
+    for(int i=-mWarmupFrames; i<mFrames; i++)
+    {
+        viewport->setUpdatesEnabled(false);
+        applyOrbit(viewport, qMax(i,0), &zoom);
+        viewport->setUpdatesEnabled(true);
+
+        timer.start();
+        viewport->updateGL();
+        viewport->makeCurrent();
+        glFinish();
+        double ms = timer.nsecsElapsed() / 1.0e6;
+
+        if(i<0)
+            continue;
+
+        ViewPortWidget::FrameStats stats = viewport->lastFrameStats();
+        times.push_back(ms);
+        frameTimes.append(ms);
+        drawCalls.append((qint64)stats.drawCalls);
+        vertices.append((qint64)stats.vertices);
+    }
+
+    std::vector<double> sorted(times);
+    std::sort(sorted.begin(),sorted.end());
+    double total = 0.0;
+    for(size_t i=0; i<sorted.size(); i++)
+        total += sorted[i];
+
+    QJsonObject obj;
+    obj["render_type"] = QString(renderTypeName(type));
+    obj["total_ms"] = total;
+    obj["mean_ms"] = total / sorted.size();
+    obj["min_ms"] = sorted.front();
+    obj["p50_ms"] = percentile(sorted,0.50);
+    obj["p90_ms"] = percentile(sorted,0.90);
+    obj["p95_ms"] = percentile(sorted,0.95);
+    obj["p99_ms"] = percentile(sorted,0.99);
+    obj["max_ms"] = sorted.back();
+    obj["frame_times_ms"] = frameTimes;
+    obj["draw_calls"] = drawCalls;
+    obj["vertices"] = vertices;
+
+    qDebug() << renderTypeName(type) << ": mean" << obj["mean_ms"].toDouble()
+             << "ms, p95" << obj["p95_ms"].toDouble() << "ms";
+    return obj;
+}
+
+//Nearest-rank percentile of an ascending list
+double RenderBenchmark::percentile(const std::vector<double>& sorted, double p)
+{
+    if(sorted.empty())
+        return 0.0;
+    size_t rank = (size_t)ceil(p * sorted.size());
+    if(rank<1) rank = 1;
+    if(rank>sorted.size()) rank = sorted.size();
+    return sorted[rank-1];
+}
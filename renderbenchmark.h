@@ -0,0 +1,43 @@
+#ifndef RENDERBENCHMARK_H
+#define RENDERBENCHMARK_H
+
+#include <QString>
+#include <QJsonObject>
+#include <vector>
+
+#include "viewportwidget.h"
+
+/**
+ * Loads a mesh and replays a deterministic camera orbit through the
+ * ViewPortWidget for every render type, writing per-frame timings to JSON.
+ */
+class RenderBenchmark
+{
+public:
+    RenderBenchmark();
+    void setModelFile(QString fileName);
+    void setOutputFile(QString fileName);
+    void setFrameCount(int frames);
+    void setWarmupFrames(int frames);
+    void setViewportSize(int w, int h);
+    void setReorder(bool reorder);
+    int run();
+
+    static const char* renderTypeName(ViewPortWidget::RENDER_TYPE type);
+
+private:
+    QJsonObject runRenderType(ViewPortWidget* viewport,
+                              ViewPortWidget::RENDER_TYPE type);
+    void applyOrbit(ViewPortWidget* viewport, int frame, float* zoom);
+    static double percentile(const std::vector<double>& sorted, double p);
+
+    QString mModelFile;
+    QString mOutputFile;
+    int mFrames;
+    int mWarmupFrames;
+    int mWidth;
+    int mHeight;
+    bool mReorder;
+};
+
+#endif // RENDERBENCHMARK_H
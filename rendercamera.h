@@ -0,0 +1,19 @@
+#ifndef RENDERCAMERA_H
+#define RENDERCAMERA_H
+
+//View parameters shared by ViewPortWidget and the software rasterizer.
+//Rotations are in degrees and applied as glRotatef X, then Y, then Z
+//after translating by the eye position.
+struct RenderCamera {
+    float xRotation;
+    float yRotation;
+    float zRotation;
+    float eyeX;
+    float eyeY;
+    float eyeZ;
+    bool perspective;
+    float lightDistance;
+    bool multipleLights;
+};
+
+#endif // RENDERCAMERA_H
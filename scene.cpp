@@ -0,0 +1,286 @@
+#include "scene.h"
+#include "mfileparser.h"
+#include "meshreorder.h"
+#include "parallel.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <map>
+#include <cfloat>
+
+namespace {
+
+bool readVector(const QJsonValue& value, float* out, int count)
+{
+    QJsonArray array = value.toArray();
+    if(array.size()!=count)
+        return false;
+    for(int i=0; i<count; i++)
+        out[i] = (float)array.at(i).toDouble();
+    return true;
+}
+
+/**
+ * @brief readPlacement
+ * Model matrix of one placement, converted to the viewer's coordinates:
+ * the parser mirrors x, so a placement M given in OBJ coordinates becomes
+ * C*M*C with C = diag(-1,1,1).
+ */
+bool readPlacement(const QJsonObject& placement, QMatrix4x4* matrix)
+{
+    QMatrix4x4 m;
+    if(placement.contains("matrix"))
+    {
+        float v[16];
+        if(!readVector(placement.value("matrix"), v, 16))
+            return false;
+        m = QMatrix4x4(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7],
+                       v[8], v[9], v[10], v[11], v[12], v[13], v[14], v[15]);
+    }
+    else
+    {
+        float position[3] = {0.0f, 0.0f, 0.0f};
+        float rotation[3] = {0.0f, 0.0f, 0.0f};
+        float scale[3] = {1.0f, 1.0f, 1.0f};
+        if(placement.contains("position") && !readVector(placement.value("position"), position, 3))
+            return false;
+        if(placement.contains("rotation") && !readVector(placement.value("rotation"), rotation, 3))
+            return false;
+        if(placement.contains("scale"))
+        {
+            QJsonValue value = placement.value("scale");
+            if(value.isArray())
+            {
+                if(!readVector(value, scale, 3))
+                    return false;
+            }
+            else
+                scale[0] = scale[1] = scale[2] = (float)value.toDouble();
+        }
+        m.translate(position[0], position[1], position[2]);
+        m.rotate(rotation[1], 0.0f, 1.0f, 0.0f);
+        m.rotate(rotation[0], 1.0f, 0.0f, 0.0f);
+        m.rotate(rotation[2], 0.0f, 0.0f, 1.0f);
+        m.scale(scale[0], scale[1], scale[2]);
+    }
+
+    const QMatrix4x4 mirror(-1.0f, 0.0f, 0.0f, 0.0f,
+                             0.0f, 1.0f, 0.0f, 0.0f,
+                             0.0f, 0.0f, 1.0f, 0.0f,
+                             0.0f, 0.0f, 0.0f, 1.0f);
+    *matrix = mirror * m * mirror;
+    return true;
+}
+
+}
+
+long Scene::instanceCount() const
+{
+    long count = 0;
+    for(size_t i=0; i<objects.size(); i++)
+        count += (long)objects[i].transforms.size();
+    return count;
+}
+
+long Scene::triangleCount() const
+{
+    long count = 0;
+    for(size_t i=0; i<objects.size(); i++)
+        count += objects[i].triangles->triangleCount() * (long)objects[i].transforms.size();
+    return count;
+}
+
+SceneLoader::SceneLoader()
+{
+    mWeldEpsilon = 0.0f;
+    mReorder = false;
+    mFileCount = 0;
+    mSharedFiles = 0;
+}
+
+Scene* SceneLoader::fail(QString error)
+{
+    mError = error;
+    qWarning() << "Cannot load scene:" << error;
+    return NULL;
+}
+
+Scene* SceneLoader::load(QString sceneFile)
+{
+    QElapsedTimer timer;
+    timer.start();
+    mError = QString();
+    mFileCount = 0;
+    mSharedFiles = 0;
+
+    QFile file(sceneFile);
+    if(!file.open(QIODevice::ReadOnly))
+        return fail(file.errorString());
+    QJsonParseError parseError;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+    file.close();
+    if(document.isNull())
+        return fail(parseError.errorString());
+
+    //Placements grouped by file
+    QDir dir = QFileInfo(sceneFile).dir();
+    std::map<QString,int> pathIndex;
+    std::vector<QString> paths;
+    std::vector<std::vector<QMatrix4x4> > placements;
+    QJsonArray entries = document.object().value("objects").toArray();
+    for(int e=0; e<entries.size(); e++)
+    {
+        QJsonObject entry = entries.at(e).toObject();
+        QString name = entry.value("file").toString();
+        QString path = QFileInfo(dir.filePath(name)).canonicalFilePath();
+        if(path.isEmpty())
+            return fail(QString("missing file %1").arg(name));
+
+        std::map<QString,int>::iterator it = pathIndex.find(path);
+        if(it==pathIndex.end())
+        {
+            it = pathIndex.insert(std::make_pair(path, (int)paths.size())).first;
+            paths.push_back(path);
+            placements.push_back(std::vector<QMatrix4x4>());
+        }
+        std::vector<QMatrix4x4>& matrices = placements[it->second];
+
+        QJsonArray instances = entry.value("instances").toArray();
+        if(instances.size()==0)
+        {
+            QMatrix4x4 m;
+            if(!readPlacement(entry, &m))
+                return fail(QString("bad placement for %1").arg(name));
+            matrices.push_back(m);
+        }
+        for(int i=0; i<instances.size(); i++)
+        {
+            QMatrix4x4 m;
+            if(!readPlacement(instances.at(i).toObject(), &m))
+                return fail(QString("bad placement %1 for %2").arg(i).arg(name));
+            matrices.push_back(m);
+        }
+    }
+    mFileCount = (int)paths.size();
+
+    //Identical pieces saved under different names become one object
+    std::vector<QByteArray> hashes(paths.size());
+    parallelFor(0, (long)paths.size(), 1, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            QFile piece(paths[i]);
+            QCryptographicHash hash(QCryptographicHash::Sha1);
+            if(piece.open(QIODevice::ReadOnly) && hash.addData(&piece))
+                hashes[i] = hash.result();
+        }
+    });
+
+    Scene* scene = new Scene();
+    std::map<QByteArray,int> objectIndex;
+    for(size_t i=0; i<paths.size(); i++)
+    {
+        if(hashes[i].isEmpty())
+        {
+            delete scene;
+            return fail(QString("cannot read %1").arg(paths[i]));
+        }
+        std::map<QByteArray,int>::iterator it = objectIndex.find(hashes[i]);
+        if(it==objectIndex.end())
+        {
+            it = objectIndex.insert(std::make_pair(hashes[i], (int)scene->objects.size())).first;
+            SceneObject object;
+            object.file = paths[i];
+            object.contentHash = hashes[i];
+            scene->objects.push_back(object);
+        }
+        else
+            mSharedFiles++;
+        std::vector<QMatrix4x4>& transforms = scene->objects[it->second].transforms;
+        transforms.insert(transforms.end(), placements[i].begin(), placements[i].end());
+    }
+
+    //One task per distinct mesh; the parser's own loops share the pool
+    parallelFor(0, (long)scene->objects.size(), 1, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            SceneObject& object = scene->objects[i];
+            OBJFileParser parser;
+            parser.setCancellationToken(mToken);
+            parser.setWeldEpsilon(mWeldEpsilon);
+            PolygonMesh* mesh = parser.parseFile(object.file);
+            if(mesh==NULL)
+                continue;
+            if(mReorder)
+                MeshReorder::optimize(mesh);
+            object.triangles = QSharedPointer<const LodLevel>(MeshLod::baseLevel(mesh));
+            object.mesh = MeshSnapshot(mesh);
+        }
+    }, &mToken);
+
+    scene->min = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+    scene->max = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for(size_t i=0; i<scene->objects.size(); i++)
+    {
+        const SceneObject& object = scene->objects[i];
+        if(object.mesh.isNull())
+        {
+            QString name = object.file;
+            delete scene;
+            return fail(QString("cannot parse %1").arg(name));
+        }
+        const QVector3D& lo = *object.mesh->minVector;
+        const QVector3D& hi = *object.mesh->maxVector;
+        for(size_t t=0; t<object.transforms.size(); t++)
+        {
+            for(int c=0; c<8; c++)
+            {
+                QVector3D corner((c&1) ? hi.x() : lo.x(), (c&2) ? hi.y() : lo.y(), (c&4) ? hi.z() : lo.z());
+                QVector3D p = object.transforms[t].map(corner);
+                scene->min = QVector3D(qMin(scene->min.x(), p.x()), qMin(scene->min.y(), p.y()), qMin(scene->min.z(), p.z()));
+                scene->max = QVector3D(qMax(scene->max.x(), p.x()), qMax(scene->max.y(), p.y()), qMax(scene->max.z(), p.z()));
+            }
+        }
+    }
+
+    qDebug() << "Scene" << sceneFile << ":" << scene->instanceCount() << "instances of"
+             << (int)scene->objects.size() << "meshes from" << mFileCount << "files loaded in"
+             << timer.elapsed() << "ms";
+    return scene;
+}
+
+QString SceneLoader::error() const
+{
+    return mError;
+}
+
+void SceneLoader::setCancellationToken(const CancellationToken& token)
+{
+    mToken = token;
+}
+
+void SceneLoader::setWeldEpsilon(float epsilon)
+{
+    mWeldEpsilon = epsilon;
+}
+
+void SceneLoader::setReorder(bool reorder)
+{
+    mReorder = reorder;
+}
+
+int SceneLoader::fileCount() const
+{
+    return mFileCount;
+}
+
+int SceneLoader::sharedFileCount() const
+{
+    return mSharedFiles;
+}
@@ -0,0 +1,90 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <vector>
+
+#include "trianglemesh.h"
+#include "meshlod.h"
+
+/**
+ * One distinct mesh of a scene and every place it is drawn. Files with the
+ * same contents share one object, so a prop that is placed a thousand
+ * times is parsed, stored and uploaded once.
+ */
+struct SceneObject {
+    //First file that had these contents
+    QString file;
+    QByteArray contentHash;
+    MeshSnapshot mesh;
+    //Triangulated draw arrays shared by all instances
+    QSharedPointer<const LodLevel> triangles;
+    //Model matrices in viewer coordinates, one per instance
+    std::vector<QMatrix4x4> transforms;
+};
+
+class Scene
+{
+public:
+    std::vector<SceneObject> objects;
+    //World-space bounds of all instances
+    QVector3D min;
+    QVector3D max;
+
+    long instanceCount() const;
+    long triangleCount() const;
+};
+
+/**
+ * Loads a scene file: a JSON list of OBJ files with per-instance
+ * placements.
+ *
+ *   {"objects": [
+ *     {"file": "hall.obj"},
+ *     {"file": "props/crate.obj", "position": [2,0,1], "rotation": [0,45,0], "scale": 0.5},
+ *     {"file": "props/lamp.obj", "instances": [
+ *       {"position": [0,0,4]},
+ *       {"matrix": [1,0,0,8, 0,1,0,0, 0,0,1,4, 0,0,0,1]}]}
+ *   ]}
+ *
+ * File names are relative to the scene file. A placement is a row-major
+ * "matrix" or position, rotation (degrees, applied z, x, then y) and a
+ * uniform or per-axis scale, all in OBJ coordinates. An object without
+ * placements is drawn once at the origin.
+ *
+ * The files are hashed and the distinct contents parsed concurrently on
+ * the shared thread pool, then welded and reordered like a single OBJ.
+ */
+class SceneLoader
+{
+public:
+    explicit SceneLoader();
+    //NULL with error() set if the scene or one of its files cannot be read
+    Scene* load(QString sceneFile);
+    QString error() const;
+    //Skips and stops parsing the remaining files once token is cancelled
+    void setCancellationToken(const CancellationToken& token);
+    //Same load settings as a single mesh, applied to every distinct file
+    void setWeldEpsilon(float epsilon);
+    void setReorder(bool reorder);
+
+    //Distinct file paths referenced by the last scene
+    int fileCount() const;
+    //Files whose contents were identical to an earlier one
+    int sharedFileCount() const;
+
+private:
+    Scene* fail(QString error);
+
+    QString mError;
+    CancellationToken mToken;
+    float mWeldEpsilon;
+    bool mReorder;
+    int mFileCount;
+    int mSharedFiles;
+};
+
+#endif // SCENE_H
@@ -0,0 +1,635 @@
+#include "softwarerasterizer.h"
+#include "mfileparser.h"
+#include "parallel.h"
+#include "meshbuffers.h"
+
+#include <QMatrix4x4>
+#include <QFileInfo>
+#include <QDir>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+namespace {
+
+struct Light {
+    float dir[3];
+    float diffuse[3];
+    float specular[3];
+};
+
+void normalize3(float* v)
+{
+    float len = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+    if(len>0.0f)
+    {
+        v[0] /= len;
+        v[1] /= len;
+        v[2] /= len;
+    }
+}
+
+/**
+ * @brief shade
+ * Fixed-function lighting as configured by ViewPortWidget::setLightingParams
+ * with lighting and colour material enabled. n is an eye-space normal.
+ */
+void shade(const RenderCamera& camera, const float* normal, float* rgb)
+{
+    static const float materialDiffuse = 0.5f;
+    static const float materialEmission = 0.1f;
+    static const float materialSpecular[3] = {0.0f, 0.0f, 1.0f};
+    static const float shininess = 10.0f;
+    static const float globalAmbient[3] = {1.0f, 0.1f, 0.1f};
+
+    Light lights[4] = {
+        {{1.0f, 1.0f, camera.lightDistance}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f, 1.0f}},
+        {{1.0f, -10.0f, -5.0f}, {0.1f, 0.1f, 0.4f}, {0.1f, 0.1f, 0.4f}},
+        {{3.0f, 10.0f, 3.0f}, {0.4f, 0.1f, 0.1f}, {0.4f, 0.1f, 0.1f}},
+        {{-5.0f, -10.0f, 5.0f}, {0.1f, 0.2f, 0.1f}, {0.0f, 0.0f, 0.0f}}
+    };
+    int lightCount = camera.multipleLights ? 4 : 1;
+
+    float n[3] = {normal[0], normal[1], normal[2]};
+    normalize3(n);
+
+    for(int c=0; c<3; c++)
+        rgb[c] = materialEmission + globalAmbient[c]*materialDiffuse;
+
+    for(int i=0; i<lightCount; i++)
+    {
+        float* l = lights[i].dir;
+        normalize3(l);
+        float ndotl = n[0]*l[0] + n[1]*l[1] + n[2]*l[2];
+        if(ndotl<=0.0f)
+            continue;
+
+        float h[3] = {l[0], l[1], l[2] + 1.0f};
+        normalize3(h);
+        float ndoth = qMax(0.0f, n[0]*h[0] + n[1]*h[1] + n[2]*h[2]);
+        float spec = pow(ndoth, shininess);
+        for(int c=0; c<3; c++)
+        {
+            rgb[c] += ndotl * materialDiffuse * lights[i].diffuse[c];
+            rgb[c] += spec * materialSpecular[c] * lights[i].specular[c];
+        }
+    }
+
+    for(int c=0; c<3; c++)
+        rgb[c] = qBound(0.0f, rgb[c], 1.0f);
+}
+
+}
+
+SoftwareRasterizer::SoftwareRasterizer(int width, int height)
+{
+    mWidth = qMax(1,width);
+    mHeight = qMax(1,height);
+    mThreaded = true;
+    setTileSize(64);
+}
+
+void SoftwareRasterizer::setTileSize(int size)
+{
+    //Keep tiles a multiple of the 4-wide SIMD step
+    mTileSize = qMax(4, (size+3) & ~3);
+    mTilesX = (mWidth + mTileSize - 1) / mTileSize;
+    mTilesY = (mHeight + mTileSize - 1) / mTileSize;
+}
+
+void SoftwareRasterizer::setThreaded(bool threaded)
+{
+    mThreaded = threaded;
+}
+
+void SoftwareRasterizer::runParallel(long begin, long end, long grain,
+                                     const std::function<void(long,long)>& body)
+{
+    if(mThreaded)
+        parallelFor(begin,end,grain,body);
+    else if(end>begin)
+        body(begin,end);
+}
+
+QImage SoftwareRasterizer::render(const PolygonMesh* mesh,
+                                  const RenderCamera& camera,
+                                  ViewPortWidget::RENDER_TYPE type)
+{
+    //Same clear colour as ViewPortWidget::initializeGL
+    mColor.assign((size_t)mWidth*mHeight, QColor(Qt::gray).rgb());
+    mDepth.assign((size_t)mWidth*mHeight, 1.0f);
+
+    if(mesh!=NULL)
+    {
+        transformVertices(mesh,camera,type);
+        buildPrimitives(mesh,camera,type);
+        binPrimitives();
+        runParallel(0, (long)mTilesX*mTilesY, 1, [this](long from, long to) {
+            for(long t=from; t<to; t++)
+                rasterizeTile(t);
+        });
+    }
+
+    return QImage(reinterpret_cast<const uchar*>(mColor.data()),
+                  mWidth, mHeight, mWidth*4, QImage::Format_RGB32).copy();
+}
+
+bool SoftwareRasterizer::renderToFile(const PolygonMesh* mesh,
+                                      const RenderCamera& camera,
+                                      ViewPortWidget::RENDER_TYPE type,
+                                      QString pngFile)
+{
+    return render(mesh,camera,type).save(pngFile,"PNG");
+}
+
+void SoftwareRasterizer::transformVertices(const PolygonMesh* mesh,
+                                           const RenderCamera& camera,
+                                           ViewPortWidget::RENDER_TYPE type)
+{
+    //Mirror ViewPortWidget::setProjection and paintGL/draw
+    QMatrix4x4 projection;
+    if(camera.perspective)
+    {
+        const float zNear = 0.001f, zFar = 1000.0f, fov = 45.0f;
+        float aspect = (float)mWidth / (float)mHeight;
+        float ymax = zNear * tan(fov * M_PI / 360.0);
+        projection.frustum(-ymax*aspect, ymax*aspect, -ymax, ymax, zNear, zFar);
+    }
+    else
+    {
+        projection.ortho(-1, +1, -1, +1, 0.0001f, 100);
+    }
+
+    QMatrix4x4 modelView;
+    modelView.translate(camera.eyeX, camera.eyeY, camera.eyeZ);
+    modelView.rotate(camera.xRotation, 1.0f, 0.0f, 0.0f);
+    modelView.rotate(camera.yRotation, 0.0f, 1.0f, 0.0f);
+    modelView.rotate(camera.zRotation, 0.0f, 0.0f, 1.0f);
+
+    QMatrix4x4 mvp = projection * modelView;
+    float m[16];
+    std::copy(mvp.constData(), mvp.constData()+16, m);
+
+    const float* mv = modelView.constData();
+    for(int r=0; r<3; r++)
+        for(int c=0; c<3; c++)
+            mNormalMatrix[r*3+c] = mv[c*4+r];
+
+    //Points and lines are drawn with the default (0,0,1) current normal
+    mConstantNormal[0] = mNormalMatrix[2];
+    mConstantNormal[1] = mNormalMatrix[5];
+    mConstantNormal[2] = mNormalMatrix[8];
+
+    const long count = (long)mesh->vertVector->size();
+    mScreen.resize(count*3);
+    mVisible.resize(count);
+    const bool smooth = (type == ViewPortWidget::SMOOTH_SHADING);
+    mVertexColor.resize(smooth ? count*3 : 0);
+
+    const float w2 = 0.5f * mWidth;
+    const float h2 = 0.5f * mHeight;
+    runParallel(0, count, 4096, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            PolygonMesh::HE_vert* v = mesh->vertVector->at(i);
+            float cx = m[0]*v->x + m[4]*v->y + m[8]*v->z + m[12];
+            float cy = m[1]*v->x + m[5]*v->y + m[9]*v->z + m[13];
+            float cz = m[2]*v->x + m[6]*v->y + m[10]*v->z + m[14];
+            float cw = m[3]*v->x + m[7]*v->y + m[11]*v->z + m[15];
+
+            //Near-plane rejection instead of clipping
+            mVisible[i] = (cw > 1e-6f && cz >= -cw && cz <= cw);
+            if(!mVisible[i])
+                continue;
+            mScreen[i*3] = (cx/cw + 1.0f) * w2;
+            mScreen[i*3+1] = (1.0f - cy/cw) * h2;
+            mScreen[i*3+2] = (cz/cw + 1.0f) * 0.5f;
+
+            if(smooth)
+            {
+                float n[3] = {0.0f, 0.0f, 1.0f};
+                if(v->normal!=NULL)
+                {
+                    for(int r=0; r<3; r++)
+                        n[r] = mNormalMatrix[r*3]*v->normal->x
+                             + mNormalMatrix[r*3+1]*v->normal->y
+                             + mNormalMatrix[r*3+2]*v->normal->z;
+                }
+                shade(camera, n, &mVertexColor[i*3]);
+            }
+        }
+    });
+}
+
+void SoftwareRasterizer::buildPrimitives(const PolygonMesh* mesh,
+                                         const RenderCamera& camera,
+                                         ViewPortWidget::RENDER_TYPE type)
+{
+    float constantColor[3];
+    shade(camera, mConstantNormal, constantColor);
+
+    mPrims.clear();
+    if(type == ViewPortWidget::POINTS)
+    {
+        const long count = (long)mesh->vertVector->size();
+        mPrims.resize(count);
+        runParallel(0, count, 4096, [&](long from, long to) {
+            for(long i=from; i<to; i++)
+            {
+                Primitive& p = mPrims[i];
+                p.count = mVisible[i] ? 1 : 0;
+                p.x[0] = mScreen[i*3];
+                p.y[0] = mScreen[i*3+1];
+                p.z[0] = mScreen[i*3+2];
+                p.r[0] = constantColor[0];
+                p.g[0] = constantColor[1];
+                p.b[0] = constantColor[2];
+            }
+        });
+        return;
+    }
+
+    //Count primitives per face, then fill each face's slots in parallel
+    const long faceCount = (long)mesh->faceVector->size();
+    const bool lines = (type == ViewPortWidget::WIREFRAME);
+    const MeshBuffers* buffers = mesh->renderBuffers();
+    std::vector<long> offsets(faceCount+1, 0);
+    if(lines)
+    {
+        runParallel(0, faceCount, 1024, [&](long from, long to) {
+            for(long f=from; f<to; f++)
+            {
+                PolygonMesh::HE_face* face = mesh->faceVector->at(f);
+                long n = 0;
+                PolygonMesh::HE_edge* e = face->edge;
+                if(e!=NULL)
+                {
+                    do { n++; e = e->next; } while(e!=NULL && e!=face->edge);
+                }
+                offsets[f+1] = n;
+            }
+        });
+        for(long f=0; f<faceCount; f++)
+            offsets[f+1] += offsets[f];
+    }
+    else
+    {
+        //Triangles come from the mesh's cached ear-clipped index buffer
+        offsets.assign(buffers->faceTriangleOffsets.begin(), buffers->faceTriangleOffsets.end());
+    }
+    mPrims.resize(offsets[faceCount]);
+
+    runParallel(0, faceCount, 1024, [&](long from, long to) {
+        std::vector<long> loop;
+        for(long f=from; f<to; f++)
+        {
+            PolygonMesh::HE_face* face = mesh->faceVector->at(f);
+            loop.clear();
+            PolygonMesh::HE_edge* e = face->edge;
+            if(e!=NULL)
+            {
+                do { loop.push_back(e->vert->index-1); e = e->next; }
+                while(e!=NULL && e!=face->edge);
+            }
+
+            float faceColor[3];
+            if(type == ViewPortWidget::FLAT_SHADING && face->normal!=NULL)
+            {
+                float n[3];
+                for(int r=0; r<3; r++)
+                    n[r] = mNormalMatrix[r*3]*face->normal->x
+                         + mNormalMatrix[r*3+1]*face->normal->y
+                         + mNormalMatrix[r*3+2]*face->normal->z;
+                shade(camera, n, faceColor);
+            }
+            else
+            {
+                std::copy(constantColor, constantColor+3, faceColor);
+            }
+
+            long slot = offsets[f];
+            long primsInFace = offsets[f+1] - offsets[f];
+            for(long k=0; k<primsInFace; k++)
+            {
+                Primitive& p = mPrims[slot+k];
+                long ids[3];
+                if(lines)
+                {
+                    p.count = 2;
+                    ids[0] = loop[k];
+                    ids[1] = loop[(k+1) % loop.size()];
+                }
+                else
+                {
+                    p.count = 3;
+                    ids[0] = buffers->triangles[(slot+k)*3];
+                    ids[1] = buffers->triangles[(slot+k)*3+1];
+                    ids[2] = buffers->triangles[(slot+k)*3+2];
+                }
+                for(int c=0; c<p.count; c++)
+                {
+                    long v = ids[c];
+                    if(!mVisible[v])
+                        p.count = 0;
+                    p.x[c] = mScreen[v*3];
+                    p.y[c] = mScreen[v*3+1];
+                    p.z[c] = mScreen[v*3+2];
+                    const float* rgb = (type == ViewPortWidget::SMOOTH_SHADING)
+                            ? &mVertexColor[v*3] : faceColor;
+                    p.r[c] = rgb[0];
+                    p.g[c] = rgb[1];
+                    p.b[c] = rgb[2];
+                }
+            }
+        }
+    });
+}
+
+void SoftwareRasterizer::binPrimitives()
+{
+    const long primCount = (long)mPrims.size();
+    const long tileCount = (long)mTilesX*mTilesY;
+    const long chunks = qMax(1L, qMin(primCount/256 + 1,
+                                      (long)parallelThreadCount()*4));
+    const long chunkSize = (primCount + chunks - 1) / chunks;
+
+    mBins.resize(chunks);
+    for(long c=0; c<chunks; c++)
+    {
+        mBins[c].resize(tileCount);
+        for(long t=0; t<tileCount; t++)
+            mBins[c][t].clear();
+    }
+
+    runParallel(0, chunks, 1, [&](long from, long to) {
+        for(long c=from; c<to; c++)
+        {
+            long first = c*chunkSize;
+            long last = qMin(primCount, first+chunkSize);
+            for(long i=first; i<last; i++)
+            {
+                const Primitive& p = mPrims[i];
+                if(p.count==0)
+                    continue;
+                float minX = p.x[0], maxX = p.x[0];
+                float minY = p.y[0], maxY = p.y[0];
+                for(int k=1; k<p.count; k++)
+                {
+                    minX = qMin(minX,p.x[k]); maxX = qMax(maxX,p.x[k]);
+                    minY = qMin(minY,p.y[k]); maxY = qMax(maxY,p.y[k]);
+                }
+                //Points cover a 2x2 pixel square
+                minX -= 1.0f; minY -= 1.0f;
+                maxX += 1.0f; maxY += 1.0f;
+                if(maxX<0 || maxY<0 || minX>=mWidth || minY>=mHeight)
+                    continue;
+
+                int tx0 = qMax(0, (int)minX / mTileSize);
+                int ty0 = qMax(0, (int)minY / mTileSize);
+                int tx1 = qMin(mTilesX-1, (int)maxX / mTileSize);
+                int ty1 = qMin(mTilesY-1, (int)maxY / mTileSize);
+                for(int ty=ty0; ty<=ty1; ty++)
+                    for(int tx=tx0; tx<=tx1; tx++)
+                        mBins[c][ty*mTilesX+tx].push_back((int)i);
+            }
+        }
+    });
+}
+
+void SoftwareRasterizer::rasterizeTile(long tile)
+{
+    int x0 = (int)(tile % mTilesX) * mTileSize;
+    int y0 = (int)(tile / mTilesX) * mTileSize;
+    int x1 = qMin(mWidth, x0 + mTileSize);
+    int y1 = qMin(mHeight, y0 + mTileSize);
+
+    for(size_t c=0; c<mBins.size(); c++)
+    {
+        const std::vector<int>& bin = mBins[c][tile];
+        for(size_t i=0; i<bin.size(); i++)
+        {
+            const Primitive& p = mPrims[bin[i]];
+            if(p.count==3)
+                rasterizeTriangle(p,x0,y0,x1,y1);
+            else if(p.count==2)
+                rasterizeLine(p,x0,y0,x1,y1);
+            else if(p.count==1)
+                rasterizePoint(p,x0,y0,x1,y1);
+        }
+    }
+}
+
+void SoftwareRasterizer::writePixel(int x, int y, float z, float r, float g, float b)
+{
+    size_t idx = (size_t)y*mWidth + x;
+    if(z >= mDepth[idx])
+        return;
+    mDepth[idx] = z;
+    mColor[idx] = qRgb((int)(r*255.0f + 0.5f),
+                       (int)(g*255.0f + 0.5f),
+                       (int)(b*255.0f + 0.5f));
+}
+
+void SoftwareRasterizer::rasterizeTriangle(const Primitive& p,
+                                           int x0, int y0, int x1, int y1)
+{
+    float area = (p.x[1]-p.x[0])*(p.y[2]-p.y[0]) - (p.y[1]-p.y[0])*(p.x[2]-p.x[0]);
+    if(fabs(area) < 1e-12f)
+        return;
+
+    //Edge functions E_i(x,y) = A_i*x + B_i*y + C_i, E_i weighting vertex i
+    float A[3], B[3], C[3];
+    for(int i=0; i<3; i++)
+    {
+        int a = (i+1)%3;
+        int b = (i+2)%3;
+        A[i] = p.y[a] - p.y[b];
+        B[i] = p.x[b] - p.x[a];
+        C[i] = -(A[i]*p.x[a] + B[i]*p.y[a]);
+        if(area<0)
+        {
+            A[i] = -A[i];
+            B[i] = -B[i];
+            C[i] = -C[i];
+        }
+    }
+    const float invArea = 1.0f / fabs(area);
+
+    int bx0 = qMax(x0, (int)floor(qMin(p.x[0], qMin(p.x[1], p.x[2]))));
+    int by0 = qMax(y0, (int)floor(qMin(p.y[0], qMin(p.y[1], p.y[2]))));
+    int bx1 = qMin(x1, (int)ceil(qMax(p.x[0], qMax(p.x[1], p.x[2]))) + 1);
+    int by1 = qMin(y1, (int)ceil(qMax(p.y[0], qMax(p.y[1], p.y[2]))) + 1);
+    bx0 &= ~3;
+
+#ifdef __SSE2__
+    const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 a0 = _mm_set1_ps(A[0]), a1 = _mm_set1_ps(A[1]), a2 = _mm_set1_ps(A[2]);
+    const __m128 z0 = _mm_set1_ps(p.z[0]*invArea);
+    const __m128 z1 = _mm_set1_ps(p.z[1]*invArea);
+    const __m128 z2 = _mm_set1_ps(p.z[2]*invArea);
+#endif
+
+    for(int y=by0; y<by1; y++)
+    {
+        const float py = y + 0.5f;
+        for(int x=bx0; x<bx1; x+=4)
+        {
+            float w[3][4];
+            float z[4];
+            int mask = 0;
+#ifdef __SSE2__
+            __m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), lane);
+            __m128 w0 = _mm_add_ps(_mm_mul_ps(a0,px), _mm_set1_ps(B[0]*py + C[0]));
+            __m128 w1 = _mm_add_ps(_mm_mul_ps(a1,px), _mm_set1_ps(B[1]*py + C[1]));
+            __m128 w2 = _mm_add_ps(_mm_mul_ps(a2,px), _mm_set1_ps(B[2]*py + C[2]));
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0,zero),
+                                                  _mm_cmpge_ps(w1,zero)),
+                                       _mm_cmpge_ps(w2,zero));
+            mask = _mm_movemask_ps(inside);
+            if(mask==0)
+                continue;
+            __m128 zi = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0,z0), _mm_mul_ps(w1,z1)),
+                                   _mm_mul_ps(w2,z2));
+            _mm_storeu_ps(w[0], w0);
+            _mm_storeu_ps(w[1], w1);
+            _mm_storeu_ps(w[2], w2);
+            _mm_storeu_ps(z, zi);
+#else
+            for(int l=0; l<4; l++)
+            {
+                float px = x + l + 0.5f;
+                for(int i=0; i<3; i++)
+                    w[i][l] = A[i]*px + B[i]*py + C[i];
+                if(w[0][l]>=0 && w[1][l]>=0 && w[2][l]>=0)
+                    mask |= (1<<l);
+                z[l] = (w[0][l]*p.z[0] + w[1][l]*p.z[1] + w[2][l]*p.z[2]) * invArea;
+            }
+            if(mask==0)
+                continue;
+#endif
+            for(int l=0; l<4; l++)
+            {
+                if(!(mask & (1<<l)) || x+l<x0 || x+l>=bx1)
+                    continue;
+                float b0 = w[0][l]*invArea, b1 = w[1][l]*invArea, b2 = w[2][l]*invArea;
+                writePixel(x+l, y, z[l],
+                           b0*p.r[0] + b1*p.r[1] + b2*p.r[2],
+                           b0*p.g[0] + b1*p.g[1] + b2*p.g[2],
+                           b0*p.b[0] + b1*p.b[1] + b2*p.b[2]);
+            }
+        }
+    }
+}
+
+void SoftwareRasterizer::rasterizeLine(const Primitive& p,
+                                       int x0, int y0, int x1, int y1)
+{
+    float dx = p.x[1] - p.x[0];
+    float dy = p.y[1] - p.y[0];
+
+    //Clip the parameter range to the tile before stepping
+    float t0 = 0.0f, t1 = 1.0f;
+    const float lo[2] = {(float)x0, (float)y0};
+    const float hi[2] = {(float)x1, (float)y1};
+    const float start[2] = {p.x[0], p.y[0]};
+    const float delta[2] = {dx, dy};
+    for(int a=0; a<2; a++)
+    {
+        if(fabs(delta[a]) < 1e-12f)
+        {
+            if(start[a] < lo[a] || start[a] >= hi[a])
+                return;
+            continue;
+        }
+        float ta = (lo[a] - start[a]) / delta[a];
+        float tb = (hi[a] - start[a]) / delta[a];
+        t0 = qMax(t0, qMin(ta,tb));
+        t1 = qMin(t1, qMax(ta,tb));
+    }
+    if(t0 > t1)
+        return;
+
+    int steps = (int)ceil(qMax(fabs(dx), fabs(dy)) * (t1 - t0)) + 1;
+    for(int s=0; s<=steps; s++)
+    {
+        float t = t0 + (t1 - t0) * s / steps;
+        int px = (int)floor(p.x[0] + dx*t);
+        int py = (int)floor(p.y[0] + dy*t);
+        if(px<x0 || px>=x1 || py<y0 || py>=y1)
+            continue;
+        writePixel(px, py, p.z[0] + (p.z[1]-p.z[0])*t,
+                   p.r[0] + (p.r[1]-p.r[0])*t,
+                   p.g[0] + (p.g[1]-p.g[0])*t,
+                   p.b[0] + (p.b[1]-p.b[0])*t);
+    }
+}
+
+void SoftwareRasterizer::rasterizePoint(const Primitive& p,
+                                        int x0, int y0, int x1, int y1)
+{
+    //glPointSize(2.0f) covers the pixel centres within one pixel of the point
+    int px = (int)floor(p.x[0] - 0.5f);
+    int py = (int)floor(p.y[0] - 0.5f);
+    for(int y=qMax(py,y0); y<qMin(py+2,y1); y++)
+        for(int x=qMax(px,x0); x<qMin(px+2,x1); x++)
+            writePixel(x, y, p.z[0], p.r[0], p.g[0], p.b[0]);
+}
+
+/**
+ * @brief renderThumbnails
+ * Renders every OBJ file with the default camera into outDir. With more
+ * than one turntable frame the camera yaw is swept through a full turn and
+ * one PNG is written per frame. Files are processed in parallel, each with
+ * a single-threaded rasterizer, which scales better than tiling small images.
+ * @return number of files that failed
+ */
+int SoftwareRasterizer::renderThumbnails(QStringList objFiles,
+                                         QString outDir,
+                                         ViewPortWidget::RENDER_TYPE type,
+                                         int width, int height,
+                                         int turntableFrames)
+{
+    QDir dir(outDir);
+    dir.mkpath(".");
+    turntableFrames = qMax(1,turntableFrames);
+    std::atomic<int> failures(0);
+
+    parallelFor(0, objFiles.size(), 1, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            QString objFile = objFiles.at(i);
+            OBJFileParser parser;
+            //Freed after its frames, so a batch holds one model per thread
+            QScopedPointer<PolygonMesh> mesh(parser.parseFile(objFile));
+            if(mesh.isNull())
+            {
+                failures++;
+                continue;
+            }
+
+            SoftwareRasterizer rasterizer(width,height);
+            rasterizer.setThreaded(false);
+            RenderCamera camera = ViewPortWidget::defaultCamera();
+            QString base = QFileInfo(objFile).completeBaseName();
+            for(int f=0; f<turntableFrames; f++)
+            {
+                camera.yRotation = 360.0f * f / turntableFrames;
+                QString name = (turntableFrames==1)
+                        ? base + ".png"
+                        : QString("%1_%2.png").arg(base).arg(f,3,10,QChar('0'));
+                if(!rasterizer.renderToFile(mesh.data(),camera,type,dir.filePath(name)))
+                {
+                    failures++;
+                    break;
+                }
+            }
+        }
+    });
+
+    return failures.load();
+}
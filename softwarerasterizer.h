@@ -0,0 +1,88 @@
+#ifndef SOFTWARERASTERIZER_H
+#define SOFTWARERASTERIZER_H
+
+#include <QImage>
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+#include "trianglemesh.h"
+#include "rendercamera.h"
+#include "viewportwidget.h"
+
+/**
+ * Headless CPU renderer for thumbnails and turntable previews.
+ *
+ * Reproduces the fixed-function pipeline of ViewPortWidget (projection,
+ * camera rotations, lights and material) for the mesh only; the ground,
+ * axis and bounding box overlays are not drawn. The screen is split into
+ * tiles, primitives are binned per tile in parallel and every tile is then
+ * rasterized by one worker, so no two threads ever touch the same pixel.
+ */
+class SoftwareRasterizer
+{
+public:
+    SoftwareRasterizer(int width, int height);
+    void setTileSize(int size);
+    void setThreaded(bool threaded);
+    QImage render(const PolygonMesh* mesh,
+                  const RenderCamera& camera,
+                  ViewPortWidget::RENDER_TYPE type);
+    bool renderToFile(const PolygonMesh* mesh,
+                      const RenderCamera& camera,
+                      ViewPortWidget::RENDER_TYPE type,
+                      QString pngFile);
+
+    static int renderThumbnails(QStringList objFiles,
+                                QString outDir,
+                                ViewPortWidget::RENDER_TYPE type,
+                                int width, int height,
+                                int turntableFrames);
+
+private:
+    //Screen-space point, line or triangle with per-vertex colour
+    struct Primitive {
+        int count;
+        float x[3], y[3], z[3];
+        float r[3], g[3], b[3];
+    };
+
+    void transformVertices(const PolygonMesh* mesh,
+                           const RenderCamera& camera,
+                           ViewPortWidget::RENDER_TYPE type);
+    void buildPrimitives(const PolygonMesh* mesh,
+                         const RenderCamera& camera,
+                         ViewPortWidget::RENDER_TYPE type);
+    void binPrimitives();
+    void rasterizeTile(long tile);
+    void rasterizeTriangle(const Primitive& p, int x0, int y0, int x1, int y1);
+    void rasterizeLine(const Primitive& p, int x0, int y0, int x1, int y1);
+    void rasterizePoint(const Primitive& p, int x0, int y0, int x1, int y1);
+    void writePixel(int x, int y, float z, float r, float g, float b);
+    void runParallel(long begin, long end, long grain,
+                     const std::function<void(long,long)>& body);
+
+    int mWidth;
+    int mHeight;
+    int mTileSize;
+    int mTilesX;
+    int mTilesY;
+    bool mThreaded;
+    float mNormalMatrix[9];
+    float mConstantNormal[3];
+
+    std::vector<QRgb> mColor;
+    std::vector<float> mDepth;
+
+    //Per-vertex screen position (x,y,z) and lit colour
+    std::vector<float> mScreen;
+    std::vector<float> mVertexColor;
+    std::vector<char> mVisible;
+
+    std::vector<Primitive> mPrims;
+    //Bins per primitive chunk and tile, so binning needs no locks and
+    //primitives keep their submission order within a tile
+    std::vector<std::vector<std::vector<int> > > mBins;
+};
+
+#endif // SOFTWARERASTERIZER_H
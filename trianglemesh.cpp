@@ -1,16 +1,136 @@
 #include "trianglemesh.h"
+#include "meshbuffers.h"
+#include "parallel.h"
+
+#include <unordered_set>
 
 PolygonMesh::PolygonMesh()
 {
     first_vertex = NULL;
     edgeVector = new std::vector<HE_edge>();
+    vertVector = new std::vector<HE_vert*>();
+    faceVector = new std::vector<HE_face*>();
     maxVector = new QVector3D(0.0,0.0,0.0);
     minVector = new QVector3D(0.0,0.0,0.0);
+    buffers = NULL;
+    vertPool = NULL;
+    facePool = NULL;
+    edgePool = NULL;
 }
 
 PolygonMesh::~PolygonMesh(){
+    //Normals and centroids are allocated per node; vertex normals read from
+    //the file may be shared between vertices
+    std::unordered_set<Normal*> normals;
+    for(size_t i=0; i<vertVector->size(); i++)
+        normals.insert(vertVector->at(i)->normal);
+    for(size_t i=0; i<faceVector->size(); i++)
+    {
+        normals.insert(faceVector->at(i)->normal);
+        delete faceVector->at(i)->centroid;
+    }
+    for(std::unordered_set<Normal*>::iterator it=normals.begin(); it!=normals.end(); ++it)
+        delete *it;
+
+    //Without pools every node was allocated on its own
+    if(vertPool==NULL)
+    {
+        for(size_t i=0; i<faceVector->size(); i++)
+        {
+            HE_face* face = faceVector->at(i);
+            HE_edge* e = face->edge;
+            if(e!=NULL)
+            {
+                if(e->prev!=NULL)
+                    e->prev->next = NULL;
+                while(e!=NULL)
+                {
+                    HE_edge* next = e->next;
+                    delete e;
+                    e = next;
+                }
+            }
+            delete face;
+        }
+        for(size_t i=0; i<vertVector->size(); i++)
+            delete vertVector->at(i);
+    }
+
     delete edgeVector;
+    delete vertVector;
+    delete faceVector;
     delete maxVector;
     delete minVector;
+    delete buffers;
+    delete[] vertPool;
+    delete[] facePool;
+    delete[] edgePool;
+}
+
+const MeshBuffers* PolygonMesh::renderBuffers() const
+{
+    std::lock_guard<std::mutex> guard(buffersLock);
+    if(buffers==NULL)
+    {
+        buffers = new MeshBuffers();
+        buffers->build(this);
+    }
+    return buffers;
+}
+
+const MeshBuffers* PolygonMesh::flatRenderBuffers() const
+{
+    renderBuffers();
+    std::lock_guard<std::mutex> guard(buffersLock);
+    if(buffers->flatPositions.empty() && !buffers->triangles.empty())
+        buffers->buildFlat(this);
+    return buffers;
+}
+
+
+void PolygonMesh::releaseRenderBuffers()
+{
+    std::lock_guard<std::mutex> guard(buffersLock);
+    delete buffers;
+    buffers = NULL;
 }
 
+size_t PolygonMesh::memoryUsage() const
+{
+    //Every new'd node also costs the allocator's header
+    const size_t overhead = vertPool==NULL ? 16 : 0;
+    const long faceCount = (long)faceVector->size();
+    const size_t halfEdges = parallelReduce(0L, faceCount, 16384, (size_t)0,
+        [this](long from, long to) {
+            size_t count = 0;
+            for(long f=from; f<to; f++)
+            {
+                HE_edge* e = faceVector->at(f)->edge;
+                if(e==NULL)
+                    continue;
+                do {
+                    count++;
+                    e = e->next;
+                } while(e!=NULL && e!=faceVector->at(f)->edge);
+            }
+            return count;
+        },
+        [](size_t a, size_t b) { return a + b; });
+
+    size_t bytes = sizeof(PolygonMesh);
+    bytes += vertVector->size() * (sizeof(HE_vert*) + sizeof(HE_vert) + overhead + sizeof(Normal) + 16);
+    bytes += faceVector->size() * (sizeof(HE_face*) + sizeof(HE_face) + overhead +
+                                   sizeof(Normal) + sizeof(HE_vert) + 32);
+    bytes += halfEdges * (sizeof(HE_edge) + overhead);
+    bytes += edgeVector->capacity() * sizeof(HE_edge);
+    std::lock_guard<std::mutex> guard(buffersLock);
+    if(buffers!=NULL)
+    {
+        bytes += (buffers->positions.capacity() + buffers->normals.capacity() +
+                  buffers->flatPositions.capacity() + buffers->flatNormals.capacity()) * sizeof(float);
+        bytes += (buffers->edgeIndices.capacity() + buffers->boundaryEdgeIndices.capacity() +
+                  buffers->nonManifoldEdgeIndices.capacity() + buffers->triangles.capacity() +
+                  buffers->faceTriangleOffsets.capacity()) * sizeof(unsigned int);
+    }
+    return bytes;
+}
@@ -5,6 +5,8 @@
 #include <QMap>
 #include <vector>
 #include <QVector3D>
+#include <QSharedPointer>
+#include <mutex>
 #ifdef _WIN32
     #include <Windows.h>
     #include <GL/glu.h>
@@ -12,6 +14,16 @@
     #include <OpenGL/glu.h>
 #endif
 
+class MeshBuffers;
+
+/**
+ * Half-edge mesh. A mesh is built and edited by one owner (parser,
+ * MeshBuilder, MeshReorder) and then published as a MeshSnapshot. From
+ * then on it is never modified: the viewer, the cache and background
+ * jobs each hold a reference and read it concurrently without locks, and
+ * it is freed with the last reference. Operations that change a mesh
+ * (simplify, component extraction, coplanar merging) build a new one.
+ */
 class PolygonMesh
 {
 public:
@@ -46,11 +58,38 @@ public:
     };
     HE_vert* first_vertex;
     std::vector<HE_edge>* edgeVector;
+    //Dense arrays in index order: vertVector[i]->index == i+1
+    std::vector<HE_vert*>* vertVector;
+    std::vector<HE_face*>* faceVector;
     void copyEdge(HE_edge* in, HE_edge* out);
 
+    //Vertex/index arrays for drawing, built once on first use by any reader
+    const MeshBuffers* renderBuffers() const;
+    //renderBuffers() with the per-corner flat shading arrays filled in
+    const MeshBuffers* flatRenderBuffers() const;
+    //Drops the cached arrays after the topology has been changed
+    void releaseRenderBuffers();
+    //Approximate heap bytes of the nodes, attributes and render buffers
+    size_t memoryUsage() const;
+
+    //Contiguous node storage, set once the nodes have been reordered
+    HE_vert* vertPool;
+    HE_face* facePool;
+    HE_edge* edgePool;
+
     //Max and Min X,Y,Z positions to draw bounding box
     QVector3D* maxVector;
     QVector3D* minVector;
+
+private:
+    PolygonMesh(const PolygonMesh&);
+    PolygonMesh& operator=(const PolygonMesh&);
+
+    mutable MeshBuffers* buffers;
+    mutable std::mutex buffersLock;
 };
 
+//Published, read-only mesh shared by everything that uses it
+typedef QSharedPointer<const PolygonMesh> MeshSnapshot;
+
 #endif // TRIANGLEMESH_H
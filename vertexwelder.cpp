@@ -0,0 +1,131 @@
+#include "vertexwelder.h"
+#include "parallel.h"
+
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+typedef unsigned long long CellKey;
+
+struct CellEntry {
+    CellKey key;
+    long vertex;
+    bool operator<(const CellEntry& other) const
+    {
+        return key<other.key || (key==other.key && vertex<other.vertex);
+    }
+};
+
+long long cellOf(float value, float epsilon)
+{
+    return (long long)std::floor((double)value / epsilon);
+}
+
+//Different cells may share a key; candidates are checked by distance anyway
+CellKey hashCell(long long x, long long y, long long z)
+{
+    CellKey h = (CellKey)x * 0x9E3779B97F4A7C15ULL;
+    h ^= (CellKey)y * 0xC2B2AE3D27D4EB4FULL + (h << 6) + (h >> 2);
+    h ^= (CellKey)z * 0x165667B19E3779F9ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+}
+
+VertexWelder::VertexWelder(float epsilon)
+{
+    mEpsilon = epsilon;
+    mMerged = 0;
+}
+
+std::vector<long> VertexWelder::weld(const std::vector<PolygonMesh::HE_vert*>& verts)
+{
+    std::vector<float> positions(verts.size()*3);
+    parallelFor(0, (long)verts.size(), 16384, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            positions[i*3] = verts[i]->x;
+            positions[i*3+1] = verts[i]->y;
+            positions[i*3+2] = verts[i]->z;
+        }
+    });
+    return weld(positions);
+}
+
+std::vector<long> VertexWelder::weld(const std::vector<float>& positions)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const long count = (long)positions.size() / 3;
+    std::vector<long> target(count);
+    mMerged = 0;
+    if(mEpsilon<=0.0f)
+    {
+        for(long i=0; i<count; i++)
+            target[i] = i;
+        return target;
+    }
+
+    std::vector<CellEntry> cells(count);
+    parallelFor(0, count, 16384, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            const float* v = &positions[i*3];
+            cells[i].key = hashCell(cellOf(v[0], mEpsilon), cellOf(v[1], mEpsilon), cellOf(v[2], mEpsilon));
+            cells[i].vertex = i;
+        }
+    });
+    std::sort(cells.begin(), cells.end());
+
+    //Earliest vertex within epsilon in the 27 surrounding cells
+    const float limit = mEpsilon * mEpsilon;
+    std::vector<long> nearest(count);
+    parallelFor(0, count, 4096, [&](long from, long to) {
+        for(long i=from; i<to; i++)
+        {
+            const float* v = &positions[i*3];
+            const long long cx = cellOf(v[0], mEpsilon);
+            const long long cy = cellOf(v[1], mEpsilon);
+            const long long cz = cellOf(v[2], mEpsilon);
+            long best = i;
+            for(int n=0; n<27; n++)
+            {
+                CellEntry probe;
+                probe.key = hashCell(cx + n%3 - 1, cy + (n/3)%3 - 1, cz + n/9 - 1);
+                probe.vertex = 0;
+                std::vector<CellEntry>::const_iterator it = std::lower_bound(cells.begin(), cells.end(), probe);
+                //Entries of a cell are sorted by vertex, so only earlier ones are visited
+                for(; it!=cells.end() && it->key==probe.key && it->vertex<best; ++it)
+                {
+                    const float* w = &positions[it->vertex*3];
+                    float dx = w[0] - v[0];
+                    float dy = w[1] - v[1];
+                    float dz = w[2] - v[2];
+                    if(dx*dx + dy*dy + dz*dz <= limit)
+                        best = it->vertex;
+                }
+            }
+            nearest[i] = best;
+        }
+    });
+
+    //nearest always points backwards, so its target is already final
+    for(long i=0; i<count; i++)
+    {
+        target[i] = nearest[i]==i ? i : target[nearest[i]];
+        if(target[i]!=i)
+            mMerged++;
+    }
+
+    qDebug() << "Welded" << mMerged << "of" << count << "vertices within" << mEpsilon
+             << "in" << timer.elapsed() << "ms";
+    return target;
+}
+
+long VertexWelder::mergedCount() const
+{
+    return mMerged;
+}
@@ -0,0 +1,38 @@
+#ifndef VERTEXWELDER_H
+#define VERTEXWELDER_H
+
+#include <vector>
+
+#include "trianglemesh.h"
+
+/**
+ * Finds vertices that lie within an epsilon of each other, such as the
+ * copies many exporters write along UV or material seams.
+ *
+ * Vertices are hashed into a grid of epsilon-sized cells; the cell keys and
+ * the neighbour searches run in parallel. Every vertex is mapped to the
+ * first vertex (in file order) of its group, so chains of vertices closer
+ * than epsilon collapse onto one.
+ */
+class VertexWelder
+{
+public:
+    explicit VertexWelder(float epsilon);
+
+    /**
+     * @brief weld
+     * @return for every vertex the position in verts of the vertex it is
+     * merged into; its own position if it is kept. A target is always kept.
+     */
+    std::vector<long> weld(const std::vector<PolygonMesh::HE_vert*>& verts);
+    //Same for xyz triples, for loaders that have not built vertices yet
+    std::vector<long> weld(const std::vector<float>& positions);
+    //Vertices merged into another one by the last weld()
+    long mergedCount() const;
+
+private:
+    float mEpsilon;
+    long mMerged;
+};
+
+#endif // VERTEXWELDER_H
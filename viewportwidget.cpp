@@ -3,9 +3,53 @@
 #include <QList>
 
 #include "viewportwidget.h"
+#include "meshbuffers.h"
+#include "meshlod.h"
+#include "meshcomponents.h"
+#include "clustergraph.h"
+#include "pathpointwriter.h"
+#include "pathgraphwriter.h"
+#include "pathgraphtiler.h"
+#include "coplanarmerger.h"
+#include "walkabilityfilter.h"
 
 const static bool showDebug = false;
 
+struct SceneBuffers {
+    SceneBuffers()
+        : positions(QGLBuffer::VertexBuffer),
+          normals(QGLBuffer::VertexBuffer),
+          indices(QGLBuffer::IndexBuffer),
+          level(NULL),
+          uploaded(false) {}
+    QGLBuffer positions;
+    QGLBuffer normals;
+    QGLBuffer indices;
+    //Client arrays used when VBOs are unavailable
+    const LodLevel* level;
+    bool uploaded;
+};
+
+class LodBuildJob
+{
+public:
+    LodBuildJob(MeshSnapshot mesh, const CancellationToken& token){
+        sMesh = mesh;
+        sToken = token;
+    }
+    MeshSnapshot sMesh;
+    CancellationToken sToken;
+    std::vector<LodLevel*> sChain;
+
+    void run()
+    {
+        QElapsedTimer timer;
+        timer.start();
+        sChain = MeshLod::buildChain(sMesh.data(), 5, 1000, &sToken);
+        qDebug() << "LOD chain of" << (int)sChain.size() << "levels built in" << timer.elapsed() << "ms";
+    }
+};
+
 ViewPortWidget::ViewPortWidget(QWidget *parent)
     : QGLWidget(QGLFormat(QGL::SampleBuffers), parent)
 {
@@ -27,10 +71,42 @@ ViewPortWidget::ViewPortWidget(QWidget *parent)
     perspective_projection = true;
     axis_height = 1.0f;
     light_distance = 1.0f;
+    m_highlightEdges = false;
+    m_pointLod = true;
+    mPointBudget = 2000000;
+    mInteracting = false;
+    mMeshGeneration = 0;
+    mPositionBufferGeneration = 0;
+    m_autoLod = true;
+    mFrameBudgetMs = 33.0f;
+    mLodLevel = 0;
+    mLodJob = NULL;
+    mLodFrameMs.assign(1, 0.0f);
+    mFrameStats.drawCalls = 0;
+    mFrameStats.vertices = 0;
+    m_exportClusterGraph = false;
+    m_compactJson = false;
+    m_mergeCoplanar = false;
+    m_walkableOnly = false;
+    m_maxSlope = 45.0f;
+    m_clearance = 0.0f;
+    m_weightLinks = false;
 }
 
 ViewPortWidget::~ViewPortWidget()
-{}
+{
+    //Queued jobs are dropped, running ones stop at their next check
+    mJobs.cancel();
+    mJobs.wait();
+    if(mLodJob!=NULL)
+    {
+        for(size_t i=0; i<mLodJob->sChain.size(); i++)
+            delete mLodJob->sChain[i];
+        delete mLodJob;
+    }
+    clearLodChain();
+    releaseSceneBuffers();
+}
 
 void ViewPortWidget::initializeGL()
 {
@@ -105,6 +181,13 @@ void ViewPortWidget::setProjection()
 
 void ViewPortWidget::paintGL()
 {
+    mFrameStats.drawCalls = 0;
+    mFrameStats.vertices = 0;
+    selectLodLevel();
+
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+
     glMatrixMode(GL_MODELVIEW);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glLoadIdentity();
@@ -112,6 +195,13 @@ void ViewPortWidget::paintGL()
     glTranslatef(eyeX, eyeY, eyeZ);
     draw();
 
+    if(lodActive())
+    {
+        //Wait for the GPU so the sample covers the whole frame
+        glFinish();
+        recordFrameTime(frameTimer.nsecsElapsed() / 1.0e6f);
+    }
+
     if(showDebug) {
         qDebug() << "X: " << eyeX << "Y: " << eyeY << "Z: " << eyeZ;
         qDebug() << "X_Rotation: " << xAxisRotation << "Y_Rotation: " << yAxisRotation << "Z-Rotation: " << zAxisRotation;
@@ -123,6 +213,15 @@ void ViewPortWidget::mousePressEvent(QMouseEvent *event)
     if(showDebug)
         qDebug() << "Received mouse click";
     firstClickPosition = event->pos();
+    mInteracting = true;
+}
+
+void ViewPortWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+    Q_UNUSED(event);
+    mInteracting = false;
+    mLodLevel = 0;
+    updateGL();
 }
 
 void ViewPortWidget::mouseMoveEvent(QMouseEvent *event)
@@ -208,29 +307,38 @@ void ViewPortWidget::drawObject(){
     {
         glShadeModel(GL_SMOOTH);
     }
-    else if(mCurrRenderType == WIREFRAME )
+
+    if(!mScene.isNull())
     {
-        glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
+        drawScene();
     }
-    else if(mCurrRenderType == POINTS )
+    else if(triangleMesh!=NULL && mCurrRenderType == POINTS)
     {
-        glPointSize(2.0f);
-    }
+        drawPoints();
 
-    if(triangleMesh!=NULL)
+        if(m_showBoundingBox){
+            drawBoundingBox();
+        }
+    }
+    else if(triangleMesh!=NULL && mCurrRenderType == WIREFRAME)
     {
+        drawWireframe();
 
-        std::vector<PolygonMesh::HE_edge>::iterator iv = triangleMesh->edgeVector->begin();
-        while (iv != triangleMesh->edgeVector->end()) {
-
-            drawFace(iv->next);
-            ++iv;
+        if(m_showBoundingBox){
+            drawBoundingBox();
+        }
+    }
+    else if(triangleMesh!=NULL && mLodLevel>0)
+    {
+        drawLodLevel(mLodChain[mLodLevel-1]);
 
-            /*
-            traverse_halfedge(iv->next);
-            break;
-            */
+        if(m_showBoundingBox){
+            drawBoundingBox();
         }
+    }
+    else if(triangleMesh!=NULL)
+    {
+        drawTriangles();
 
         if(m_showBoundingBox){
             drawBoundingBox();
@@ -244,24 +352,23 @@ void ViewPortWidget::drawObject(){
     else if(mCurrRenderType == FLAT_SHADING)
     {
 
-    }
-    else if(mCurrRenderType == WIREFRAME )
-    {
-        glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
-    }
-    else if(mCurrRenderType == POINTS )
-    {
-        glPointSize(1.0f);
     }
     glPopMatrix();
 }
 
+/**
+ * @brief drawFace
+ * Draws the face of edge from the mesh's cached triangulation, so quads and
+ * larger (also concave) polygons are filled correctly.
+ */
 void ViewPortWidget::drawFace(PolygonMesh::HE_edge* edge){
     if(edge!=NULL && edge->face!=NULL){
         PolygonMesh::HE_face* face = edge->face;
         PolygonMesh::Normal* face_normal = face->normal;
-        PolygonMesh::HE_edge* first_edge = nullptr;
-        PolygonMesh::HE_edge* curr_edge = edge;
+        const MeshBuffers* buffers = triangleMesh->renderBuffers();
+        const std::vector<PolygonMesh::HE_vert*>& verts = *triangleMesh->vertVector;
+        const unsigned int first = buffers->faceTriangleOffsets[face->index-1]*3;
+        const unsigned int last = buffers->faceTriangleOffsets[face->index]*3;
 
 
         if(mCurrRenderType == POINTS )
@@ -274,16 +381,9 @@ void ViewPortWidget::drawFace(PolygonMesh::HE_edge* edge){
         glColor3f(0.5f,0.5f,0.5f);
 
 
-        //qDebug() << "\n" << "face: " << face;
-        while(curr_edge != first_edge)
+        for(unsigned int i=first; i<last; i++)
         {
-            //qDebug() << "edge: " << curr_edge;
-            if(first_edge==nullptr)
-            {
-                first_edge = curr_edge;
-            }
-
-            PolygonMesh::HE_vert* vert = curr_edge->vert;
+            PolygonMesh::HE_vert* vert = verts[buffers->triangles[i]];
             if(mCurrRenderType == FLAT_SHADING)
             {
                 glNormal3f(face_normal->x,face_normal->y,face_normal->z);
@@ -293,17 +393,376 @@ void ViewPortWidget::drawFace(PolygonMesh::HE_edge* edge){
                 glNormal3f(vert->normal->x,vert->normal->y,vert->normal->z);
             }
             glVertex3f(vert->x,vert->y,vert->z);
-
-            curr_edge = curr_edge->next;
+            mFrameStats.vertices++;
         }
 
         glEnd();
+        mFrameStats.drawCalls++;
+
+        if (edge->pair == NULL) {
+            if(showDebug)
+                qDebug() << "      Current's' pair is null" << QString::number(edge->index);
+        }
     }
+}
 
-    if (edge->pair == NULL) {
-        if(showDebug)
-            qDebug() << "      Current's' pair is null" << QString::number(edge->index);
+/**
+ * @brief drawTriangles
+ * Draws the whole mesh from its cached triangle index buffer in one call:
+ * indexed from the position VBO with vertex normals for smooth shading,
+ * or from the expanded per-corner arrays with face normals for flat
+ * shading.
+ */
+void ViewPortWidget::drawTriangles(){
+    //The flat arrays cost 72 bytes per triangle, so only flat shading builds them
+    const MeshBuffers* buffers = (mCurrRenderType == FLAT_SHADING)
+            ? triangleMesh->flatRenderBuffers() : triangleMesh->renderBuffers();
+    if(buffers->triangles.empty())
+        return;
+
+    glColor3f(0.5f,0.5f,0.5f);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    if(mCurrRenderType == FLAT_SHADING)
+    {
+        glVertexPointer(3, GL_FLOAT, 0, &buffers->flatPositions[0]);
+        glNormalPointer(GL_FLOAT, 0, &buffers->flatNormals[0]);
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)buffers->triangles.size());
     }
+    else
+    {
+        const GLvoid* positions = bindPositionBuffer();
+        glVertexPointer(3, GL_FLOAT, 0, positions);
+        //The normal and index arrays are client-side
+        releasePositionBuffer();
+        glNormalPointer(GL_FLOAT, 0, &buffers->normals[0]);
+        glDrawElements(GL_TRIANGLES, (GLsizei)buffers->triangles.size(),
+                       GL_UNSIGNED_INT, &buffers->triangles[0]);
+    }
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    mFrameStats.drawCalls++;
+    mFrameStats.vertices += (long)buffers->triangles.size();
+}
+
+/**
+ * @brief drawWireframe
+ * Draws every undirected edge once from the mesh's edge index buffer in a
+ * single GL_LINES call, optionally overdrawing boundary edges in red and
+ * non-manifold edges in magenta.
+ */
+void ViewPortWidget::drawWireframe(){
+    const MeshBuffers* buffers = triangleMesh->renderBuffers();
+    const GLvoid* positions = bindPositionBuffer();
+    if(positions==NULL && !mPositionBuffer.isCreated())
+        return;
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, positions);
+    //Lines have no normals; lit, they would take whatever normal was last set
+    glDisable(GL_LIGHTING);
+
+    glColor3f(0.5f,0.5f,0.5f);
+    drawLineIndices(buffers->edgeIndices);
+
+    if(m_highlightEdges)
+    {
+        glLineWidth(2.0f);
+        glColor3f(1.0f,0.0f,0.0f);
+        drawLineIndices(buffers->boundaryEdgeIndices);
+        glColor3f(1.0f,0.0f,1.0f);
+        drawLineIndices(buffers->nonManifoldEdgeIndices);
+        glLineWidth(1.0f);
+    }
+
+    if(use_lighting)
+        glEnable(GL_LIGHTING);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    releasePositionBuffer();
+}
+
+/**
+ * @brief drawPoints
+ * Draws every vertex once straight from the position array with one
+ * glDrawArrays call. With point LOD on, meshes above the point budget are
+ * drawn with a vertex stride while the camera is being dragged so the frame
+ * stays interactive; the point size then grows to cover the gaps.
+ */
+void ViewPortWidget::drawPoints(){
+    const MeshBuffers* buffers = triangleMesh->renderBuffers();
+    const long count = (long)buffers->positions.size() / 3;
+    const GLvoid* positions = bindPositionBuffer();
+    if(count==0 || (positions==NULL && !mPositionBuffer.isCreated()))
+        return;
+
+    long stride = 1;
+    if(m_pointLod && mInteracting && mPointBudget>0 && count>mPointBudget)
+        stride = (count + mPointBudget - 1) / mPointBudget;
+    const long drawn = count / stride;
+
+    float pointSize = 2.0f;
+    if(m_pointLod)
+    {
+        //Roughly one point per covered pixel once the cloud is dense
+        float pixelsPerPoint = (float)(width * height) / (float)drawn;
+        pointSize = qBound(1.0f, (float)sqrt(pixelsPerPoint), stride>1 ? 3.0f : 2.0f);
+    }
+
+    glPointSize(pointSize);
+    glColor3f(0.5f,0.5f,0.5f);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, (GLsizei)(stride * 3 * sizeof(float)), positions);
+    glDrawArrays(GL_POINTS, 0, (GLsizei)drawn);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glPointSize(1.0f);
+    releasePositionBuffer();
+
+    mFrameStats.drawCalls++;
+    mFrameStats.vertices += drawn;
+}
+
+/**
+ * @brief bindPositionBuffer
+ * Uploads the mesh positions to a vertex buffer object once per mesh and
+ * binds it. Falls back to client-side arrays when VBOs are unavailable.
+ * @return pointer to pass to glVertexPointer
+ */
+const GLvoid* ViewPortWidget::bindPositionBuffer(){
+    const MeshBuffers* buffers = triangleMesh->renderBuffers();
+    if(buffers->positions.empty())
+        return NULL;
+
+    if(!mPositionBuffer.isCreated() && !mPositionBuffer.create())
+        return &buffers->positions[0];
+
+    mPositionBuffer.bind();
+    if(mPositionBufferGeneration != mMeshGeneration)
+    {
+        mPositionBuffer.allocate(&buffers->positions[0],
+                                 (int)(buffers->positions.size() * sizeof(float)));
+        mPositionBufferGeneration = mMeshGeneration;
+    }
+    return NULL;
+}
+
+void ViewPortWidget::releasePositionBuffer(){
+    if(mPositionBuffer.isCreated())
+        mPositionBuffer.release();
+}
+
+void ViewPortWidget::drawLineIndices(const std::vector<unsigned int>& indices){
+    if(indices.empty())
+        return;
+    glDrawElements(GL_LINES, (GLsizei)indices.size(), GL_UNSIGNED_INT, &indices[0]);
+    mFrameStats.drawCalls++;
+    mFrameStats.vertices += (long)indices.size();
+}
+
+void ViewPortWidget::drawLodLevel(LodLevel* level){
+    if(level->triangles.empty())
+        return;
+
+    //Flat shading keeps one lit colour per triangle
+    if(mCurrRenderType == FLAT_SHADING)
+        glShadeModel(GL_FLAT);
+
+    glColor3f(0.5f,0.5f,0.5f);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, &level->positions[0]);
+    glNormalPointer(GL_FLOAT, 0, &level->normals[0]);
+    glDrawElements(GL_TRIANGLES, (GLsizei)level->triangles.size(),
+                   GL_UNSIGNED_INT, &level->triangles[0]);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glShadeModel(GL_SMOOTH);
+
+    mFrameStats.drawCalls++;
+    mFrameStats.vertices += (long)level->triangles.size();
+}
+
+/**
+ * @brief drawScene
+ * Draws every instance of every scene object. Each object's buffers are
+ * bound once and its instances are drawn from them with their own model
+ * matrix, so repeated props cost one upload and one draw call apiece.
+ */
+void ViewPortWidget::drawScene(){
+    uploadSceneBuffers();
+
+    if(mCurrRenderType == FLAT_SHADING)
+        glShadeModel(GL_FLAT);
+    if(mCurrRenderType == WIREFRAME)
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    //Scaled instances would otherwise scale their normals
+    glEnable(GL_NORMALIZE);
+    glColor3f(0.5f,0.5f,0.5f);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+
+    for(size_t i=0; i<mScene->objects.size(); i++)
+    {
+        const SceneObject& object = mScene->objects[i];
+        SceneBuffers* buffers = mSceneBuffers[i];
+        const LodLevel* level = buffers->level;
+        if(level->triangles.empty())
+            continue;
+
+        const bool vbo = buffers->uploaded;
+        if(vbo)
+        {
+            buffers->positions.bind();
+            glVertexPointer(3, GL_FLOAT, 0, NULL);
+            buffers->normals.bind();
+            glNormalPointer(GL_FLOAT, 0, NULL);
+            buffers->normals.release();
+            buffers->indices.bind();
+        }
+        else
+        {
+            glVertexPointer(3, GL_FLOAT, 0, &level->positions[0]);
+            glNormalPointer(GL_FLOAT, 0, &level->normals[0]);
+        }
+
+        for(size_t t=0; t<object.transforms.size(); t++)
+        {
+            glPushMatrix();
+            glMultMatrixf(object.transforms[t].constData());
+            if(mCurrRenderType == POINTS)
+                glDrawArrays(GL_POINTS, 0, (GLsizei)(level->positions.size() / 3));
+            else
+                glDrawElements(GL_TRIANGLES, (GLsizei)level->triangles.size(), GL_UNSIGNED_INT,
+                               vbo ? NULL : &level->triangles[0]);
+            glPopMatrix();
+
+            mFrameStats.drawCalls++;
+            mFrameStats.vertices += mCurrRenderType == POINTS ? (long)level->positions.size() / 3
+                                                              : (long)level->triangles.size();
+        }
+
+        if(vbo)
+        {
+            buffers->indices.release();
+            buffers->positions.release();
+        }
+    }
+
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glShadeModel(GL_SMOOTH);
+}
+
+void ViewPortWidget::uploadSceneBuffers(){
+    if(mSceneBuffers.size() == mScene->objects.size())
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+    long bytes = 0;
+    for(size_t i=0; i<mScene->objects.size(); i++)
+    {
+        const LodLevel* level = mScene->objects[i].triangles.data();
+        SceneBuffers* buffers = new SceneBuffers();
+        buffers->level = level;
+        buffers->uploaded = !level->triangles.empty() &&
+                            buffers->positions.create() &&
+                            buffers->normals.create() &&
+                            buffers->indices.create();
+        if(buffers->uploaded)
+        {
+            buffers->positions.bind();
+            buffers->positions.allocate(&level->positions[0], (int)(level->positions.size() * sizeof(float)));
+            buffers->positions.release();
+            buffers->normals.bind();
+            buffers->normals.allocate(&level->normals[0], (int)(level->normals.size() * sizeof(float)));
+            buffers->normals.release();
+            buffers->indices.bind();
+            buffers->indices.allocate(&level->triangles[0], (int)(level->triangles.size() * sizeof(unsigned int)));
+            buffers->indices.release();
+            bytes += (long)((level->positions.size() + level->normals.size()) * sizeof(float) +
+                            level->triangles.size() * sizeof(unsigned int));
+        }
+        mSceneBuffers.push_back(buffers);
+    }
+    qDebug() << "Uploaded" << (int)mSceneBuffers.size() << "scene meshes," << (bytes >> 10) << "KB in"
+             << timer.elapsed() << "ms";
+}
+
+void ViewPortWidget::releaseSceneBuffers(){
+    if(mSceneBuffers.empty())
+        return;
+    makeCurrent();
+    for(size_t i=0; i<mSceneBuffers.size(); i++)
+    {
+        mSceneBuffers[i]->positions.destroy();
+        mSceneBuffers[i]->normals.destroy();
+        mSceneBuffers[i]->indices.destroy();
+        delete mSceneBuffers[i];
+    }
+    mSceneBuffers.clear();
+}
+
+/**
+ * @brief lodActive
+ * True while the camera is dragged in a shaded mode with auto LOD on and a
+ * chain to pick from; only then are frame times measured and levels swapped.
+ */
+bool ViewPortWidget::lodActive() const{
+    const bool shaded = (mCurrRenderType == FLAT_SHADING ||
+                         mCurrRenderType == SMOOTH_SHADING);
+    return m_autoLod && mInteracting && shaded && !mLodChain.empty();
+}
+
+/**
+ * @brief selectLodLevel
+ * While the camera is dragged in a shaded mode, steps to a coarser level
+ * when the measured frame time of the current level exceeds the budget and
+ * back to a finer one when that level's measured (or, if never drawn,
+ * triangle-scaled) time fits comfortably within it.
+ */
+void ViewPortWidget::selectLodLevel(){
+    if(!lodActive())
+    {
+        mLodLevel = 0;
+        return;
+    }
+
+    float current = mLodFrameMs[mLodLevel];
+    if(current <= 0.0f)
+        return;
+
+    if(current > mFrameBudgetMs && mLodLevel < (int)mLodChain.size())
+    {
+        mLodLevel++;
+    }
+    else if(mLodLevel > 0)
+    {
+        float finer = mLodFrameMs[mLodLevel-1];
+        if(finer <= 0.0f)
+        {
+            long finerTris = (mLodLevel==1) ? (long)triangleMesh->faceVector->size()
+                                           : mLodChain[mLodLevel-2]->triangleCount();
+            long tris = qMax(1L, mLodChain[mLodLevel-1]->triangleCount());
+            finer = current * finerTris / tris;
+        }
+        if(finer < 0.8f * mFrameBudgetMs)
+            mLodLevel--;
+    }
+}
+
+void ViewPortWidget::recordFrameTime(float ms){
+    float& average = mLodFrameMs[mLodLevel];
+    average = (average <= 0.0f) ? ms : 0.7f * average + 0.3f * ms;
+}
+
+void ViewPortWidget::clearLodChain(){
+    for(size_t i=0; i<mLodChain.size(); i++)
+        delete mLodChain[i];
+    mLodChain.clear();
+    mLodFrameMs.assign(1, 0.0f);
+    mLodLevel = 0;
 }
 
 //Not used - only for testing
@@ -710,6 +1169,23 @@ void ViewPortWidget::setRenderType(RENDER_TYPE type)
     updateGL();
 }
 
+void ViewPortWidget::setPointLod(bool enabled)
+{
+    m_pointLod = enabled;
+    updateGL();
+}
+
+void ViewPortWidget::setInteractivePointBudget(long points)
+{
+    mPointBudget = points;
+}
+
+void ViewPortWidget::highlightOpenEdges(bool highlight)
+{
+    m_highlightEdges = highlight;
+    updateGL();
+}
+
 void ViewPortWidget::setOrthoView(ORTHO_VIEW_TYPE view)
 {
     mCurrentOrthoView = view;
@@ -727,6 +1203,42 @@ void ViewPortWidget::setLightPosition(float position){
     updateGL();
 }
 
+ViewPortWidget::FrameStats ViewPortWidget::lastFrameStats()
+{
+    return mFrameStats;
+}
+
+RenderCamera ViewPortWidget::camera()
+{
+    RenderCamera cam;
+    cam.xRotation = xAxisRotation;
+    cam.yRotation = yAxisRotation;
+    cam.zRotation = zAxisRotation;
+    cam.eyeX = eyeX;
+    cam.eyeY = eyeY;
+    cam.eyeZ = eyeZ;
+    cam.perspective = perspective_projection;
+    cam.lightDistance = light_distance;
+    cam.multipleLights = multipleLights;
+    return cam;
+}
+
+//Camera set up by setProjection for the default perspective view
+RenderCamera ViewPortWidget::defaultCamera()
+{
+    RenderCamera cam;
+    cam.xRotation = 22.0f;
+    cam.yRotation = 0.0f;
+    cam.zRotation = 0.0f;
+    cam.eyeX = 0.0f;
+    cam.eyeY = 0.0f;
+    cam.eyeZ = -5.0f;
+    cam.perspective = true;
+    cam.lightDistance = 1.0f;
+    cam.multipleLights = true;
+    return cam;
+}
+
 QVector3D ViewPortWidget::getLookAtVector()
 {
     GLfloat mat[16];
@@ -736,91 +1248,307 @@ QVector3D ViewPortWidget::getLookAtVector()
     return lookAtV;
 }
 
-class SaveThread : public QThread
+/**
+ * @brief setMesh
+ * Shows the mesh and starts generating its LOD chain in the background.
+ */
+void ViewPortWidget::setMesh(MeshSnapshot mesh)
+{
+    if(!mesh.isNull() && !mScene.isNull())
+    {
+        releaseSceneBuffers();
+        mScene.clear();
+    }
+    //Compared as snapshots, so the old mesh is still alive and no address can repeat
+    if(mesh != mMesh)
+        mMeshGeneration++;
+    mMesh = mesh;
+    triangleMesh = mesh.data();
+    clearLodChain();
+    if(!mesh.isNull() && mLodJob==NULL)
+    {
+        LodBuildJob* job = new LodBuildJob(mesh, mJobs.token());
+        mLodJob = job;
+        mJobs.run([this, job]() {
+            job->run();
+            QMetaObject::invokeMethod(this, "lodChainReady", Qt::QueuedConnection);
+        });
+    }
+    updateGL();
+}
+
+void ViewPortWidget::lodChainReady()
+{
+    LodBuildJob* job = mLodJob;
+    mLodJob = NULL;
+    if(job->sMesh.data() == triangleMesh)
+    {
+        clearLodChain();
+        mLodChain = job->sChain;
+        mLodFrameMs.assign(mLodChain.size()+1, 0.0f);
+    }
+    else
+    {
+        for(size_t i=0; i<job->sChain.size(); i++)
+            delete job->sChain[i];
+        //The mesh changed while building; start over for the current one
+        if(triangleMesh!=NULL)
+            setMesh(mMesh);
+    }
+    delete job;
+}
+
+MeshSnapshot ViewPortWidget::sharedMesh() const
+{
+    return mMesh;
+}
+
+void ViewPortWidget::setScene(QSharedPointer<const Scene> scene)
+{
+    releaseSceneBuffers();
+    mScene = scene;
+    setMesh(MeshSnapshot());
+}
+
+void ViewPortWidget::setAutoLod(bool enabled)
+{
+    m_autoLod = enabled;
+    updateGL();
+}
+
+void ViewPortWidget::setFrameTimeBudget(float ms)
+{
+    mFrameBudgetMs = ms;
+}
+
+class SaveJob
 {
 public:
-    SaveThread(QSharedPointer<PolygonMesh> mesh, QString f_name){
+    SaveJob(MeshSnapshot mesh, QString f_name, long minComponentFaces = 0){
         sFileName = f_name;
         sOutMesh = mesh;
+        sMinComponentFaces = minComponentFaces;
+        sClusterGraph = false;
+        sCompact = false;
+        sTiled = false;
+        sTileSize = 0.0f;
+        sMergeCoplanar = false;
+        sFilterWalkable = false;
+        sPathMesh = NULL;
     }
+    CancellationToken sToken;
+    bool sClusterGraph;
+    bool sCompact;
+    bool sTiled;
+    float sTileSize;
+    bool sMergeCoplanar;
+    bool sFilterWalkable;
+    WalkabilityFilter sWalkability;
 
-private:
     void run()
     {
-        QJsonObject path_points_obj;
-        QJsonArray path_points;
-        qDebug() << "Save started";
-        std::vector<PolygonMesh::HE_edge>::iterator iv = sOutMesh.data()->edgeVector->begin();
-        while (iv != sOutMesh.data()->edgeVector->end()) {
-            QJsonObject obj;
-            obj["index"] = iv->face->index;
-            obj["x"] = iv->face->centroid->x;
-            obj["y"] = iv->face->centroid->y;
-            obj["z"] = iv->face->centroid->z;
-
-            QJsonArray link_list;
-            PolygonMesh::HE_edge* edge = &(*iv);
-            get_linked_faces(edge,&link_list);
-            obj["linked_indexes"] = link_list;
-
-            path_points.append(obj);
-            ++iv;
-            //qDebug() << "Adding points-> " << obj["x"] << " " << obj["y"] << " " << obj["z"];
+        //Path nodes are either the faces or the merged coplanar polygons
+        QScopedPointer<PolygonMesh> merged;
+        sPathMesh = sOutMesh.data();
+        if(sMergeCoplanar)
+        {
+            CoplanarMerger merger(sPathMesh);
+            merged.reset(merger.merge());
+            sPathMesh = merged.data();
         }
+        if(sFilterWalkable)
+            sWalkability.classify(sPathMesh);
+        //Checked between the steps; a file being written is finished
+        if(cancelled())
+            return;
 
-        qDebug() << "Writing json";
+        if(sTiled)
+        {
+            FaceGraph graph;
+            buildGraph(graph);
+            PathGraphTiler tiler;
+            tiler.setTileSize(sTileSize);
+            int tiles = tiler.write(graph, sFileName);
+            if(tiles>=0)
+                qDebug() << "Saved" << tiles << "path graph tiles indexed by" << sFileName;
+            return;
+        }
+
+        if(sFileName.endsWith(".pgraph"))
+        {
+            FaceGraph graph;
+            buildGraph(graph);
+            PathGraphWriter writer;
+            writer.setNormals(true);
+            if(writer.write(graph, sPathMesh, sFileName))
+                qDebug() << "Saved" << sFileName;
+            return;
+        }
 
-        path_points_obj["pedestrian_path_points"] = path_points;
-        QByteArray b = QJsonDocument(path_points_obj).toJson(QJsonDocument::Indented);
+        if(sMinComponentFaces<=0)
+        {
+            writePathPoints(sFileName, NULL, -1);
+            if(sClusterGraph && !cancelled())
+                writeClusterGraph();
+            return;
+        }
 
-        QFile file(sFileName);
-        file.open(QIODevice::WriteOnly);
-        file.write(b);
-        file.close();
-        qDebug() << "Save Complete";
+        //One file per component, smaller islands are left out
+        MeshComponents components(sPathMesh);
+        components.label();
+        QFileInfo info(sFileName);
+        for(int c=0; c<components.componentCount() && !cancelled(); c++)
+        {
+            if(components.component(c).faces < sMinComponentFaces)
+                break;
+            QString name = info.dir().filePath(QString("%1_component%2.json")
+                                               .arg(info.completeBaseName()).arg(c));
+            writePathPoints(name, &components.faceComponents(), c);
+        }
     }
 
-    void get_linked_faces(PolygonMesh::HE_edge* edge, QJsonArray* link_list){
-
-        long currentIndex = edge->face->index;
+private:
+    bool cancelled() const
+    {
+        if(sToken.isCancelled())
+            qDebug() << "Export to" << sFileName << "cancelled";
+        return sToken.isCancelled();
+    }
 
-        PolygonMesh::HE_edge* outgoing_he=nullptr;
-        PolygonMesh::HE_edge* curr = edge;
+    //Face graph of the exported mesh with unwalkable links dropped or reweighted
+    void buildGraph(FaceGraph& graph)
+    {
+        graph.build(sPathMesh);
+        if(sFilterWalkable)
+            sWalkability.apply(graph);
+    }
 
-        int count=0;
-        while(curr!=outgoing_he)
+    //<name>_clusters.json next to the path points, same face indices
+    void writeClusterGraph()
+    {
+        QFileInfo info(sFileName);
+        QFile file(info.dir().filePath(info.completeBaseName() + "_clusters.json"));
+        if(!file.open(QIODevice::WriteOnly))
         {
-            if(count>2) //Only supports triangle geometry
-                break;
-            count++;
-
-            if(outgoing_he==nullptr)
-                outgoing_he = curr;
+            qWarning() << "Unable to write cluster graph:" << file.errorString();
+            return;
+        }
 
-            //qDebug() << "Current edge index -> " << curr->index;
+        FaceGraph graph;
+        buildGraph(graph);
+        ClusterGraph clusters(&graph);
+        clusters.build();
 
-            if (curr->pair != NULL)
-            {
-                QJsonObject link;
-                const long end_index  = curr->pair->face->index;
-                link["start_index"] = currentIndex;
-                link["end_index"] = end_index;
+        QByteArray json = QJsonDocument(clusters.toJson()).toJson(QJsonDocument::Indented);
+        bool ok = file.write(json) == (qint64)json.size();
+        file.close();
+        if(ok)
+            qDebug() << "Saved" << file.fileName();
+        else
+            qWarning() << "Unable to write cluster graph:" << file.errorString();
+    }
 
-                link_list->append(link);
-                qDebug() << "adding link: " << currentIndex << " -> " << end_index;
-            }
-            curr = curr->prev;
+    void writePathPoints(QString fileName, const std::vector<int>* faceComponent, int component)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        PathPointWriter writer;
+        writer.setPretty(!sCompact);
+        writer.setPortals(sMergeCoplanar);
+        std::vector<int> walkableComponent;
+        if(sFilterWalkable && sWalkability.mode()==WalkabilityFilter::WeightLinks)
+            writer.setFaceCosts(&sWalkability.faceCosts());
+        else if(sFilterWalkable)
+        {
+            //Unwalkable faces leave the component filter
+            const std::vector<int>& walkable = sWalkability.walkable();
+            walkableComponent.resize(walkable.size());
+            for(size_t f=0; f<walkable.size(); f++)
+                walkableComponent[f] = !walkable[f] ? -1 : (faceComponent!=NULL ? faceComponent->at(f) : 0);
+            faceComponent = &walkableComponent;
+            component = qMax(0, component);
         }
+        writer.setFaceFilter(faceComponent, component);
+        if(writer.write(sPathMesh, fileName))
+            qDebug() << "Saved" << fileName << "in" << timer.elapsed() << "ms";
     }
 
     QString sFileName;
-    QSharedPointer<PolygonMesh> sOutMesh;
+    MeshSnapshot sOutMesh;
+    const PolygonMesh* sPathMesh;
+    long sMinComponentFaces;
 };
 
 
 
 void ViewPortWidget::savePathPointsToJson(QString f_name){
-    QSharedPointer<PolygonMesh> mesh = QSharedPointer<PolygonMesh>(triangleMesh);
-    SaveThread* t = new SaveThread(mesh, f_name);
-    t->start();
+    if(mMesh.isNull())
+        return;
+    SaveJob* t = new SaveJob(mMesh, f_name);
+    t->sClusterGraph = m_exportClusterGraph;
+    t->sCompact = m_compactJson;
+    t->sMergeCoplanar = m_mergeCoplanar;
+    setWalkability(t);
+    startSave(t);
+}
+
+void ViewPortWidget::saveTiledPathGraph(QString f_name, float tileSize){
+    if(mMesh.isNull())
+        return;
+    SaveJob* t = new SaveJob(mMesh, f_name);
+    t->sTiled = true;
+    t->sMergeCoplanar = m_mergeCoplanar;
+    setWalkability(t);
+    t->sTileSize = tileSize;
+    startSave(t);
+}
+
+void ViewPortWidget::setExportClusterGraph(bool enabled){
+    m_exportClusterGraph = enabled;
+}
+
+void ViewPortWidget::setCompactJson(bool compact){
+    m_compactJson = compact;
+}
+
+void ViewPortWidget::setMergeCoplanar(bool merge){
+    m_mergeCoplanar = merge;
+}
+
+void ViewPortWidget::setWalkableOnly(bool enabled, float maxSlope, float clearance){
+    m_walkableOnly = enabled;
+    m_maxSlope = maxSlope;
+    m_clearance = clearance;
+}
+
+void ViewPortWidget::setWeightUnwalkable(bool weight){
+    m_weightLinks = weight;
+}
+
+void ViewPortWidget::setWalkability(SaveJob* t){
+    t->sFilterWalkable = m_walkableOnly;
+    t->sWalkability.setMaxSlope(m_maxSlope);
+    t->sWalkability.setClearance(m_clearance);
+    t->sWalkability.setMode(m_weightLinks ? WalkabilityFilter::WeightLinks
+                                          : WalkabilityFilter::DropLinks);
+}
+
+void ViewPortWidget::saveComponentPathPointsToJson(QString f_name, long minFaces){
+    if(mMesh.isNull())
+        return;
+    SaveJob* t = new SaveJob(mMesh, f_name, qMax(1L, minFaces));
+    t->sCompact = m_compactJson;
+    t->sMergeCoplanar = m_mergeCoplanar;
+    setWalkability(t);
+    startSave(t);
+}
+
+//Runs the save on the shared pool; the job keeps the mesh alive until done
+void ViewPortWidget::startSave(SaveJob* t){
+    t->sToken = mJobs.token();
+    //Owned by the task, which is also freed when it is cancelled before running
+    QSharedPointer<SaveJob> job(t);
+    mJobs.run([job]() {
+        job->run();
+    });
 }
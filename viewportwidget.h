@@ -2,8 +2,14 @@
 #define MYGLWIDGET_H
 
 #include <QGLWidget>
+#include <QGLBuffer>
 #include <QVector3D>
+#include <QSharedPointer>
 #include "trianglemesh.h"
+#include "rendercamera.h"
+#include "meshlod.h"
+#include "parallel.h"
+#include "scene.h"
 #ifdef _WIN32
     #include <Windows.h>
     #include <GL/glu.h>
@@ -11,13 +17,18 @@
     #include <OpenGL/glu.h>
 #endif
 
+class LodBuildJob;
+class SaveJob;
+struct SceneBuffers;
+
 class ViewPortWidget : public QGLWidget
 {
     Q_OBJECT
 public:
     explicit ViewPortWidget(QWidget *parent = 0);
     ~ViewPortWidget();
-    PolygonMesh* triangleMesh;
+    //Read-only view of mMesh
+    const PolygonMesh* triangleMesh;
     //Render types
     enum RENDER_TYPE{
         POINTS,
@@ -30,6 +41,11 @@ public:
         XZ,
         YZ
     };
+    //Counters for the last painted frame
+    struct FrameStats {
+        long drawCalls;
+        long vertices;
+    };
     void setXAxisRotation(float angle);
     void setYAxisRotation(float angle);
     void setZAxisRotation(float angle);
@@ -42,9 +58,37 @@ public:
     void showBoundingBox(bool show);
     void setOrthoView(ORTHO_VIEW_TYPE view);
     void setRenderType(RENDER_TYPE type);
+    void highlightOpenEdges(bool highlight);
+    void setPointLod(bool enabled);
+    void setInteractivePointBudget(long points);
+    //Shows a snapshot that may also be held by the cache or jobs
+    void setMesh(MeshSnapshot mesh);
+    MeshSnapshot sharedMesh() const;
+    //Replaces the mesh with a scene of instanced meshes; NULL clears it
+    void setScene(QSharedPointer<const Scene> scene);
+    void setAutoLod(bool enabled);
+    void setFrameTimeBudget(float ms);
     void setAxisHeight(float height);
     void setLightPosition(float position);
     void savePathPointsToJson(QString fileName);
+    //Tiles next to the JSON index fileName; tileSize 0 picks one
+    void saveTiledPathGraph(QString fileName, float tileSize);
+    void saveComponentPathPointsToJson(QString fileName, long minFaces);
+    void setExportClusterGraph(bool enabled);
+    void setCompactJson(bool compact);
+    //Export merged coplanar polygons with portal edges instead of faces
+    void setMergeCoplanar(bool merge);
+    //Export only faces within maxSlope degrees of +y with clearance free above them
+    void setWalkableOnly(bool enabled, float maxSlope, float clearance);
+    //Keep unwalkable faces and raise their link costs instead of dropping them
+    void setWeightUnwalkable(bool weight);
+    void changeCameraZoom(float change);
+    FrameStats lastFrameStats();
+    RenderCamera camera();
+    static RenderCamera defaultCamera();
+
+private slots:
+    void lodChainReady();
 
 protected:
     void initializeGL();
@@ -52,10 +96,10 @@ protected:
     void resizeGL(int width, int height);
     void mousePressEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
     void setLightingParams();
     void changeCameraPositionOnXAxis(float change);
     void changeCameraPositionOnYAxis(float change);
-    void changeCameraZoom(float change);
     void perspective(GLdouble fovy, GLdouble aspect, GLdouble zNear, GLdouble zFar);
     void setProjection();
 
@@ -67,6 +111,20 @@ private:
     void drawBoundingBox();
     void drawObject();
     void drawFace(PolygonMesh::HE_edge* edge);
+    void drawTriangles();
+    void drawWireframe();
+    void drawLineIndices(const std::vector<unsigned int>& indices);
+    void drawPoints();
+    const GLvoid* bindPositionBuffer();
+    void releasePositionBuffer();
+    void drawLodLevel(LodLevel* level);
+    void drawScene();
+    void uploadSceneBuffers();
+    void releaseSceneBuffers();
+    bool lodActive() const;
+    void selectLodLevel();
+    void recordFrameTime(float ms);
+    void clearLodChain();
     void traverse_halfedge(PolygonMesh::HE_edge* edge);
     void normalizeAngle(float &angle);
     void normalizeMotion(float &x);
@@ -90,8 +148,40 @@ private:
     bool m_showAxis;
     bool m_showGround;
     bool m_showBoundingBox;
+    bool m_highlightEdges;
+    bool m_pointLod;
+    long mPointBudget;
+    bool mInteracting;
+    QGLBuffer mPositionBuffer;
+    //Bumped by setMesh; the VBO holds the positions of mPositionBufferGeneration
+    unsigned long mMeshGeneration;
+    unsigned long mPositionBufferGeneration;
+    bool m_autoLod;
+    float mFrameBudgetMs;
+    //Level 0 is the full mesh, level i draws mLodChain[i-1]
+    int mLodLevel;
+    std::vector<LodLevel*> mLodChain;
+    std::vector<float> mLodFrameMs;
+    LodBuildJob* mLodJob;
+    //Owner of triangleMesh; background jobs hold their own references
+    MeshSnapshot mMesh;
+    QSharedPointer<const Scene> mScene;
+    //One set of GPU buffers per scene object, shared by its instances
+    std::vector<SceneBuffers*> mSceneBuffers;
     float axis_height;
     float light_distance;
+    FrameStats mFrameStats;
+    bool m_exportClusterGraph;
+    bool m_compactJson;
+    bool m_mergeCoplanar;
+    bool m_walkableOnly;
+    float m_maxSlope;
+    float m_clearance;
+    bool m_weightLinks;
+    void setWalkability(SaveJob* t);
+    void startSave(SaveJob* t);
+    //LOD builds and saves on the shared pool; waited for on destruction
+    TaskGroup mJobs;
 };
 
 #endif // MYGLWIDGET_H
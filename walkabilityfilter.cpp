@@ -0,0 +1,321 @@
+#include "walkabilityfilter.h"
+#include "parallel.h"
+#include "meshbuffers.h"
+#include "facetriangulator.h"
+
+#include <QDebug>
+#include <cmath>
+#include <atomic>
+
+const float WalkabilityFilter::blockedCost = 1000.0f;
+
+namespace {
+
+//Unit Newell normal of a face loop; zero for degenerate faces
+void faceNormal(PolygonMesh::HE_face* face, float* n)
+{
+    FaceTriangulator::newellNormal(face, n);
+    const float length = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    if(length>0.0f)
+    {
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+    }
+}
+
+inline float dot(const float* a, const float* b)
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+/**
+ * Faces bucketed by their footprint on the plane perpendicular to the up
+ * axis, for vertical ray queries.
+ */
+class ClearanceGrid
+{
+public:
+    ClearanceGrid(const PolygonMesh* mesh, const float* up)
+    {
+        mMesh = mesh;
+        mBuffers = mesh->renderBuffers();
+        for(int a=0; a<3; a++)
+            mUp[a] = up[a];
+        //Any vector not parallel to up gives the in-plane basis
+        float helper[3] = {1.0f, 0.0f, 0.0f};
+        if(fabsf(up[0]) > 0.9f)
+        {
+            helper[0] = 0.0f;
+            helper[1] = 1.0f;
+        }
+        mU[0] = up[1]*helper[2] - up[2]*helper[1];
+        mU[1] = up[2]*helper[0] - up[0]*helper[2];
+        mU[2] = up[0]*helper[1] - up[1]*helper[0];
+        const float length = sqrtf(dot(mU, mU));
+        for(int a=0; a<3; a++)
+            mU[a] /= length;
+        mV[0] = up[1]*mU[2] - up[2]*mU[1];
+        mV[1] = up[2]*mU[0] - up[0]*mU[2];
+        mV[2] = up[0]*mU[1] - up[1]*mU[0];
+
+        const long faceCount = (long)mesh->faceVector->size();
+        std::vector<float> box(faceCount*4);
+        float minU = 0.0f, maxU = 0.0f, minV = 0.0f, maxV = 0.0f;
+        bool first = true;
+        for(long f=0; f<faceCount; f++)
+        {
+            PolygonMesh::HE_face* face = mesh->faceVector->at(f);
+            float* b = &box[f*4];
+            b[0] = b[2] = 1e30f;
+            b[1] = b[3] = -1e30f;
+            PolygonMesh::HE_edge* e = face->edge;
+            if(e==NULL)
+                continue;
+            do {
+                const float p[3] = {e->vert->x, e->vert->y, e->vert->z};
+                const float u = dot(p, mU), v = dot(p, mV);
+                b[0] = qMin(b[0], u);
+                b[1] = qMax(b[1], u);
+                b[2] = qMin(b[2], v);
+                b[3] = qMax(b[3], v);
+                e = e->next;
+            } while(e!=NULL && e!=face->edge);
+            if(first)
+            {
+                minU = b[0]; maxU = b[1]; minV = b[2]; maxV = b[3];
+                first = false;
+            }
+            minU = qMin(minU, b[0]);
+            maxU = qMax(maxU, b[1]);
+            minV = qMin(minV, b[2]);
+            maxV = qMax(maxV, b[3]);
+        }
+        //About four faces per cell if they were spread evenly
+        const float area = qMax(1e-12f, (maxU-minU)*(maxV-minV));
+        mCell = qMax(1e-6f, sqrtf(area * 4.0f / qMax(1L, faceCount)));
+        mMinU = minU;
+        mMinV = minV;
+        mWidth = qMin(2048, (int)((maxU-minU)/mCell) + 1);
+        mHeight = qMin(2048, (int)((maxV-minV)/mCell) + 1);
+        mCell = qMax((maxU-minU)/mWidth, (maxV-minV)/mHeight) * 1.0001f + 1e-6f;
+
+        std::vector<int> counts(mWidth*mHeight + 1, 0);
+        for(int pass=0; pass<2; pass++)
+        {
+            for(long f=0; f<faceCount; f++)
+            {
+                const float* b = &box[f*4];
+                if(b[0]>b[1])
+                    continue;
+                int u0, u1, v0, v1;
+                cellRange(b, u0, u1, v0, v1);
+                for(int v=v0; v<=v1; v++)
+                {
+                    for(int u=u0; u<=u1; u++)
+                    {
+                        if(pass==0)
+                            counts[v*mWidth+u+1]++;
+                        else
+                            mFaces[mOffsets[v*mWidth+u] + counts[v*mWidth+u]++] = (int)f;
+                    }
+                }
+            }
+            if(pass==0)
+            {
+                for(size_t c=1; c<counts.size(); c++)
+                    counts[c] += counts[c-1];
+                mOffsets = counts;
+                mFaces.resize(counts.back());
+                counts.assign(counts.size(), 0);
+            }
+        }
+    }
+
+    //Whether a face other than skip is hit within height above origin
+    bool blocked(const float* origin, float height, PolygonMesh::HE_face* skip) const
+    {
+        const float u = dot(origin, mU) - mMinU;
+        const float v = dot(origin, mV) - mMinV;
+        const int cu = qBound(0, (int)(u/mCell), mWidth-1);
+        const int cv = qBound(0, (int)(v/mCell), mHeight-1);
+        const int cell = cv*mWidth + cu;
+        for(int k=mOffsets[cell]; k<mOffsets[cell+1]; k++)
+        {
+            PolygonMesh::HE_face* face = mMesh->faceVector->at(mFaces[k]);
+            if(face!=skip && hits(face, origin, height))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    void cellRange(const float* b, int& u0, int& u1, int& v0, int& v1) const
+    {
+        u0 = qBound(0, (int)((b[0]-mMinU)/mCell), mWidth-1);
+        u1 = qBound(0, (int)((b[1]-mMinU)/mCell), mWidth-1);
+        v0 = qBound(0, (int)((b[2]-mMinV)/mCell), mHeight-1);
+        v1 = qBound(0, (int)((b[3]-mMinV)/mCell), mHeight-1);
+    }
+
+    //Moeller-Trumbore against the cached triangles of the face, ray along up
+    bool hits(PolygonMesh::HE_face* face, const float* origin, float height) const
+    {
+        const unsigned int* tris = mBuffers->triangles.empty() ? NULL : &mBuffers->triangles[0];
+        const float* positions = &mBuffers->positions[0];
+        const unsigned int end = mBuffers->faceTriangleOffsets[face->index];
+        for(unsigned int k=mBuffers->faceTriangleOffsets[face->index-1]; k<end; k++)
+        {
+            const float* p0 = &positions[tris[k*3]*3];
+            const float* p1 = &positions[tris[k*3+1]*3];
+            const float* p2 = &positions[tris[k*3+2]*3];
+            const float e1[3] = {p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2]};
+            const float e2[3] = {p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2]};
+            const float p[3] = {mUp[1]*e2[2]-mUp[2]*e2[1], mUp[2]*e2[0]-mUp[0]*e2[2], mUp[0]*e2[1]-mUp[1]*e2[0]};
+            const float det = dot(e1, p);
+            if(fabsf(det) < 1e-12f)
+                continue;
+            const float inv = 1.0f / det;
+            const float s[3] = {origin[0]-p0[0], origin[1]-p0[1], origin[2]-p0[2]};
+            const float a = dot(s, p) * inv;
+            if(a<0.0f || a>1.0f)
+                continue;
+            const float q[3] = {s[1]*e1[2]-s[2]*e1[1], s[2]*e1[0]-s[0]*e1[2], s[0]*e1[1]-s[1]*e1[0]};
+            const float b = dot(mUp, q) * inv;
+            if(b<0.0f || a+b>1.0f)
+                continue;
+            const float t = dot(e2, q) * inv;
+            if(t>0.0f && t<=height)
+                return true;
+        }
+        return false;
+    }
+
+    const PolygonMesh* mMesh;
+    const MeshBuffers* mBuffers;
+    float mUp[3], mU[3], mV[3];
+    float mMinU, mMinV, mCell;
+    int mWidth, mHeight;
+    std::vector<int> mOffsets;
+    std::vector<int> mFaces;
+};
+
+}
+
+WalkabilityFilter::WalkabilityFilter()
+{
+    mUp[0] = 0.0f;
+    mUp[1] = 1.0f;
+    mUp[2] = 0.0f;
+    mMaxSlope = 45.0f;
+    mClearance = 0.0f;
+    mMode = DropLinks;
+    mWalkableCount = 0;
+}
+
+void WalkabilityFilter::setUpAxis(float x, float y, float z){
+    const float length = sqrtf(x*x + y*y + z*z);
+    if(length<=0.0f)
+        return;
+    mUp[0] = x/length;
+    mUp[1] = y/length;
+    mUp[2] = z/length;
+}
+
+void WalkabilityFilter::setMaxSlope(float degrees){
+    mMaxSlope = qBound(0.0f, degrees, 180.0f);
+}
+
+void WalkabilityFilter::setClearance(float height){
+    mClearance = qMax(0.0f, height);
+}
+
+void WalkabilityFilter::setMode(Mode mode){
+    mMode = mode;
+}
+
+void WalkabilityFilter::classify(const PolygonMesh* mesh)
+{
+    const long faceCount = (long)mesh->faceVector->size();
+    mWalkable.assign(faceCount, 0);
+    mCost.assign(faceCount, blockedCost);
+    const float cosMax = cosf(mMaxSlope * (float)M_PI / 180.0f);
+
+    ClearanceGrid* grid = mClearance>0.0f ? new ClearanceGrid(mesh, mUp) : NULL;
+    //Start the ray just above the face so it does not hit its own plane
+    QVector3D extent = *mesh->maxVector - *mesh->minVector;
+    const float lift = qMax(1e-6f, 1e-5f * extent.length());
+
+    std::atomic<long> walkable(0);
+    parallelFor(0, faceCount, 4096, [&](long from, long to) {
+        long count = 0;
+        for(long f=from; f<to; f++)
+        {
+            PolygonMesh::HE_face* face = mesh->faceVector->at(f);
+            if(face->edge==NULL || face->centroid==NULL)
+                continue;
+            float n[3];
+            faceNormal(face, n);
+            const float c = qBound(-1.0f, dot(n, mUp), 1.0f);
+            if(c < cosMax)
+                continue;
+            if(grid!=NULL)
+            {
+                const float origin[3] = {face->centroid->x + mUp[0]*lift,
+                                         face->centroid->y + mUp[1]*lift,
+                                         face->centroid->z + mUp[2]*lift};
+                if(grid->blocked(origin, mClearance, face))
+                    continue;
+            }
+            mWalkable[f] = 1;
+            const float slope = acosf(c) * 180.0f / (float)M_PI;
+            mCost[f] = mMaxSlope>0.0f ? 1.0f + slope/mMaxSlope : 1.0f;
+            count++;
+        }
+        walkable += count;
+    });
+    delete grid;
+    mWalkableCount = walkable;
+    qDebug() << mWalkableCount << "of" << faceCount << "faces are walkable";
+}
+
+void WalkabilityFilter::apply(FaceGraph& graph) const
+{
+    const int nodeCount = graph.nodeCount();
+    if((int)mWalkable.size()!=nodeCount)
+        return;
+    if(mMode==WeightLinks)
+    {
+        parallelFor(0, nodeCount, 8192, [&](long from, long to) {
+            for(long n=from; n<to; n++)
+            {
+                for(int k=graph.offsets[n]; k<graph.offsets[n+1]; k++)
+                    graph.weights[k] *= mCost[graph.targets[k]];
+            }
+        });
+        return;
+    }
+
+    //Compact in place; unwalkable nodes keep their index but lose all links
+    int write = 0;
+    for(int n=0; n<nodeCount; n++)
+    {
+        const int begin = graph.offsets[n];
+        const int end = graph.offsets[n+1];
+        graph.offsets[n] = write;
+        if(!mWalkable[n])
+            continue;
+        for(int k=begin; k<end; k++)
+        {
+            if(mWalkable[graph.targets[k]])
+            {
+                graph.targets[write] = graph.targets[k];
+                graph.weights[write] = graph.weights[k];
+                write++;
+            }
+        }
+    }
+    graph.offsets[nodeCount] = write;
+    graph.targets.resize(write);
+    graph.weights.resize(write);
+}
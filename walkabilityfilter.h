@@ -0,0 +1,58 @@
+#ifndef WALKABILITYFILTER_H
+#define WALKABILITYFILTER_H
+
+#include <vector>
+
+#include "facegraph.h"
+
+/**
+ * Export-time classification of faces into walkable and unwalkable.
+ *
+ * A face is walkable if the angle between its normal and the up axis is at
+ * most the maximum slope, so walls, steep ramps and ceilings are rejected.
+ * With a clearance height set, a ray is also cast up from the centroid and
+ * the face is rejected if any other face lies within that height. Faces
+ * and rays are processed in parallel; rays query a grid over the plane
+ * perpendicular to the up axis.
+ *
+ * The result either removes unwalkable faces from the graph (DropLinks) or
+ * keeps every face and turns the classification into link costs
+ * (WeightLinks): a link into a face costs its length times
+ * 1 + slope/maxSlope, or times blockedCost if the face is unwalkable.
+ */
+class WalkabilityFilter
+{
+public:
+    enum Mode { DropLinks, WeightLinks };
+
+    explicit WalkabilityFilter();
+    void setUpAxis(float x, float y, float z);
+    void setMaxSlope(float degrees);
+    //Free height needed above a face in model units, 0 to skip the ray test
+    void setClearance(float height);
+    void setMode(Mode mode);
+    Mode mode() const { return mMode; }
+
+    void classify(const PolygonMesh* mesh);
+
+    //Indexed by face->index-1
+    const std::vector<int>& walkable() const { return mWalkable; }
+    const std::vector<float>& faceCosts() const { return mCost; }
+    long walkableCount() const { return mWalkableCount; }
+
+    //Drops or reweights the links of a graph built from the classified mesh
+    void apply(FaceGraph& graph) const;
+
+    static const float blockedCost;
+
+private:
+    float mUp[3];
+    float mMaxSlope;
+    float mClearance;
+    Mode mMode;
+    std::vector<int> mWalkable;
+    std::vector<float> mCost;
+    long mWalkableCount;
+};
+
+#endif // WALKABILITYFILTER_H
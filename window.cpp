@@ -5,6 +5,48 @@
 
 #include "viewportwidget.h"
 #include "mfileparser.h"
+#include "meshdecimator.h"
+#include "meshreorder.h"
+#include "meshcomponents.h"
+#include "scene.h"
+#include "meshfileio.h"
+
+class SimplifyJob
+{
+public:
+    SimplifyJob(MeshSnapshot mesh, long targetFaces){
+        sMesh = mesh;
+        sTargetFaces = targetFaces;
+        sResult = NULL;
+    }
+    MeshSnapshot sMesh;
+    long sTargetFaces;
+    PolygonMesh* sResult;
+
+    void run()
+    {
+        MeshDecimator decimator(sMesh.data());
+        decimator.setTargetFaceCount(sTargetFaces);
+        sResult = decimator.decimate();
+    }
+};
+
+class SceneLoadJob
+{
+public:
+    SceneLoadJob(QString fileName){
+        sFileName = fileName;
+        sScene = NULL;
+    }
+    QString sFileName;
+    SceneLoader sLoader;
+    Scene* sScene;
+
+    void run()
+    {
+        sScene = sLoader.load(sFileName);
+    }
+};
 
 Window::Window(QWidget *parent) :
     QMainWindow(parent),
@@ -14,15 +56,30 @@ Window::Window(QWidget *parent) :
 
     o_mesh = NULL;
     use_multi_threading = true;
+    mSimplifyJob = NULL;
+    mSceneJob = NULL;
+    mWeldEpsilon = 0.0f;
     connect(this,SIGNAL(startParsing()),&mParseWorker,SLOT(parse()));
+    connect(&mParseWorker,SIGNAL(verticesWelded(long)),this,SLOT(verticesWelded(long)));
+    connect(&mParseWorker,SIGNAL(parseFailed(QString)),this,SLOT(parseFailed(QString)));
     connect(&mParseWorker,SIGNAL(parseComplete(QSharedPointer<PolygonMesh>)),this,SLOT(render(QSharedPointer<PolygonMesh>)));
 
     createActions();
     createMenus();
+
+    mCacheLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(mCacheLabel);
+    updateCacheStatus();
 }
 
 Window::~Window()
 {
+    mJobs.cancel();
+    mJobs.wait();
+    delete mSimplifyJob;
+    if(mSceneJob!=NULL)
+        delete mSceneJob->sScene;
+    delete mSceneJob;
     delete ui;
 }
 
@@ -40,12 +97,92 @@ void Window::createActions()
     openAct->setShortcuts(QKeySequence::New);
     openAct->setStatusTip(tr("Open a new 3D Mesh"));
     connect(openAct, SIGNAL(triggered()), this, SLOT(open()));
+
+    openSceneAct = new QAction(tr("Open &Scene..."), this);
+    openSceneAct->setStatusTip(tr("Open a JSON scene of placed OBJ meshes"));
+    connect(openSceneAct, SIGNAL(triggered()), this, SLOT(openScene()));
+
+    saveMeshAct = new QAction(tr("Save Mesh &As..."), this);
+    saveMeshAct->setStatusTip(tr("Write the current mesh as OBJ, binary PLY or STL"));
+    connect(saveMeshAct, SIGNAL(triggered()), this, SLOT(saveMeshAs()));
+
+    simplifyAct = new QAction(tr("&Simplify..."), this);
+    simplifyAct->setStatusTip(tr("Reduce the triangle count of the current mesh"));
+    connect(simplifyAct, SIGNAL(triggered()), this, SLOT(simplify()));
+
+    reorderAct = new QAction(tr("Optimize Memory &Layout on Load"), this);
+    reorderAct->setCheckable(true);
+    reorderAct->setStatusTip(tr("Reorder vertices and faces for cache locality after loading"));
+    connect(reorderAct, SIGNAL(toggled(bool)), this, SLOT(reorderToggled(bool)));
+
+    weldAct = new QAction(tr("&Weld Vertices on Load..."), this);
+    weldAct->setCheckable(true);
+    weldAct->setStatusTip(tr("Merge duplicated vertices along seams so faces connect"));
+    connect(weldAct, SIGNAL(toggled(bool)), this, SLOT(weldToggled(bool)));
+
+    largestComponentAct = new QAction(tr("Keep &Largest Component"), this);
+    largestComponentAct->setStatusTip(tr("Drop every part not connected to the largest one"));
+    connect(largestComponentAct, SIGNAL(triggered()), this, SLOT(keepLargestComponent()));
+
+    saveComponentsAct = new QAction(tr("Save Path Points per &Component..."), this);
+    saveComponentsAct->setStatusTip(tr("Write one path point file per connected component"));
+    connect(saveComponentsAct, SIGNAL(triggered()), this, SLOT(saveComponentJson()));
+
+    saveTilesAct = new QAction(tr("Save &Tiled Path Graph..."), this);
+    saveTilesAct->setStatusTip(tr("Write the path graph as a grid of binary tiles with a JSON index"));
+    connect(saveTilesAct, SIGNAL(triggered()), this, SLOT(saveTiledGraph()));
+
+    clusterGraphAct = new QAction(tr("Export Cluster &Graph with Path Points"), this);
+    clusterGraphAct->setCheckable(true);
+    clusterGraphAct->setStatusTip(tr("Also write the hierarchical path graph when saving path points"));
+    connect(clusterGraphAct, SIGNAL(toggled(bool)), this, SLOT(clusterGraphToggled(bool)));
+
+    compactJsonAct = new QAction(tr("Compact Path Point &JSON"), this);
+    compactJsonAct->setCheckable(true);
+    compactJsonAct->setStatusTip(tr("Write path points without indentation"));
+    connect(compactJsonAct, SIGNAL(toggled(bool)), this, SLOT(compactJsonToggled(bool)));
+
+    mergeCoplanarAct = new QAction(tr("&Merge Coplanar Faces for Path Export"), this);
+    mergeCoplanarAct->setCheckable(true);
+    mergeCoplanarAct->setStatusTip(tr("Export convex polygons of coplanar faces as path nodes, with portal edges"));
+    connect(mergeCoplanarAct, SIGNAL(toggled(bool)), this, SLOT(mergeCoplanarToggled(bool)));
+
+    walkableAct = new QAction(tr("Export &Walkable Surfaces Only..."), this);
+    walkableAct->setCheckable(true);
+    walkableAct->setStatusTip(tr("Leave out faces that are too steep or lack head room"));
+    connect(walkableAct, SIGNAL(toggled(bool)), this, SLOT(walkableToggled(bool)));
+
+    weightUnwalkableAct = new QAction(tr("Weight Unwalkable Links Instead of Dropping"), this);
+    weightUnwalkableAct->setCheckable(true);
+    weightUnwalkableAct->setStatusTip(tr("Keep every face and write slope-based link costs"));
+    connect(weightUnwalkableAct, SIGNAL(toggled(bool)), this, SLOT(weightUnwalkableToggled(bool)));
+
+    cacheBudgetAct = new QAction(tr("Mesh &Cache Budget..."), this);
+    cacheBudgetAct->setStatusTip(tr("Memory kept for recently opened meshes"));
+    connect(cacheBudgetAct, SIGNAL(triggered()), this, SLOT(changeCacheBudget()));
 }
 
 void Window::createMenus()
 {
     fileMenu = menuBar()->addMenu(tr("&File"));
     fileMenu->addAction(openAct);
+    fileMenu->addAction(openSceneAct);
+    fileMenu->addAction(saveMeshAct);
+    fileMenu->addAction(cacheBudgetAct);
+
+    meshMenu = menuBar()->addMenu(tr("&Mesh"));
+    meshMenu->addAction(simplifyAct);
+    meshMenu->addAction(reorderAct);
+    meshMenu->addAction(weldAct);
+    meshMenu->addSeparator();
+    meshMenu->addAction(largestComponentAct);
+    meshMenu->addAction(saveComponentsAct);
+    meshMenu->addAction(saveTilesAct);
+    meshMenu->addAction(clusterGraphAct);
+    meshMenu->addAction(compactJsonAct);
+    meshMenu->addAction(mergeCoplanarAct);
+    meshMenu->addAction(walkableAct);
+    meshMenu->addAction(weightUnwalkableAct);
 }
 
 //bool use_multi_threading = true;
@@ -56,29 +193,35 @@ void Window::open(){
                 this,
                 tr("Open 3D Mesh"),
                 QDir::currentPath(),
-                tr("Wavefront (*.obj)") );
+                tr("Meshes (*.obj *.obj.gz *.obj.zst *.ply *.stl);;Wavefront (*.obj *.obj.gz *.obj.zst);;PLY (*.ply);;STL (*.stl)") );
     if( !filename.isEmpty() )
     {
-        lbl = new QLabel;
-        lbl->setFrameStyle(QFrame::Panel | QFrame::Sunken);
-        QMovie *movie = new QMovie(":/images/loading.gif");
-        lbl->setMovie(movie);
-        lbl->setAttribute(Qt::WA_TranslucentBackground);
-        lbl->setFixedSize(350,290);
-        lbl->setWindowModality(Qt::ApplicationModal);
-        lbl->setWindowFlags(Qt::FramelessWindowHint);
-        lbl->show();
-        movie->start();
+        //Unchanged files that were opened recently come from the cache
+        mPendingKey = MeshCache::key(filename, reorderAct->isChecked(), mWeldEpsilon);
+        MeshSnapshot cached = mMeshCache.find(mPendingKey);
+        if(!cached.isNull())
+        {
+            ui->viewPortWidget->setMesh(cached);
+            updateCacheStatus();
+            return;
+        }
+
+        showLoading();
 
 
         if(!use_multi_threading){
 
             OBJFileParser mFileParser;
+            mFileParser.setWeldEpsilon(mWeldEpsilon);
             out_mesh = mFileParser.parseFile( filename );
             if(out_mesh!=NULL)
             {
-                ui->viewPortWidget->triangleMesh = out_mesh;
-                ui->viewPortWidget->updateGL();
+                if(reorderAct->isChecked())
+                    MeshReorder::optimize(out_mesh);
+                MeshSnapshot mesh(out_mesh);
+                mMeshCache.insert(mPendingKey, mesh);
+                ui->viewPortWidget->setMesh(mesh);
+                updateCacheStatus();
             }
             else
             {
@@ -97,12 +240,73 @@ void Window::open(){
     }
 }
 
+void Window::showLoading(){
+    lbl = new QLabel;
+    lbl->setFrameStyle(QFrame::Panel | QFrame::Sunken);
+    QMovie *movie = new QMovie(":/images/loading.gif");
+    lbl->setMovie(movie);
+    lbl->setAttribute(Qt::WA_TranslucentBackground);
+    lbl->setFixedSize(350,290);
+    lbl->setWindowModality(Qt::ApplicationModal);
+    lbl->setWindowFlags(Qt::FramelessWindowHint);
+    lbl->show();
+    movie->start();
+}
+
+void Window::openScene(){
+    if(mSceneJob!=NULL)
+        return;
+    QString filename = QFileDialog::getOpenFileName(
+                this,
+                tr("Open Scene"),
+                QDir::currentPath(),
+                tr("Scene (*.json)") );
+    if(filename.isEmpty())
+        return;
+
+    showLoading();
+    SceneLoadJob* job = new SceneLoadJob(filename);
+    job->sLoader.setCancellationToken(mJobs.token());
+    job->sLoader.setWeldEpsilon(mWeldEpsilon);
+    job->sLoader.setReorder(reorderAct->isChecked());
+    mSceneJob = job;
+    mJobs.run([this, job]() {
+        job->run();
+        QMetaObject::invokeMethod(this, "sceneLoaded", Qt::QueuedConnection);
+    });
+}
+
+void Window::sceneLoaded(){
+    SceneLoadJob* job = mSceneJob;
+    mSceneJob = NULL;
+    lbl->close();
+    if(job->sScene!=NULL)
+    {
+        QSharedPointer<const Scene> scene(job->sScene);
+        ui->viewPortWidget->setScene(scene);
+        statusBar()->showMessage(tr("%1 instances of %2 meshes, %3 of %4 files shared")
+                                 .arg(scene->instanceCount())
+                                 .arg((int)scene->objects.size())
+                                 .arg(job->sLoader.sharedFileCount())
+                                 .arg(job->sLoader.fileCount()));
+    }
+    else
+    {
+        QMessageBox::warning(this, tr("Open Scene"),
+                             tr("Cannot load scene: %1").arg(job->sLoader.error()));
+    }
+    delete job;
+}
+
 void Window::render(QSharedPointer<PolygonMesh> sp){
     PolygonMesh* sInMesh = sp.data();
     if(sInMesh!=NULL){
 
-        ui->viewPortWidget->triangleMesh = sInMesh;
-        ui->viewPortWidget->updateGL();
+        //Published from here on; nothing may modify it any more
+        MeshSnapshot mesh = sp;
+        mMeshCache.insert(mPendingKey, mesh);
+        ui->viewPortWidget->setMesh(mesh);
+        updateCacheStatus();
     }
     else
     {
@@ -111,6 +315,221 @@ void Window::render(QSharedPointer<PolygonMesh> sp){
     lbl->close();
 }
 
+void Window::setReorderOnLoad(bool reorder){
+    reorderAct->setChecked(reorder);
+}
+
+void Window::setCacheBudget(long megabytes){
+    mMeshCache.setBudget((size_t)qMax(0L, megabytes) << 20);
+    updateCacheStatus();
+}
+
+void Window::changeCacheBudget(){
+    bool ok = false;
+    int megabytes = QInputDialog::getInt(this, tr("Mesh Cache Budget"),
+                                         tr("Memory for recently opened meshes (MB):"),
+                                         (int)(mMeshCache.budget() >> 20), 0, 1048576, 256, &ok);
+    if(ok)
+        setCacheBudget(megabytes);
+}
+
+void Window::updateCacheStatus(){
+    mCacheLabel->setText(tr("Cache: %1 meshes, %2 / %3 MB, %4 hits, %5 misses, %6 evictions")
+                         .arg(mMeshCache.count())
+                         .arg((qulonglong)(mMeshCache.memoryUsed() >> 20))
+                         .arg((qulonglong)(mMeshCache.budget() >> 20))
+                         .arg(mMeshCache.hits())
+                         .arg(mMeshCache.misses())
+                         .arg(mMeshCache.evictions()));
+}
+
+void Window::reorderToggled(bool checked){
+    mParseWorker.setReorder(checked);
+}
+
+void Window::setWeldEpsilon(float epsilon){
+    mWeldEpsilon = qMax(0.0f, epsilon);
+    mParseWorker.setWeldEpsilon(mWeldEpsilon);
+    weldAct->blockSignals(true);
+    weldAct->setChecked(mWeldEpsilon > 0.0f);
+    weldAct->blockSignals(false);
+}
+
+void Window::weldToggled(bool checked){
+    if(!checked)
+    {
+        setWeldEpsilon(0.0f);
+        return;
+    }
+    bool ok = false;
+    double epsilon = QInputDialog::getDouble(this, tr("Weld Vertices"),
+                                             tr("Merge vertices closer than (model units):"),
+                                             0.0001, 0.0, 1.0e9, 6, &ok);
+    setWeldEpsilon(ok ? (float)epsilon : 0.0f);
+}
+
+void Window::verticesWelded(long count){
+    statusBar()->showMessage(tr("Welded %1 duplicate vertices").arg(count));
+}
+
+//The parser runs on the pool and only reports; dialogs belong to this thread
+void Window::parseFailed(QString error){
+    QMessageBox::warning(this, tr("Open"), error.isEmpty() ? tr("The file could not be read.") : error);
+}
+
+void Window::keepLargestComponent(){
+    const PolygonMesh* mesh = ui->viewPortWidget->triangleMesh;
+    if(mesh==NULL)
+        return;
+
+    MeshComponents components(mesh);
+    components.label();
+    if(components.componentCount() > 1)
+        ui->viewPortWidget->setMesh(MeshSnapshot(components.extract(0)));
+}
+
+void Window::saveComponentJson(){
+    if(ui->viewPortWidget->triangleMesh==NULL)
+        return;
+
+    QString outFileName = QFileDialog::getSaveFileName(
+                this,
+                tr("Save Path Points per Component"),
+                QDir::homePath(),
+                tr("JSON (*.json)") );
+    if( outFileName.isEmpty() )
+        return;
+
+    bool ok = false;
+    int minFaces = QInputDialog::getInt(this, tr("Save Path Points per Component"),
+                                        tr("Skip components with fewer faces than:"),
+                                        100, 1, 1000000000, 1, &ok);
+    if(ok)
+        ui->viewPortWidget->saveComponentPathPointsToJson(outFileName, minFaces);
+}
+
+void Window::saveMeshAs(){
+    MeshSnapshot mesh = ui->viewPortWidget->sharedMesh();
+    if(mesh.isNull())
+        return;
+
+    QString selectedFilter;
+    QString outFileName = QFileDialog::getSaveFileName(
+                this,
+                tr("Save Mesh As"),
+                QDir::homePath(),
+                tr("Wavefront (*.obj);;PLY (*.ply);;STL (*.stl)"),
+                &selectedFilter );
+    if( outFileName.isEmpty() )
+        return;
+    if(!outFileName.endsWith(".obj") && !outFileName.endsWith(".ply") && !outFileName.endsWith(".stl"))
+    {
+        if(selectedFilter.startsWith("STL"))
+            outFileName.append(".stl");
+        else if(selectedFilter.startsWith("PLY"))
+            outFileName.append(".ply");
+        else
+            outFileName.append(".obj");
+    }
+
+    if(MeshFileIO::write(mesh.data(), outFileName))
+        statusBar()->showMessage(tr("Saved %1").arg(outFileName), 5000);
+    else
+        QMessageBox::warning(this, tr("Save Mesh As"), tr("Unable to write %1").arg(outFileName));
+}
+
+void Window::saveTiledGraph(){
+    if(ui->viewPortWidget->triangleMesh==NULL)
+        return;
+
+    QString outFileName = QFileDialog::getSaveFileName(
+                this,
+                tr("Save Tiled Path Graph"),
+                QDir::homePath(),
+                tr("Tile index (*.json)") );
+    if( outFileName.isEmpty() )
+        return;
+    if(!outFileName.endsWith(".json"))
+        outFileName.append(".json");
+
+    bool ok = false;
+    double tileSize = QInputDialog::getDouble(this, tr("Save Tiled Path Graph"),
+                                              tr("Tile size in model units (0 = automatic):"),
+                                              0.0, 0.0, 1.0e9, 3, &ok);
+    if(ok)
+        ui->viewPortWidget->saveTiledPathGraph(outFileName, (float)tileSize);
+}
+
+void Window::clusterGraphToggled(bool checked){
+    ui->viewPortWidget->setExportClusterGraph(checked);
+}
+
+void Window::compactJsonToggled(bool checked){
+    ui->viewPortWidget->setCompactJson(checked);
+}
+
+void Window::mergeCoplanarToggled(bool checked){
+    ui->viewPortWidget->setMergeCoplanar(checked);
+}
+
+void Window::walkableToggled(bool checked){
+    if(!checked)
+    {
+        ui->viewPortWidget->setWalkableOnly(false, 0.0f, 0.0f);
+        return;
+    }
+    bool ok = false;
+    double slope = QInputDialog::getDouble(this, tr("Walkable Surfaces"),
+                                           tr("Maximum slope in degrees:"),
+                                           45.0, 0.0, 90.0, 1, &ok);
+    double clearance = 0.0;
+    if(ok)
+        clearance = QInputDialog::getDouble(this, tr("Walkable Surfaces"),
+                                            tr("Clearance above the face in model units (0 = no check):"),
+                                            0.0, 0.0, 1.0e9, 4, &ok);
+    if(!ok)
+    {
+        walkableAct->setChecked(false);
+        return;
+    }
+    ui->viewPortWidget->setWalkableOnly(true, (float)slope, (float)clearance);
+}
+
+void Window::weightUnwalkableToggled(bool checked){
+    ui->viewPortWidget->setWeightUnwalkable(checked);
+}
+
+void Window::simplify(){
+    MeshSnapshot mesh = ui->viewPortWidget->sharedMesh();
+    if(mesh.isNull() || mSimplifyJob!=NULL)
+        return;
+
+    bool ok = false;
+    int percent = QInputDialog::getInt(this, tr("Simplify Mesh"),
+                                       tr("Keep percentage of faces:"),
+                                       10, 1, 99, 1, &ok);
+    if(!ok)
+        return;
+
+    long targetFaces = (long)mesh->faceVector->size() * percent / 100;
+    simplifyAct->setEnabled(false);
+    SimplifyJob* job = new SimplifyJob(mesh, targetFaces);
+    mSimplifyJob = job;
+    mJobs.run([this, job]() {
+        job->run();
+        QMetaObject::invokeMethod(this, "simplifyFinished", Qt::QueuedConnection);
+    });
+}
+
+void Window::simplifyFinished(){
+    PolygonMesh* result = mSimplifyJob->sResult;
+    delete mSimplifyJob;
+    mSimplifyJob = NULL;
+    simplifyAct->setEnabled(true);
+    if(result!=NULL)
+        ui->viewPortWidget->setMesh(MeshSnapshot(result));
+}
+
 void Window::on_enableLightBtn_clicked(bool checked)
 {
     ui->viewPortWidget->enableLight(checked);
@@ -231,6 +650,26 @@ void Window::on_pointsRb_toggled(bool checked)
         ui->viewPortWidget->setRenderType(ViewPortWidget::POINTS);
 }
 
+void Window::on_highlightEdgesCb_toggled(bool checked)
+{
+    ui->viewPortWidget->highlightOpenEdges(checked);
+}
+
+void Window::on_pointLodCb_toggled(bool checked)
+{
+    ui->viewPortWidget->setPointLod(checked);
+}
+
+void Window::on_autoLodCb_toggled(bool checked)
+{
+    ui->viewPortWidget->setAutoLod(checked);
+}
+
+void Window::setFrameTimeBudget(float ms)
+{
+    ui->viewPortWidget->setFrameTimeBudget(ms);
+}
+
 void Window::on_axisLengthSlider_sliderMoved(int value)
 {
     float height = value/10.0f;
@@ -249,14 +688,18 @@ void Window::on_pushButton_clicked()
 }
 
 void Window::saveJson(){
+    //Scenes have no single mesh to export
+    if(ui->viewPortWidget->sharedMesh().isNull())
+        return;
+
     QString outFileName = QFileDialog::getSaveFileName(
                 this,
                 tr("Save Path Points"),
                 QDir::homePath(),
-                tr("JSON (*.json)") );
+                tr("JSON (*.json);;Binary path graph (*.pgraph)") );
     if( !outFileName.isEmpty() )
     {
-        if(!outFileName.endsWith(".json"))
+        if(!outFileName.endsWith(".json") && !outFileName.endsWith(".pgraph"))
         {
             outFileName.append(".json");
         }
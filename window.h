@@ -11,6 +11,13 @@
 #include <QMainWindow>
 
 #include "parseworker.h"
+#include "parallel.h"
+#include "meshcache.h"
+
+class QLabel;
+
+class SimplifyJob;
+class SceneLoadJob;
 
 namespace Ui {
 class Window;
@@ -24,6 +31,11 @@ public:
     explicit Window(QWidget *parent = 0);
     ~Window();
     PolygonMesh* o_mesh;
+    void setFrameTimeBudget(float ms);
+    void setReorderOnLoad(bool reorder);
+    void setCacheBudget(long megabytes);
+    //0 loads vertices as they are
+    void setWeldEpsilon(float epsilon);
 
 signals:
 
@@ -35,16 +47,59 @@ protected:
 private:
     Ui::Window *ui;
     QMenu *fileMenu;
+    QMenu *meshMenu;
     QAction *openAct;
+    QAction *openSceneAct;
+    QAction *saveMeshAct;
+    QAction *simplifyAct;
+    QAction *reorderAct;
+    QAction *weldAct;
+    QAction *largestComponentAct;
+    QAction *saveComponentsAct;
+    QAction *saveTilesAct;
+    QAction *clusterGraphAct;
+    QAction *compactJsonAct;
+    QAction *mergeCoplanarAct;
+    QAction *walkableAct;
+    QAction *weightUnwalkableAct;
+    QAction *cacheBudgetAct;
+    QLabel *mCacheLabel;
+    MeshCache mMeshCache;
+    //Cache key of the file being parsed
+    QString mPendingKey;
     ParseWorker mParseWorker;
+    SimplifyJob* mSimplifyJob;
+    SceneLoadJob* mSceneJob;
+    TaskGroup mJobs;
     void createActions();
     void createMenus();
     void saveJson();
+    void updateCacheStatus();
+    void showLoading();
     bool use_multi_threading;
+    float mWeldEpsilon;
 
 public slots:
     void open();
+    void openScene();
+    void sceneLoaded();
+    void saveMeshAs();
     void render(QSharedPointer<PolygonMesh> sp);
+    void simplify();
+    void simplifyFinished();
+    void reorderToggled(bool checked);
+    void weldToggled(bool checked);
+    void verticesWelded(long count);
+    void parseFailed(QString error);
+    void keepLargestComponent();
+    void saveComponentJson();
+    void saveTiledGraph();
+    void clusterGraphToggled(bool checked);
+    void compactJsonToggled(bool checked);
+    void mergeCoplanarToggled(bool checked);
+    void walkableToggled(bool checked);
+    void weightUnwalkableToggled(bool checked);
+    void changeCacheBudget();
 
 private slots:
     void on_enableLightBtn_clicked(bool checked);
@@ -58,6 +113,9 @@ private slots:
     void on_flatShadingRb_toggled(bool checked);
     void on_wireframeRb_toggled(bool checked);
     void on_pointsRb_toggled(bool checked);
+    void on_highlightEdgesCb_toggled(bool checked);
+    void on_pointLodCb_toggled(bool checked);
+    void on_autoLodCb_toggled(bool checked);
     void on_colorMatBtn_clicked(bool checked);
     void on_xyRb_toggled(bool checked);
     void on_xzRb_toggled(bool checked);